@@ -0,0 +1,76 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "arena.h"
+
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+namespace sim {
+
+void Arena::Deleter::operator()(char *chunk) const {
+    ::operator delete(chunk, align_val_t(alignment));
+}
+
+Arena::Arena(size_t chunkSize)
+    : chunkSize(roundUp(chunkSize)) {
+}
+
+void *Arena::allocate(size_t bytes) {
+    bytes = roundUp(max<size_t>(bytes, sizeof(FreeBlock)));
+
+    ++stats.allocations;
+    stats.bytesInUse += bytes;
+
+    auto &freeList = freeLists[bytes];
+    if (freeList) {
+        auto block = freeList;
+        freeList = block->next;
+        ++stats.reused;
+        return block;
+    }
+
+    // Move on to the next chunk that has room, chunks are only added when
+    // all of them are full
+    while (current < chunks.size() && offset + bytes > chunkSizes[current]) {
+        ++current;
+        offset = 0;
+    }
+
+    if (current == chunks.size()) {
+        addChunk(bytes);
+    }
+
+    auto pointer = chunks[current].get() + offset;
+    offset += bytes;
+    return pointer;
+}
+
+void Arena::free(void *pointer, size_t bytes) {
+    if (!pointer) {
+        return;
+    }
+
+    bytes = roundUp(max<size_t>(bytes, sizeof(FreeBlock)));
+    stats.bytesInUse -= bytes;
+
+    auto &freeList = freeLists[bytes];
+    freeList = new (pointer) FreeBlock{freeList};
+}
+
+void Arena::addChunk(size_t minimumBytes) {
+    auto size = max(chunkSize, minimumBytes);
+
+    chunks.emplace_back(
+        static_cast<char *>(::operator new(size, align_val_t(alignment))));
+    chunkSizes.push_back(size);
+
+    current = chunks.size() - 1;
+    offset = 0;
+
+    ++stats.chunks;
+    stats.bytesReserved += size;
+}
+
+} // namespace sim
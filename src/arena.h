@@ -0,0 +1,129 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace sim {
+
+//! Memory for the objects of one world, taken from a few large chunks
+//!
+//! Objects that are added to the world together ends up next to each other,
+//! and tearing down the world frees everything with one call per chunk
+//! instead of one per object. Blocks that are freed are kept in a list per
+//! size, so despawning and spawning vehicles of the same kind reuses the
+//! same memory. Objects are never destructed by the arena
+class Arena {
+public:
+    //! Bullet objects are 16 byte aligned
+    static constexpr size_t alignment = 16;
+
+    struct Statistics {
+        //! Number of blocks handed out, including reused ones
+        size_t allocations = 0;
+
+        //! Allocations that was served from the free lists
+        size_t reused = 0;
+
+        //! Allocations from the system, one per chunk
+        size_t chunks = 0;
+
+        size_t bytesInUse = 0;
+        size_t bytesReserved = 0;
+    };
+
+    explicit Arena(size_t chunkSize = 64 * 1024);
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    //! Memory aligned to Arena::alignment
+    void *allocate(size_t bytes);
+
+    //! Give back a block to be reused by allocations of the same size
+    void free(void *pointer, size_t bytes);
+
+    const Statistics &statistics() const {
+        return stats;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct Deleter {
+        void operator()(char *chunk) const;
+    };
+
+    static size_t roundUp(size_t bytes) {
+        return (bytes + alignment - 1) & ~(alignment - 1);
+    }
+
+    void addChunk(size_t minimumBytes);
+
+    size_t chunkSize;
+
+    std::vector<std::unique_ptr<char, Deleter>> chunks;
+    std::vector<size_t> chunkSizes;
+
+    //! Chunk that is allocated from, and the offset in it
+    size_t current = 0;
+    size_t offset = 0;
+
+    std::map<size_t, FreeBlock *> freeLists;
+
+    Statistics stats;
+};
+
+//! Standard allocator that takes the memory from an arena, so that
+//! containers of objects in a world can use World::arena. Without an arena
+//! it falls back to std::allocator
+template <typename T>
+class ArenaAllocator {
+public:
+    static_assert(alignof(T) <= Arena::alignment,
+                  "the arena does not align to more than Arena::alignment");
+
+    using value_type = T;
+
+    ArenaAllocator(Arena *arena = nullptr)
+        : arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other)
+        : arena(other.arena) {}
+
+    T *allocate(size_t n) {
+        if (arena) {
+            return static_cast<T *>(arena->allocate(n * sizeof(T)));
+        }
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void deallocate(T *pointer, size_t n) {
+        if (arena) {
+            arena->free(pointer, n * sizeof(T));
+        }
+        else {
+            std::allocator<T>{}.deallocate(pointer, n);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena != other.arena;
+    }
+
+    Arena *arena;
+};
+
+} // namespace sim
@@ -0,0 +1,126 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "articulatedvehicle.h"
+
+#include "LinearMath/btAlignedAllocator.h"
+
+#include <new>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+//! Bullet objects needs 16 byte alignment, and their sizes are multiples of
+//! that, so the hinges can start right after the bodies
+const size_t alignment = Arena::alignment;
+
+static_assert(sizeof(btRigidBody) % alignment == 0,
+              "hinges are placed directly after the bodies");
+
+} // namespace
+
+ArticulatedVehicle::ArticulatedVehicle(
+    btDynamicsWorld *world,
+    const btTransform &transform,
+    shared_ptr<const VehicleDefinition> d,
+    Arena *arena)
+    : definition(move(d))
+    , world(world)
+    , arena(arena)
+    , throttleInput(definition->input("throttle"))
+    , steeringInput(definition->input("steering")) {
+    auto &def = *definition;
+
+    auto bodyBytes = sizeof(btRigidBody) * numBodies();
+    auto hingeBytes = sizeof(btHingeConstraint) * numHinges();
+
+    bytes = bodyBytes + hingeBytes;
+
+    auto memory = static_cast<char *>(
+        arena ? arena->allocate(bytes)
+              : btAlignedAlloc(static_cast<int>(bytes), alignment));
+
+    bodies = reinterpret_cast<btRigidBody *>(memory);
+    hinges = reinterpret_cast<btHingeConstraint *>(memory + bodyBytes);
+
+    for (size_t i = 0; i < numBodies(); ++i) {
+        auto &part = def.bodies[i];
+
+        btRigidBody::btRigidBodyConstructionInfo info(
+            part.mass, nullptr, part.collisionShape.get(), part.inertia);
+        info.m_startWorldTransform =
+            transform * btTransform(btQuaternion::getIdentity(), part.position);
+        info.m_friction = part.friction;
+        info.m_linearSleepingThreshold = def.sleepLinearVelocity;
+        info.m_angularSleepingThreshold = def.sleepAngularVelocity;
+
+        new (bodies + i) btRigidBody(info);
+    }
+
+    for (size_t i = 0; i < numHinges(); ++i) {
+        auto &part = def.hinges[i];
+        new (hinges + i) btHingeConstraint(bodies[part.bodyA],
+                                           bodies[part.bodyB],
+                                           part.pivotA,
+                                           part.pivotB,
+                                           part.axis,
+                                           part.axis);
+    }
+
+    for (size_t i = 0; i < numBodies(); ++i) {
+        world->addRigidBody(bodies + i);
+    }
+
+    for (size_t i = 0; i < numHinges(); ++i) {
+        world->addConstraint(hinges + i);
+    }
+}
+
+ArticulatedVehicle::~ArticulatedVehicle() {
+    for (size_t i = numHinges(); i-- > 0;) {
+        world->removeConstraint(hinges + i);
+        hinges[i].~btHingeConstraint();
+    }
+
+    for (size_t i = numBodies(); i-- > 0;) {
+        world->removeRigidBody(bodies + i);
+        bodies[i].~btRigidBody();
+    }
+
+    if (arena) {
+        arena->free(bodies, bytes);
+    }
+    else {
+        btAlignedFree(bodies);
+    }
+}
+
+void ArticulatedVehicle::control(int input, double value) {
+    if (input < 0) {
+        return;
+    }
+
+    if (value != 0) {
+        wake();
+    }
+
+    for (size_t i = 0; i < numHinges(); ++i) {
+        auto &motor = definition->hinges[i].motor;
+        if (motor.input == input) {
+            hinges[i].enableAngularMotor(
+                true,
+                static_cast<btScalar>(value * motor.scale),
+                static_cast<btScalar>(motor.maxImpulse));
+        }
+    }
+}
+
+void ArticulatedVehicle::wake() {
+    for (size_t i = 0; i < numBodies(); ++i) {
+        bodies[i].activate();
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,107 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "arena.h"
+#include "vehicledefinition.h"
+
+#include "BulletDynamics/ConstraintSolver/btHingeConstraint.h"
+#include "BulletDynamics/Dynamics/btDynamicsWorld.h"
+#include "BulletDynamics/Dynamics/btRigidBody.h"
+#include "transformsnapshot.h"
+
+#include <memory>
+
+namespace sim {
+
+class Culling;
+class RenderBatch;
+
+//! A vehicle built from a VehicleDefinition
+//! The shapes and inertia are shared with the definition, and the bodies
+//! and hinges are constructed in place in one allocation, so spawning a
+//! copy is that allocation and adding the parts to the world
+class ArticulatedVehicle {
+public:
+    //! The memory is taken from the arena if there is one, usually
+    //! World::arena, which then has to outlive the vehicle
+    ArticulatedVehicle(btDynamicsWorld *world,
+                       const btTransform &transform,
+                       std::shared_ptr<const VehicleDefinition> definition,
+                       Arena *arena = nullptr);
+
+    //! Removes everything from the world
+    ~ArticulatedVehicle();
+
+    ArticulatedVehicle(const ArticulatedVehicle &) = delete;
+    ArticulatedVehicle &operator=(const ArticulatedVehicle &) = delete;
+
+    //! Set the value of an input, see VehicleDefinition::input
+    //! Any value other than 0 wakes the vehicle up and keeps it awake
+    void control(int input, double value);
+
+    //! The inputs named "throttle" and "steering", if there are any
+    void throttle(double value) {
+        control(throttleInput, value);
+    }
+
+    void steering(double value) {
+        control(steeringInput, value);
+    }
+
+    //! Same as for Vehicle1, all bodies are woken up together and the
+    //! hinges keeps them in the same island
+    void wake();
+
+    bool isSleeping() const {
+        return bodies[0].getActivationState() == ISLAND_SLEEPING;
+    }
+
+    size_t numBodies() const {
+        return definition->bodies.size();
+    }
+
+    size_t numHinges() const {
+        return definition->hinges.size();
+    }
+
+    btRigidBody &body(size_t index) {
+        return bodies[index];
+    }
+
+    const btRigidBody &body(size_t index) const {
+        return bodies[index];
+    }
+
+    btHingeConstraint &hinge(size_t index) {
+        return hinges[index];
+    }
+
+    //! Defined in articulatedvehiclerender.cpp to keep the physics free from
+    //! graphics
+    void render(RenderBatch &batch,
+                const InterpolatedTransforms &transforms,
+                const Culling &culling) const;
+
+    //! Box around all bodies in the snapshots, false if it is not in them
+    //! Defined in articulatedvehiclerender.cpp
+    bool bounds(const InterpolatedTransforms &transforms,
+                btVector3 &min,
+                btVector3 &max) const;
+
+    const std::shared_ptr<const VehicleDefinition> definition;
+
+private:
+    btDynamicsWorld *world;
+    Arena *arena;
+
+    //! Both point into the same allocation, which is bytes large
+    btRigidBody *bodies = nullptr;
+    btHingeConstraint *hinges = nullptr;
+    size_t bytes = 0;
+
+    int throttleInput = -1;
+    int steeringInput = -1;
+};
+
+} // namespace sim
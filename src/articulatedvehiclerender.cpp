@@ -0,0 +1,62 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "articulatedvehicle.h"
+#include "culling.h"
+#include "renderbatch.h"
+
+namespace sim {
+
+void ArticulatedVehicle::render(RenderBatch &batch,
+                                const InterpolatedTransforms &transforms,
+                                const Culling &culling) const {
+    btVector3 min, max;
+    if (!bounds(transforms, min, max) || !culling.visible(min, max)) {
+        return;
+    }
+
+    if (!culling.isDetailed(min, max)) {
+        auto center = (min + max) / 2;
+        auto halfExtents = (max - min) / 2;
+        batch.box(Matrixd::Translation(center.x(), center.y(), center.z()) *
+                  Matrixd::Scale(
+                      halfExtents.x(), halfExtents.y(), halfExtents.z()));
+        return;
+    }
+
+    for (size_t i = 0; i < numBodies(); ++i) {
+        auto &part = definition->bodies[i];
+
+        Matrix<btScalar> model;
+        transforms(bodies[i]).getOpenGLMatrix(&model.x1);
+        model *= Matrix<btScalar>::Scale(part.halfExtents.x(),
+                                         part.halfExtents.y(),
+                                         part.halfExtents.z());
+
+        if (part.shape == VehicleDefinition::Box) {
+            batch.box(model);
+        }
+        else {
+            batch.cylinderX(model);
+        }
+    }
+}
+
+bool ArticulatedVehicle::bounds(const InterpolatedTransforms &transforms,
+                                btVector3 &min,
+                                btVector3 &max) const {
+    if (!transforms.bounds(bodies[0], min, max)) {
+        return false;
+    }
+
+    for (size_t i = 1; i < numBodies(); ++i) {
+        btVector3 bodyMin, bodyMax;
+        if (transforms.bounds(bodies[i], bodyMin, bodyMax)) {
+            min.setMin(bodyMin);
+            max.setMax(bodyMax);
+        }
+    }
+
+    return true;
+}
+
+} // namespace sim
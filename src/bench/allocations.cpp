@@ -0,0 +1,109 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Replaces the global operator new to count allocations, which is only
+// done in the bench program
+
+#include "allocations.h"
+
+#include "LinearMath/btAlignedAllocator.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<size_t> count{0};
+
+void *allocate(size_t size) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    if (auto pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *allocateAligned(size_t size, std::align_val_t alignment) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<size_t>(alignment);
+    size = (size + align - 1) / align * align;
+    if (auto pointer = std::aligned_alloc(align, size ? size : align)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *bulletAllocate(size_t size) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size);
+}
+
+void bulletFree(void *pointer) {
+    std::free(pointer);
+}
+
+//! Bullet uses its own allocator for its objects and arrays
+const bool bulletHooked = [] {
+    btAlignedAllocSetCustom(bulletAllocate, bulletFree);
+    return true;
+}();
+
+} // namespace
+
+void *operator new(size_t size) {
+    return allocate(size);
+}
+
+void *operator new[](size_t size) {
+    return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+namespace sim {
+namespace bench {
+
+size_t allocations() {
+    return count.load(std::memory_order_relaxed);
+}
+
+} // namespace bench
+} // namespace sim
@@ -0,0 +1,16 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include <cstddef>
+
+namespace sim {
+namespace bench {
+
+//! Number of heap allocations made so far in the process, both through
+//! operator new and through bullets aligned allocator
+//! The counting is always on in the bench program, see allocations.cpp
+size_t allocations();
+
+} // namespace bench
+} // namespace sim
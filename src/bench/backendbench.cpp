@@ -0,0 +1,132 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Hinge based Vehicle1 against the btMultiBody version, at the usual step
+// and at a larger step with fewer solver iterations. "joint error" is the
+// largest drift of any joint during the run, the hinges drifts more when
+// the step is larger while the multibody joints can not drift at all
+
+#include "benchmark.h"
+#include "fleetfixture.h"
+
+#include "fleet.h"
+#include "multibodyvehicle1.h"
+#include "world.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using sim::bench::State;
+
+namespace {
+
+const size_t numVehicles = 100;
+
+//! Simulated time is the same for every configuration
+const double simTime = 5;
+
+void benchmarkBackend(State &state,
+                      bool multiBody,
+                      double dt,
+                      int iterations) {
+    auto layout = sim::bench::squareLayout(numVehicles);
+
+    auto worldSettings = sim::bench::worldFor(layout);
+    worldSettings.multiBody = multiBody;
+
+    sim::World world(worldSettings);
+    world.dynamicsWorld->getSolverInfo().m_numIterations = iterations;
+
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+    vector<unique_ptr<sim::MultiBodyVehicle1>> multiBodies;
+
+    if (multiBody) {
+        auto shapes = make_shared<sim::Vehicle1::Shapes>(layout.settings);
+
+        // Same grid as Fleet::spawn
+        for (size_t i = 0; i < layout.count; ++i) {
+            auto transform = layout.transform(i);
+
+            multiBodies.push_back(make_unique<sim::MultiBodyVehicle1>(
+                world.multiBodyWorld(), transform, layout.settings, shapes));
+        }
+    }
+    else {
+        fleet.spawn(layout);
+    }
+
+    auto control = [&](double throttle, double steering) {
+        fleet.control(throttle, steering);
+        for (auto &vehicle : multiBodies) {
+            vehicle->throttle(throttle);
+            vehicle->steering(steering);
+        }
+    };
+
+    double jointError = 0;
+
+    auto measureJointError = [&] {
+        for (auto &vehicle : fleet) {
+            jointError = max(jointError, vehicle.jointError());
+        }
+        for (auto &vehicle : multiBodies) {
+            jointError = max(jointError, vehicle->jointError());
+        }
+    };
+
+    const auto step = static_cast<btScalar>(dt);
+    const auto landingSteps = static_cast<size_t>(1 / dt);
+
+    for (size_t i = 0; i < landingSteps; ++i) {
+        world.dynamicsWorld->stepSimulation(step, 1, step);
+    }
+
+    control(1, .5);
+
+    while (state.keepRunning()) {
+        world.dynamicsWorld->stepSimulation(step, 1, step);
+        measureJointError();
+    }
+
+    state.rate("sim-steps", 1);
+    state.rate("sim-seconds", dt);
+    state.counter("vehicles", static_cast<double>(numVehicles));
+    state.counter("iterations", iterations);
+    state.counter("joint error", jointError);
+}
+
+bool registerBackendBenchmarks() {
+    struct Config {
+        const char *name;
+        double dt;
+        int iterations;
+    };
+
+    const Config configs[] = {
+        {"60hz-10", 1. / 60., 10},
+        {"30hz-4", 1. / 30., 4},
+    };
+
+    for (bool multiBody : {false, true}) {
+        for (auto &config : configs) {
+            auto dt = config.dt;
+            auto iterations = config.iterations;
+
+            sim::bench::Registration(
+                string("backend/") + (multiBody ? "multibody/" : "hinge/") +
+                    config.name,
+                [multiBody, dt, iterations](State &state) {
+                    benchmarkBackend(state, multiBody, dt, iterations);
+                },
+                static_cast<size_t>(simTime / dt));
+        }
+    }
+
+    return true;
+}
+
+const bool registered = registerBackendBenchmarks();
+
+} // namespace
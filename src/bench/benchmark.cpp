@@ -0,0 +1,344 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace sim {
+namespace bench {
+
+namespace {
+
+bool isRate(const string &name) {
+    return name.size() > 2 && name.compare(name.size() - 2, 2, "/s") == 0;
+}
+
+bool isTime(const string &name) {
+    return name.compare(0, 3, "ns/") == 0;
+}
+
+string quote(const string &str) {
+    string ret = "\"";
+    for (auto c : str) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+        }
+        ret += c;
+    }
+    return ret + "\"";
+}
+
+//! Just enough json to read back what writeJson writes
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Null;
+    double number = 0;
+    string str;
+    vector<JsonValue> array;
+    vector<pair<string, JsonValue>> object;
+
+    const JsonValue *find(const string &key) const {
+        for (auto &member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonReader {
+public:
+    JsonReader(istream &stream) : stream(stream) {
+    }
+
+    JsonValue value() {
+        JsonValue ret;
+
+        auto c = peek();
+        if (c == '{') {
+            ret.type = JsonValue::Object;
+            stream.get();
+            if (peek() == '}') {
+                stream.get();
+                return ret;
+            }
+            do {
+                if (peek() != '"') {
+                    throw runtime_error("json: expected key");
+                }
+                auto key = readString();
+                expect(':');
+                ret.object.emplace_back(move(key), value());
+            } while (accept(','));
+            expect('}');
+        }
+        else if (c == '[') {
+            ret.type = JsonValue::Array;
+            stream.get();
+            if (peek() == ']') {
+                stream.get();
+                return ret;
+            }
+            do {
+                ret.array.push_back(value());
+            } while (accept(','));
+            expect(']');
+        }
+        else if (c == '"') {
+            ret.type = JsonValue::String;
+            ret.str = readString();
+        }
+        else if (c == 't' || c == 'f' || c == 'n') {
+            string word;
+            while (isalpha(stream.peek())) {
+                word += static_cast<char>(stream.get());
+            }
+            if (word == "null") {
+                return ret;
+            }
+            if (word != "true" && word != "false") {
+                throw runtime_error("json: unexpected '" + word + "'");
+            }
+            ret.type = JsonValue::Bool;
+            ret.number = (word == "true");
+        }
+        else {
+            ret.type = JsonValue::Number;
+            if (!(stream >> ret.number)) {
+                throw runtime_error("json: expected value");
+            }
+        }
+
+        return ret;
+    }
+
+private:
+    int peek() {
+        stream >> ws;
+        return stream.peek();
+    }
+
+    bool accept(char c) {
+        if (peek() == c) {
+            stream.get();
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c)) {
+            throw runtime_error(string{"json: expected '"} + c + "'");
+        }
+    }
+
+    string readString() {
+        stream.get();
+        string ret;
+        for (int c = stream.get(); c != '"'; c = stream.get()) {
+            if (c == EOF) {
+                throw runtime_error("json: unterminated string");
+            }
+            if (c == '\\') {
+                c = stream.get();
+            }
+            ret += static_cast<char>(c);
+        }
+        return ret;
+    }
+
+    istream &stream;
+};
+
+} // namespace
+
+double Comparison::improvement() const {
+    if (baseline == 0 || current == 0) {
+        return 0;
+    }
+    return higherIsBetter ? current / baseline - 1 : baseline / current - 1;
+}
+
+vector<Benchmark> &benchmarks() {
+    static vector<Benchmark> list;
+    return list;
+}
+
+Registration::Registration(string name,
+                           function<void(State &)> function,
+                           size_t iterations) {
+    benchmarks().push_back({move(name), move(function), iterations});
+}
+
+Result run(const Benchmark &benchmark, double minTime) {
+    size_t iterations = benchmark.iterations ? benchmark.iterations : 1;
+
+    for (;;) {
+        State state(iterations);
+        benchmark.function(state);
+
+        auto seconds = state.seconds();
+
+        if (benchmark.iterations || seconds >= minTime ||
+            iterations >= 1000000000) {
+            Result result;
+            result.name = benchmark.name;
+            result.iterations = iterations;
+            result.nsPerIteration =
+                seconds * 1e9 / static_cast<double>(iterations);
+            result.counters = state.counters;
+
+            for (auto &rate : state.rates) {
+                result.counters[rate.first + "/s"] =
+                    seconds > 0 ? rate.second *
+                                      static_cast<double>(iterations) / seconds
+                                : 0;
+            }
+
+            return result;
+        }
+
+        // Aim a bit over the minimum time so that the next run is likely to
+        // be the last, but never grow more than 10 times at once
+        auto factor = seconds > 0 ? minTime * 1.4 / seconds : 10.;
+        factor = std::min(std::max(factor, 2.), 10.);
+        iterations = static_cast<size_t>(static_cast<double>(iterations) *
+                                         factor);
+    }
+}
+
+void writeJson(ostream &stream, const vector<Result> &results) {
+    auto flags = stream.flags();
+    auto precision = stream.precision();
+
+    auto t = time(nullptr);
+    char date[32] = {};
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+
+    stream << "{\n"
+           << "  \"context\": {\n"
+           << "    \"date\": " << quote(date) << ",\n"
+           << "    \"num_cpus\": " << thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+           << "    \"library_build_type\": \"release\"\n"
+#else
+           << "    \"library_build_type\": \"debug\"\n"
+#endif
+           << "  },\n"
+           << "  \"benchmarks\": [";
+
+    stream << setprecision(10);
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &result = results[i];
+
+        stream << (i ? ",\n" : "\n") << "    {\n"
+               << "      \"name\": " << quote(result.name) << ",\n"
+               << "      \"iterations\": " << result.iterations << ",\n"
+               << "      \"real_time\": " << result.nsPerIteration << ",\n";
+
+        for (auto &counter : result.counters) {
+            stream << "      " << quote(counter.first) << ": "
+                   << counter.second << ",\n";
+        }
+
+        stream << "      \"time_unit\": \"ns\"\n"
+               << "    }";
+    }
+
+    stream << "\n  ]\n}\n";
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+vector<Result> readJson(istream &stream) {
+    auto root = JsonReader{stream}.value();
+
+    auto list = root.find("benchmarks");
+    if (!list || list->type != JsonValue::Array) {
+        throw runtime_error("json: no benchmarks array");
+    }
+
+    vector<Result> results;
+
+    for (auto &entry : list->array) {
+        Result result;
+
+        for (auto &member : entry.object) {
+            auto &key = member.first;
+            auto &value = member.second;
+
+            if (key == "name") {
+                result.name = value.str;
+            }
+            else if (value.type != JsonValue::Number) {
+                continue;
+            }
+            else if (key == "iterations") {
+                result.iterations = static_cast<size_t>(value.number);
+            }
+            else if (key == "real_time") {
+                result.nsPerIteration = value.number;
+            }
+            else {
+                result.counters[key] = value.number;
+            }
+        }
+
+        results.push_back(move(result));
+    }
+
+    return results;
+}
+
+vector<Comparison> compare(const vector<Result> &baseline,
+                           const vector<Result> &current) {
+    vector<Comparison> ret;
+
+    for (auto &result : current) {
+        auto it = find_if(
+            baseline.begin(), baseline.end(), [&](const Result &r) {
+                return r.name == result.name;
+            });
+
+        if (it == baseline.end()) {
+            continue;
+        }
+
+        ret.push_back({result.name,
+                       "ns",
+                       it->nsPerIteration,
+                       result.nsPerIteration,
+                       false});
+
+        for (auto &counter : result.counters) {
+            auto old = it->counters.find(counter.first);
+            if (old == it->counters.end() ||
+                !(isRate(counter.first) || isTime(counter.first))) {
+                continue;
+            }
+
+            ret.push_back({result.name,
+                           counter.first,
+                           old->second,
+                           counter.second,
+                           isRate(counter.first)});
+        }
+    }
+
+    return ret;
+}
+
+} // namespace bench
+} // namespace sim
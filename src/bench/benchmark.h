@@ -0,0 +1,157 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Small benchmark harness in the style of google benchmark
+//
+// SIM_BENCHMARK("name", function) registers a benchmark, the function does
+// its setup and then runs the measured code once per iteration:
+//
+//     void benchmarkSomething(sim::bench::State &state) {
+//         setup();
+//         while (state.keepRunning()) {
+//             measured();
+//         }
+//     }
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sim {
+namespace bench {
+
+class State {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    State(size_t iterations) : numIterations(iterations), left(iterations) {
+    }
+
+    //! Starts the timer on the first call and stops it when there are no
+    //! iterations left
+    bool keepRunning() {
+        if (!started) {
+            started = true;
+            start = Clock::now();
+        }
+
+        if (left == 0) {
+            end = Clock::now();
+            return false;
+        }
+
+        --left;
+        return true;
+    }
+
+    size_t iterations() const {
+        return numIterations;
+    }
+
+    double seconds() const {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    //! Value that is written as is to the results, counters named "ns/..."
+    //! are compared as times where lower is better
+    void counter(const std::string &name, double value) {
+        counters[name] = value;
+    }
+
+    //! Amount of something done per iteration, written to the results as
+    //! "name/s". Rates are what the comparison mode gates on, together with
+    //! the time per iteration
+    void rate(const std::string &name, double perIteration) {
+        rates[name] = perIteration;
+    }
+
+    std::map<std::string, double> counters;
+    std::map<std::string, double> rates;
+
+private:
+    size_t numIterations;
+    size_t left;
+    bool started = false;
+    Clock::time_point start;
+    Clock::time_point end;
+};
+
+//! Keeps the compiler from removing calculations whose results are unused
+template <typename T>
+inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    auto sink = *reinterpret_cast<const volatile char *>(&value);
+    (void)sink;
+#endif
+}
+
+struct Benchmark {
+    std::string name;
+    std::function<void(State &)> function;
+
+    //! Fixed number of iterations, 0 means that the number of iterations is
+    //! increased until the run takes at least the minimum time
+    size_t iterations = 0;
+};
+
+struct Result {
+    std::string name;
+    size_t iterations = 0;
+    double nsPerIteration = 0;
+
+    //! Counters and rates, rates are already converted to per second
+    std::map<std::string, double> counters;
+};
+
+//! One metric that exists in both the baseline and the current results
+struct Comparison {
+    std::string name;
+    std::string metric;
+    double baseline = 0;
+    double current = 0;
+    bool higherIsBetter = false;
+
+    //! Relative improvement, negative values are regressions
+    double improvement() const;
+};
+
+//! Every registered benchmark, in registration order
+std::vector<Benchmark> &benchmarks();
+
+struct Registration {
+    Registration(std::string name,
+                 std::function<void(State &)> function,
+                 size_t iterations = 0);
+};
+
+Result run(const Benchmark &benchmark, double minTime);
+
+//! Same layout as google benchmarks json output, so that the same tools can
+//! read both
+void writeJson(std::ostream &stream, const std::vector<Result> &results);
+
+//! Reads the output of writeJson, throws std::runtime_error on syntax errors
+std::vector<Result> readJson(std::istream &stream);
+
+//! Time per iteration and every rate ("/s") and time ("ns/") counter that
+//! both sets have in common
+std::vector<Comparison> compare(const std::vector<Result> &baseline,
+                                const std::vector<Result> &current);
+
+} // namespace bench
+} // namespace sim
+
+#define SIM_BENCHMARK_CONCAT_INNER(a, b) a##b
+#define SIM_BENCHMARK_CONCAT(a, b) SIM_BENCHMARK_CONCAT_INNER(a, b)
+
+//! SIM_BENCHMARK(name, function) or SIM_BENCHMARK(name, function, iterations)
+#define SIM_BENCHMARK(...)                                                     \
+    static ::sim::bench::Registration SIM_BENCHMARK_CONCAT(                    \
+        simBenchmarkRegistration, __LINE__)(__VA_ARGS__)
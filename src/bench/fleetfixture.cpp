@@ -0,0 +1,32 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "fleetfixture.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace sim {
+namespace bench {
+
+Fleet::Layout squareLayout(size_t count) {
+    Fleet::Layout layout;
+    layout.count = count;
+    layout.columns =
+        static_cast<size_t>(ceil(sqrt(static_cast<double>(layout.count))));
+    return layout;
+}
+
+World::Settings worldFor(const Fleet::Layout &layout) {
+    auto extents = layout.halfExtents();
+
+    World::Settings settings;
+    settings.groundHalfExtent = max<double>(
+        settings.groundHalfExtent,
+        max(extents.x(), extents.y()) + layout.spacingY);
+    return settings;
+}
+
+} // namespace bench
+} // namespace sim
@@ -0,0 +1,22 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "fleet.h"
+#include "world.h"
+
+namespace sim {
+namespace bench {
+
+//! Step of the benchmarks that step a world, the same as the programs
+const btScalar dt = 1. / 60.;
+
+//! count vehicles in a grid that is as close to square as it gets
+Fleet::Layout squareLayout(size_t count);
+
+//! A ground that is large enough for the layout, never smaller than the
+//! default
+World::Settings worldFor(const Fleet::Layout &layout);
+
+} // namespace bench
+} // namespace sim
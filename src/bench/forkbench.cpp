@@ -0,0 +1,110 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Forking a world with a fleet, restoring a WorldState into a world that
+// is already built against building the world and the vehicles again
+
+#include "benchmark.h"
+#include "fleetfixture.h"
+
+#include "branches.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace std;
+using sim::bench::State;
+using sim::bench::dt;
+
+namespace {
+
+const size_t numVehicles = 100;
+
+//! One branch per hardware thread
+const size_t numBranches = max<size_t>(thread::hardware_concurrency(), 1);
+
+//! A world where the vehicles have driven for a second
+sim::WorldState drivenState() {
+    auto layout = sim::bench::squareLayout(numVehicles);
+    sim::Branches::Branch source(sim::bench::worldFor(layout), layout);
+
+    source.fleet.control(1, .5);
+    for (size_t i = 0; i < 60; ++i) {
+        source.world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    sim::WorldState state;
+    state.capture(*source.world.dynamicsWorld);
+    return state;
+}
+
+void benchmarkRestore(State &state, bool exact) {
+    auto layout = sim::bench::squareLayout(numVehicles);
+    auto worldState = drivenState();
+
+    sim::Branches branches(1, sim::bench::worldFor(layout), layout);
+
+    while (state.keepRunning()) {
+        branches.fork(worldState, exact);
+    }
+
+    state.rate("forks", 1);
+    state.counter("bodies", static_cast<double>(worldState.bodies.size()));
+}
+
+void benchmarkRebuild(State &state) {
+    auto layout = sim::bench::squareLayout(numVehicles);
+    auto settings = sim::bench::worldFor(layout);
+    auto worldState = drivenState();
+
+    while (state.keepRunning()) {
+        sim::Branches::Branch branch(settings, layout);
+        worldState.restore(*branch.world.dynamicsWorld);
+    }
+
+    state.rate("forks", 1);
+    state.counter("bodies", static_cast<double>(worldState.bodies.size()));
+}
+
+//! Fork and drive one second in every branch, with the branches in
+//! parallel
+void benchmarkBranches(State &state, size_t count) {
+    auto layout = sim::bench::squareLayout(numVehicles);
+    auto worldState = drivenState();
+
+    sim::ThreadPool pool;
+    sim::Branches branches(
+        count, sim::bench::worldFor(layout), layout, &pool);
+
+    while (state.keepRunning()) {
+        branches.fork(worldState);
+        branches.run(60, dt, [count](size_t branch, size_t, sim::Fleet &fleet) {
+            fleet.control(
+                1, static_cast<double>(branch) / static_cast<double>(count));
+        });
+    }
+
+    state.rate("branches", static_cast<double>(count));
+    state.counter("threads", static_cast<double>(pool.size()));
+}
+
+} // namespace
+
+SIM_BENCHMARK(
+    "fork/restore/" + to_string(numVehicles),
+    [](State &state) { benchmarkRestore(state, false); },
+    1000);
+SIM_BENCHMARK(
+    "fork/restore-exact/" + to_string(numVehicles),
+    [](State &state) { benchmarkRestore(state, true); },
+    100);
+SIM_BENCHMARK(
+    "fork/rebuild/" + to_string(numVehicles),
+    [](State &state) { benchmarkRebuild(state); },
+    20);
+SIM_BENCHMARK(
+    "fork/branches/" + to_string(numBranches) + "x" + to_string(numVehicles),
+    [](State &state) { benchmarkBranches(state, numBranches); },
+    5);
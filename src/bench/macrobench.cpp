@@ -0,0 +1,144 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Whole simulation steps with growing numbers of vehicles
+
+#include "benchmark.h"
+#include "fleetfixture.h"
+
+#include "fleet.h"
+#include "world.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using sim::bench::State;
+using sim::bench::dt;
+
+namespace {
+
+//! Number of steps in each run, so that the runs are comparable between
+//! vehicle counts
+const size_t numSteps = 300;
+
+void benchmarkFleet(State &state, size_t count) {
+    auto layout = sim::bench::squareLayout(count);
+    sim::World world(sim::bench::worldFor(layout));
+
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+    fleet.spawn(layout);
+
+    // Let the vehicles land on the ground before measuring
+    for (size_t i = 0; i < 60; ++i) {
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    fleet.control(1, .5);
+
+    while (state.keepRunning()) {
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    state.rate("sim-steps", 1);
+    state.rate("vehicle-steps", static_cast<double>(count));
+    state.counter("vehicles", static_cast<double>(count));
+}
+
+//! Yard where only some of the vehicles drive and the rest are parked,
+//! the parked ones should fall asleep and cost close to nothing
+void benchmarkIdle(State &state, size_t count, size_t idlePercent) {
+    auto layout = sim::bench::squareLayout(count);
+    sim::World world(sim::bench::worldFor(layout));
+
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+    fleet.spawn(layout);
+
+    vector<double> throttle(count, 0);
+    vector<double> steering(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (i * 100 >= idlePercent * count) {
+            throttle[i] = 1;
+            steering[i] = .5;
+        }
+    }
+
+    // Bullet waits two seconds before a body is allowed to sleep
+    for (size_t i = 0; i < 240; ++i) {
+        fleet.control(throttle.data(), steering.data());
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    while (state.keepRunning()) {
+        fleet.control(throttle.data(), steering.data());
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    state.rate("sim-steps", 1);
+    state.counter("vehicles", static_cast<double>(count));
+    state.counter("sleeping", static_cast<double>(fleet.numSleeping()));
+}
+
+//! Only the vehicles around the first one use the full model, the rest
+//! are raycast vehicle proxies
+void benchmarkDetail(State &state, size_t count, double focusRadius) {
+    auto layout = sim::bench::squareLayout(count);
+    sim::World world(sim::bench::worldFor(layout));
+
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+    fleet.spawn(layout);
+
+    sim::Fleet::Detail detail;
+    detail.focusRadius = focusRadius;
+
+    vector<btVector3> focus(1);
+
+    auto step = [&] {
+        focus.front() = fleet[0].frontBody.getWorldTransform().getOrigin();
+        fleet.updateDetail(focus, detail);
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    };
+
+    for (size_t i = 0; i < 60; ++i) {
+        step();
+    }
+
+    fleet.control(1, .5);
+
+    while (state.keepRunning()) {
+        step();
+    }
+
+    state.rate("sim-steps", 1);
+    state.rate("vehicle-steps", static_cast<double>(count));
+    state.counter("vehicles", static_cast<double>(count));
+    state.counter("proxies", static_cast<double>(fleet.numProxies()));
+}
+
+} // namespace
+
+SIM_BENCHMARK(
+    "fleet/1", [](State &state) { benchmarkFleet(state, 1); }, numSteps);
+SIM_BENCHMARK(
+    "fleet/10", [](State &state) { benchmarkFleet(state, 10); }, numSteps);
+SIM_BENCHMARK(
+    "fleet/100", [](State &state) { benchmarkFleet(state, 100); }, numSteps);
+SIM_BENCHMARK(
+    "fleet/1000", [](State &state) { benchmarkFleet(state, 1000); }, numSteps);
+
+SIM_BENCHMARK(
+    "idle/1000/0",
+    [](State &state) { benchmarkIdle(state, 1000, 0); },
+    numSteps);
+SIM_BENCHMARK(
+    "idle/1000/50",
+    [](State &state) { benchmarkIdle(state, 1000, 50); },
+    numSteps);
+SIM_BENCHMARK(
+    "idle/1000/90",
+    [](State &state) { benchmarkIdle(state, 1000, 90); },
+    numSteps);
+
+SIM_BENCHMARK(
+    "detail/1000/40",
+    [](State &state) { benchmarkDetail(state, 1000, 40); },
+    numSteps);
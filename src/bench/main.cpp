@@ -0,0 +1,190 @@
+//! Copyright © Mattias Larsson Sköld
+
+// Runs the micro and macro benchmarks, saves the results as json and
+// compares them with a saved baseline
+
+#include "benchmark.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+void printUsage() {
+    cout << "usage: bench [options]\n"
+         << "  --filter <text>   only run benchmarks with text in the name\n"
+         << "  --list            print the names of the benchmarks\n"
+         << "  --min-time <s>    minimum time for each benchmark (default "
+            ".5)\n"
+         << "  --steps <n>       steps for the fleet benchmarks (default 300)\n"
+         << "  --out <file>      save the results as json\n"
+         << "  --compare <file>  compare with results saved with --out and\n"
+         << "                    fail if anything got slower than threshold\n"
+         << "  --threshold <f>   allowed regression, .1 is 10% (default .1)\n";
+}
+
+struct Settings {
+    string filter;
+    bool list = false;
+    double minTime = .5;
+    size_t steps = 0;
+    string outFile;
+    string baselineFile;
+    double threshold = .1;
+};
+
+//! Returns the number of regressions
+size_t printComparison(const vector<sim::bench::Result> &baseline,
+                       const vector<sim::bench::Result> &results,
+                       double threshold) {
+    auto comparisons = sim::bench::compare(baseline, results);
+
+    size_t regressions = 0;
+
+    cout << "\n"
+         << left << setw(32) << "benchmark" << setw(18) << "metric" << right
+         << setw(14) << "baseline" << setw(14) << "current" << setw(10)
+         << "change"
+         << "\n";
+
+    for (auto &comparison : comparisons) {
+        auto improvement = comparison.improvement();
+        bool regression = improvement < -threshold;
+        regressions += regression;
+
+        cout << left << setw(32) << comparison.name << setw(18)
+             << comparison.metric << right << setw(14) << comparison.baseline
+             << setw(14) << comparison.current << setw(9) << showpos
+             << improvement * 100 << noshowpos << "%"
+             << (regression ? "  REGRESSION" : "") << "\n";
+    }
+
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Settings settings;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = string{argv[i]};
+
+        auto next = [&]() -> string {
+            if (i + 1 >= argc) {
+                cerr << "missing value for " << arg << endl;
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        }
+        else if (arg == "--filter") {
+            settings.filter = next();
+        }
+        else if (arg == "--list") {
+            settings.list = true;
+        }
+        else if (arg == "--min-time") {
+            settings.minTime = stod(next());
+        }
+        else if (arg == "--steps") {
+            settings.steps = stoul(next());
+        }
+        else if (arg == "--out") {
+            settings.outFile = next();
+        }
+        else if (arg == "--compare") {
+            settings.baselineFile = next();
+        }
+        else if (arg == "--threshold") {
+            settings.threshold = stod(next());
+        }
+        else {
+            cerr << "unknown argument " << arg << endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    // Read the baseline first so that a bad file fails before the long run
+    vector<sim::bench::Result> baseline;
+    if (!settings.baselineFile.empty()) {
+        ifstream file(settings.baselineFile);
+        if (!file) {
+            cerr << "could not open " << settings.baselineFile << endl;
+            return 1;
+        }
+        try {
+            baseline = sim::bench::readJson(file);
+        }
+        catch (std::exception &e) {
+            cerr << settings.baselineFile << ": " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    vector<sim::bench::Result> results;
+
+    for (auto benchmark : sim::bench::benchmarks()) {
+        if (benchmark.name.find(settings.filter) == string::npos) {
+            continue;
+        }
+
+        if (settings.list) {
+            cout << benchmark.name << "\n";
+            continue;
+        }
+
+        if (benchmark.iterations && settings.steps) {
+            benchmark.iterations = settings.steps;
+        }
+
+        auto result = sim::bench::run(benchmark, settings.minTime);
+
+        cout << left << setw(32) << result.name << right << setw(14)
+             << fixed << setprecision(1) << result.nsPerIteration << " ns"
+             << setw(12) << result.iterations;
+        for (auto &counter : result.counters) {
+            cout << "  " << counter.first << "=" << setprecision(1)
+                 << counter.second;
+        }
+        cout << defaultfloat << setprecision(6) << endl;
+
+        results.push_back(move(result));
+    }
+
+    if (settings.list) {
+        return 0;
+    }
+
+    if (!settings.outFile.empty()) {
+        ofstream file(settings.outFile);
+        sim::bench::writeJson(file, results);
+        if (!file) {
+            cerr << "could not write " << settings.outFile << endl;
+            return 1;
+        }
+    }
+
+    if (!baseline.empty()) {
+        auto regressions =
+            printComparison(baseline, results, settings.threshold);
+
+        if (regressions) {
+            cout << "\n" << regressions << " regression(s) over "
+                 << settings.threshold * 100 << "%" << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
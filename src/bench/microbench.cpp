@@ -0,0 +1,193 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Benchmarks of the small pieces that runs once per object and frame
+
+#include "benchmark.h"
+
+#include "mesh.h"
+#include "telemetry.h"
+#include "transformsnapshot.h"
+#include "vehicle1.h"
+#include "world.h"
+
+#include <vector>
+
+using namespace std;
+using sim::bench::State;
+
+namespace {
+
+btTransform testTransform() {
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin({1, 2, 3});
+    transform.setRotation(btQuaternion({1, 1, 0}, .3));
+    return transform;
+}
+
+void benchmarkBoxMesh(State &state) {
+    while (state.keepRunning()) {
+        auto mesh = sim::createBoxMesh();
+        sim::bench::doNotOptimize(mesh);
+    }
+}
+
+void benchmarkCylinderMesh(State &state, unsigned numPoints) {
+    while (state.keepRunning()) {
+        auto mesh = sim::createCylinderMesh(numPoints);
+        sim::bench::doNotOptimize(mesh);
+    }
+}
+
+//! btTransform to the matrix format used by the renderer
+void benchmarkGetOpenGLMatrix(State &state) {
+    auto transform = testTransform();
+    Matrix<btScalar> matrix;
+
+    while (state.keepRunning()) {
+        transform.getOpenGLMatrix(&matrix.x1);
+        sim::bench::doNotOptimize(matrix);
+    }
+}
+
+//! Same as above but with the conversion to the float matrix that is sent
+//! to the gpu
+void benchmarkGetOpenGLMatrixFloat(State &state) {
+    auto transform = testTransform();
+    Matrix<btScalar> matrix;
+
+    while (state.keepRunning()) {
+        transform.getOpenGLMatrix(&matrix.x1);
+        Matrixf converted = matrix;
+        sim::bench::doNotOptimize(converted);
+    }
+}
+
+//! The chain in Vehicle1::Wheel::render, the rotation to the x axis is baked
+//! into the mesh
+void benchmarkCylinderXChain(State &state) {
+    auto transform = testTransform();
+    Matrix<btScalar> model;
+
+    while (state.keepRunning()) {
+        transform.getOpenGLMatrix(&model.x1);
+        model *= Matrixd::Scale(.3, 1, 1);
+        Matrixf converted = model;
+        sim::bench::doNotOptimize(converted);
+    }
+}
+
+//! Everything that is done on the cpu for each vehicle part that is drawn,
+//! the same steps as Vehicle1::render followed by RenderBatch but without
+//! the gl calls
+void benchmarkVehicleDraw(State &state) {
+    sim::World world;
+
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin({0, 0, -3});
+    sim::Vehicle1 vehicle(world.dynamicsWorld.get(), transform, {});
+
+    sim::TransformSnapshot previous;
+    sim::TransformSnapshot current;
+    previous.capture(*world.dynamicsWorld);
+    world.dynamicsWorld->stepSimulation(1. / 60., 1, 1. / 60.);
+    current.capture(*world.dynamicsWorld);
+
+    sim::InterpolatedTransforms transforms;
+    transforms.previous = &previous;
+    transforms.current = &current;
+    transforms.alpha = .5;
+
+    auto &settings = vehicle.settings;
+
+    vector<Matrixf> boxes;
+    vector<Matrixf> cylinders;
+
+    auto body = [&](const btRigidBody &body, double length) {
+        Matrix<btScalar> model;
+        transforms(body).getOpenGLMatrix(&model.x1);
+        model *= Matrixd::Scale(
+            settings.bodyHalfWidth, length, settings.bodyHalfHeight);
+        boxes.push_back(model);
+    };
+
+    const size_t drawsPerVehicle = 2 + vehicle.wheels.size();
+
+    while (state.keepRunning()) {
+        body(vehicle.frontBody, settings.frontBodyHalfLength);
+        body(vehicle.rearBody, settings.rearBodyHalfLength);
+
+        for (auto &wheel : vehicle.wheels) {
+            Matrix<btScalar> model;
+            transforms(wheel.body).getOpenGLMatrix(&model.x1);
+            model *= Matrixd::Scale(wheel.width, wheel.radius, wheel.radius);
+            cylinders.push_back(model);
+        }
+
+        sim::bench::doNotOptimize(boxes.data());
+        sim::bench::doNotOptimize(cylinders.data());
+
+        boxes.clear();
+        cylinders.clear();
+    }
+
+    auto draws = static_cast<double>(state.iterations() * drawsPerVehicle);
+
+    state.rate("draws", static_cast<double>(drawsPerVehicle));
+    state.counter("ns/draw", state.seconds() * 1e9 / draws);
+}
+
+//! Throws everything away, so that only the cost on the simulation thread
+//! is measured
+class NullSink : public sim::TelemetrySink {
+public:
+    bool write(const void *, size_t) override {
+        return true;
+    }
+};
+
+//! What the simulation thread pays per vehicle and step for telemetry
+void benchmarkTelemetry(State &state) {
+    sim::World world;
+    btTransform transform;
+    transform.setIdentity();
+    sim::Vehicle1 vehicle(world.dynamicsWorld.get(),
+                          transform,
+                          sim::Vehicle1::Vehicle1Settings{});
+
+    // The writer does not sleep, so that it keeps up and the records are
+    // not dropped, which would be cheaper than pushing them
+    sim::Telemetry::Settings settings;
+    settings.interval = chrono::milliseconds(0);
+    sim::Telemetry telemetry(make_unique<NullSink>(), 1. / 60., settings);
+
+    uint64_t step = 0;
+    while (state.keepRunning()) {
+        telemetry.record(sim::captureTelemetry(vehicle, step++, 0));
+    }
+
+    telemetry.stop();
+
+    state.rate("records", 1);
+    state.counter("dropped", static_cast<double>(telemetry.dropped()));
+    state.counter("ns/record",
+                  state.seconds() * 1e9 /
+                      static_cast<double>(state.iterations()));
+}
+
+} // namespace
+
+SIM_BENCHMARK("mesh/box", benchmarkBoxMesh);
+SIM_BENCHMARK("mesh/cylinder/40",
+              [](State &state) { benchmarkCylinderMesh(state, 40); });
+SIM_BENCHMARK("mesh/cylinder/160",
+              [](State &state) { benchmarkCylinderMesh(state, 160); });
+
+SIM_BENCHMARK("matrix/getOpenGLMatrix", benchmarkGetOpenGLMatrix);
+SIM_BENCHMARK("matrix/getOpenGLMatrix/float", benchmarkGetOpenGLMatrixFloat);
+SIM_BENCHMARK("matrix/cylinderX", benchmarkCylinderXChain);
+
+SIM_BENCHMARK("draw/vehicle1", benchmarkVehicleDraw);
+
+SIM_BENCHMARK("telemetry/record", benchmarkTelemetry);
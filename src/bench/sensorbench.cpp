@@ -0,0 +1,95 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Rays per second of the range sensors, used to size sensor configurations
+// against real time. At 60 steps per second a sensor with n rays needs
+// 60 * n rays per second
+
+#include "benchmark.h"
+#include "fleetfixture.h"
+
+#include "fleet.h"
+#include "rangesensor.h"
+#include "threadpool.h"
+#include "world.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace std;
+using sim::bench::State;
+using sim::bench::dt;
+
+namespace {
+
+const size_t numVehicles = 100;
+
+//! Every vehicle has a sensor with 'horizontalRays' * 16 rays, threads 1
+//! casts on the calling thread without a pool
+void benchmarkRangeSensors(State &state,
+                           size_t horizontalRays,
+                           size_t threads) {
+    auto layout = sim::bench::squareLayout(numVehicles);
+    sim::World world(sim::bench::worldFor(layout));
+
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+    fleet.spawn(layout);
+
+    for (size_t i = 0; i < 60; ++i) {
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    unique_ptr<sim::ThreadPool> pool;
+    if (threads > 1) {
+        pool = make_unique<sim::ThreadPool>(threads);
+    }
+
+    sim::RangeSensors sensors(*world.dynamicsWorld, pool.get());
+
+    sim::RangeSensor::Settings settings;
+    settings.horizontalRays = horizontalRays;
+
+    btTransform mount;
+    mount.setIdentity();
+    mount.setOrigin({0, 0, 2});
+
+    for (auto &vehicle : fleet) {
+        sensors.add(sim::RangeSensor(vehicle, mount, settings));
+    }
+
+    while (state.keepRunning()) {
+        sensors.scan();
+    }
+
+    state.rate("rays", static_cast<double>(sensors.numRays()));
+    state.counter("rays/scan", static_cast<double>(sensors.numRays()));
+    state.counter("threads", static_cast<double>(threads));
+}
+
+//! 1 thread and all hardware threads, for a small and a large sensor
+bool registerSensorBenchmarks() {
+    auto maxThreads = max<size_t>(thread::hardware_concurrency(), 1);
+
+    for (size_t rays : {64, 360}) {
+        for (size_t threads : {size_t{1}, maxThreads}) {
+            sim::bench::Registration(
+                "sensors/" + to_string(numVehicles) + "x" + to_string(rays) +
+                    "x16/" + to_string(threads),
+                [rays, threads](State &state) {
+                    benchmarkRangeSensors(state, rays, threads);
+                },
+                10);
+
+            if (maxThreads == 1) {
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+const bool registered = registerSensorBenchmarks();
+
+} // namespace
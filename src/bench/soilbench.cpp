@@ -0,0 +1,134 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Particle substeps per second of the soil, and how the soil and a loader
+// digging in it keeps up with real time. A step of the soil with n
+// particles needs n * subSteps particle substeps, so at 60 steps per
+// second real time needs 60 * n * subSteps per second
+
+#include "benchmark.h"
+#include "fleetfixture.h"
+
+#include "soil.h"
+#include "threadpool.h"
+#include "vehicle1.h"
+#include "world.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace std;
+using sim::bench::State;
+using sim::bench::dt;
+
+namespace {
+
+//! Threads 1 steps on the calling thread without a pool
+unique_ptr<sim::ThreadPool> createPool(size_t threads) {
+    if (threads > 1) {
+        return make_unique<sim::ThreadPool>(threads);
+    }
+    return nullptr;
+}
+
+//! A pile that has settled for half a second, without any bodies
+void benchmarkSoil(State &state, size_t particles, size_t threads) {
+    auto pool = createPool(threads);
+    sim::Soil soil(pool.get());
+    soil.fillPile(btVector3(0, 0, 0), particles);
+
+    for (size_t i = 0; i < 30; ++i) {
+        soil.step(dt);
+    }
+
+    while (state.keepRunning()) {
+        soil.step(dt);
+    }
+
+    state.rate("particle substeps",
+               static_cast<double>(soil.size() * soil.settings.subSteps));
+    state.rate("sim seconds", dt);
+    state.counter("particles", static_cast<double>(soil.size()));
+    state.counter("threads", static_cast<double>(threads));
+}
+
+//! A loader that lowers the bucket and drives into the pile, the soil and
+//! the world stepped together
+void benchmarkDig(State &state, size_t particles, size_t threads) {
+    auto pool = createPool(threads);
+
+    sim::World world(50);
+
+    sim::Vehicle1::Vehicle1Settings settings;
+    settings.bucket = true;
+
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin({0, 0, -3});
+    sim::Vehicle1 vehicle(world.dynamicsWorld.get(), transform, settings);
+
+    sim::Soil soil(pool.get());
+
+    // A meter in front of the bucket, the same as in the headless program
+    auto &bucket = *vehicle.bucketBody;
+    soil.fillPile(bucket.getWorldTransform() *
+                      btVector3(0, settings.bucketHalfLength + 1, 0),
+                  particles);
+
+    soil.addBody(vehicle.frontBody);
+    soil.addBody(vehicle.rearBody);
+    soil.addBody(bucket);
+    for (auto &wheel : vehicle.wheels) {
+        soil.addBody(wheel.body);
+    }
+
+    vehicle.throttle(.5);
+    vehicle.lift(-1);
+
+    while (state.keepRunning()) {
+        soil.step(dt);
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    state.rate("particle substeps",
+               static_cast<double>(soil.size() * soil.settings.subSteps));
+    state.rate("sim seconds", dt);
+    state.counter("particles", static_cast<double>(soil.size()));
+    state.counter("threads", static_cast<double>(threads));
+}
+
+//! 1 thread and all hardware threads for each size, so that both the
+//! scaling with the particle count and with the threads shows
+bool registerSoilBenchmarks() {
+    auto maxThreads = max<size_t>(thread::hardware_concurrency(), 1);
+
+    for (size_t particles : {5000, 20000, 80000}) {
+        for (size_t threads : {size_t{1}, maxThreads}) {
+            sim::bench::Registration(
+                "soil/" + to_string(particles) + "/" + to_string(threads),
+                [particles, threads](State &state) {
+                    benchmarkSoil(state, particles, threads);
+                },
+                max<size_t>(1200000 / particles, 10));
+
+            if (maxThreads == 1) {
+                break;
+            }
+        }
+    }
+
+    // Five seconds, long enough for the bucket to reach the pile
+    sim::bench::Registration(
+        "soil/dig/20000/" + to_string(maxThreads),
+        [maxThreads](State &state) {
+            benchmarkDig(state, 20000, maxThreads);
+        },
+        300);
+
+    return true;
+}
+
+const bool registered = registerSoilBenchmarks();
+
+} // namespace
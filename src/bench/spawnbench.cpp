@@ -0,0 +1,149 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Cost of adding vehicles to a world and removing them again
+
+#include "allocations.h"
+#include "benchmark.h"
+
+#include "articulatedvehicle.h"
+#include "fleet.h"
+#include "world.h"
+
+#include <deque>
+#include <sstream>
+
+using namespace std;
+using sim::bench::State;
+
+namespace {
+
+const size_t numVehicles = 100;
+
+//! Same as data/loader.vehicle, kept here so that the benchmark does not
+//! depend on the working directory
+const char *definitionText =
+    "body front box 1.5 1.5 1 mass 1 position 0 3 1\n"
+    "body rear box 1.5 2 1 mass 1 position 0 -3.5 1\n"
+    "hinge waist front rear pivot 0 0 1 axis 0 0 1 motor steering 2 10\n"
+    "wheel frontLeft front radius 1.5 halfwidth .5 mass .2 "
+    "position -2 4 .5 friction 10 motor throttle 4 1\n"
+    "wheel rearLeft rear radius 1.5 halfwidth .5 mass .2 "
+    "position -2 -2.5 .5 friction 10 motor throttle 4 1\n"
+    "wheel frontRight front radius 1.5 halfwidth .5 mass .2 "
+    "position 2 4 .5 friction 10 motor throttle 4 1\n"
+    "wheel rearRight rear radius 1.5 halfwidth .5 mass .2 "
+    "position 2 -2.5 .5 friction 10 motor throttle 4 1\n"
+    "body bucket box 2.5 2 1 mass .5 position 0 8 1\n"
+    "hinge bucketJoint front bucket pivot 0 6 1 axis 1 0 0 motor bucket 1 10\n";
+
+//! Heap allocations per spawned and removed vehicle
+void countAllocations(State &state, size_t before) {
+    auto vehicles = static_cast<double>(state.iterations() * numVehicles);
+    state.counter(
+        "allocations/vehicle",
+        static_cast<double>(sim::bench::allocations() - before) / vehicles);
+}
+
+btTransform spawnTransform(size_t i) {
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin(btVector3(static_cast<btScalar>(i % 10) * 12,
+                                  static_cast<btScalar>(i / 10) * 16,
+                                  -3));
+    return transform;
+}
+
+void benchmarkVehicle1(State &state) {
+    sim::World world;
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+    sim::Vehicle1::Vehicle1Settings settings;
+
+    auto before = sim::bench::allocations();
+
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < numVehicles; ++i) {
+            fleet.spawn(spawnTransform(i), settings);
+        }
+        fleet.despawn(numVehicles);
+    }
+
+    state.rate("vehicles", numVehicles);
+    countAllocations(state, before);
+}
+
+//! Parsing the definition for every vehicle, what the cache avoids
+void benchmarkParse(State &state) {
+    sim::World world;
+    deque<sim::ArticulatedVehicle> vehicles;
+
+    auto before = sim::bench::allocations();
+
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < numVehicles; ++i) {
+            istringstream stream(definitionText);
+            vehicles.emplace_back(world.dynamicsWorld.get(),
+                                  spawnTransform(i),
+                                  sim::VehicleDefinition::load(stream));
+        }
+        vehicles.clear();
+    }
+
+    state.rate("vehicles", numVehicles);
+    countAllocations(state, before);
+}
+
+void benchmarkDefinition(State &state) {
+    sim::World world;
+    deque<sim::ArticulatedVehicle> vehicles;
+
+    istringstream stream(definitionText);
+    auto definition = sim::VehicleDefinition::load(stream);
+
+    auto before = sim::bench::allocations();
+
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < numVehicles; ++i) {
+            vehicles.emplace_back(
+                world.dynamicsWorld.get(), spawnTransform(i), definition);
+        }
+        vehicles.clear();
+    }
+
+    state.rate("vehicles", numVehicles);
+    countAllocations(state, before);
+}
+
+//! Same as above but with the memory from the arena of the world, after
+//! the first iteration every vehicle reuses the block of one that was
+//! removed
+void benchmarkArena(State &state) {
+    sim::World world;
+    deque<sim::ArticulatedVehicle> vehicles;
+
+    istringstream stream(definitionText);
+    auto definition = sim::VehicleDefinition::load(stream);
+
+    auto before = sim::bench::allocations();
+
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < numVehicles; ++i) {
+            vehicles.emplace_back(world.dynamicsWorld.get(),
+                                  spawnTransform(i),
+                                  definition,
+                                  &world.arena);
+        }
+        vehicles.clear();
+    }
+
+    state.rate("vehicles", numVehicles);
+    countAllocations(state, before);
+    state.counter("arena chunks",
+                  static_cast<double>(world.arena.statistics().chunks));
+}
+
+} // namespace
+
+SIM_BENCHMARK("spawn/vehicle1/100", benchmarkVehicle1);
+SIM_BENCHMARK("spawn/parse/100", benchmarkParse);
+SIM_BENCHMARK("spawn/definition/100", benchmarkDefinition);
+SIM_BENCHMARK("spawn/arena/100", benchmarkArena);
@@ -0,0 +1,78 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Scaling of bullets multithreaded world with the number of threads
+// Only registered in builds where bullet is built with BT_THREADSAFE, see
+// the bench_mt target
+
+#include "benchmark.h"
+#include "fleetfixture.h"
+
+#include "fleet.h"
+#include "world.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+using namespace std;
+using sim::bench::State;
+using sim::bench::dt;
+
+namespace {
+
+const size_t numVehicles = 500;
+const size_t numSteps = 300;
+
+void benchmarkThreads(State &state, size_t threads) {
+    auto layout = sim::bench::squareLayout(numVehicles);
+
+    auto settings = sim::bench::worldFor(layout);
+    settings.threads = threads;
+
+    sim::World world(settings);
+
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+    fleet.spawn(layout);
+
+    for (size_t i = 0; i < 60; ++i) {
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    fleet.control(1, .5);
+
+    while (state.keepRunning()) {
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+    }
+
+    state.rate("sim-steps", 1);
+    state.rate("vehicle-steps", static_cast<double>(numVehicles));
+    state.counter("threads", static_cast<double>(world.threads()));
+}
+
+//! 1, 2, 4... and the number of hardware threads
+bool registerThreadBenchmarks() {
+    if (!sim::World::supportsMultithreading()) {
+        return false;
+    }
+
+    auto maxThreads = max<size_t>(thread::hardware_concurrency(), 1);
+
+    for (size_t threads = 1;; threads *= 2) {
+        threads = min(threads, maxThreads);
+
+        sim::bench::Registration(
+            "threads/" + to_string(numVehicles) + "/" + to_string(threads),
+            [threads](State &state) { benchmarkThreads(state, threads); },
+            numSteps);
+
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+const bool registered = registerThreadBenchmarks();
+
+} // namespace
@@ -0,0 +1,118 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Batched environment steps, as a training loop would call them
+
+#include "allocations.h"
+#include "benchmark.h"
+
+#include "threadpool.h"
+#include "vecenv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using sim::bench::State;
+
+namespace {
+
+const size_t numEnvironments = 64;
+
+//! Threads 1 steps on the calling thread without a pool
+void benchmarkVecEnv(State &state, size_t threads) {
+    unique_ptr<sim::ThreadPool> pool;
+    if (threads > 1) {
+        pool = make_unique<sim::ThreadPool>(threads);
+    }
+
+    sim::VecEnv::Settings settings;
+    settings.count = numEnvironments;
+    settings.maxEpisodeSteps = 200;
+
+    sim::VecEnv env(settings, pool.get());
+
+    vector<float> position(numEnvironments * 3);
+    vector<float> rotation(numEnvironments * 4);
+    vector<float> linearVelocity(numEnvironments * 3);
+    vector<float> angularVelocity(numEnvironments * 3);
+    vector<float> waistAngle(numEnvironments);
+    vector<float> wheelSpeed(numEnvironments * 4);
+    vector<uint8_t> done(numEnvironments);
+
+    sim::VecEnv::Observations observations;
+    observations.position = position.data();
+    observations.rotation = rotation.data();
+    observations.linearVelocity = linearVelocity.data();
+    observations.angularVelocity = angularVelocity.data();
+    observations.waistAngle = waistAngle.data();
+    observations.wheelSpeed = wheelSpeed.data();
+    observations.done = done.data();
+
+    // Different actions in every environment, changing over time like a
+    // policy would
+    vector<double> throttle(numEnvironments);
+    vector<double> steering(numEnvironments);
+
+    env.reset(nullptr, observations);
+
+    size_t step = 0;
+    size_t episodes = 0;
+
+    auto stepAll = [&] {
+        for (size_t i = 0; i < numEnvironments; ++i) {
+            auto phase = static_cast<double>(step + i * 7) * .05;
+            throttle[i] = sin(phase);
+            steering[i] = cos(phase * .3);
+        }
+
+        env.step(throttle.data(), steering.data(), observations);
+        episodes += static_cast<size_t>(count(done.begin(), done.end(), 1));
+        ++step;
+    };
+
+    // Bullet grows its arrays during the first steps and the first reset,
+    // which is left out of the count
+    for (size_t i = 0; i <= settings.maxEpisodeSteps; ++i) {
+        stepAll();
+    }
+    episodes = 0;
+
+    auto before = sim::bench::allocations();
+
+    while (state.keepRunning()) {
+        stepAll();
+    }
+
+    state.counter("allocations/step",
+                  static_cast<double>(sim::bench::allocations() - before) /
+                      static_cast<double>(state.iterations()));
+    state.rate("env-steps", static_cast<double>(numEnvironments));
+    state.counter("environments", static_cast<double>(numEnvironments));
+    state.counter("episodes", static_cast<double>(episodes));
+    state.counter("threads", static_cast<double>(threads));
+}
+
+bool registerVecEnvBenchmarks() {
+    auto maxThreads = max<size_t>(thread::hardware_concurrency(), 1);
+
+    for (size_t threads : {size_t{1}, maxThreads}) {
+        sim::bench::Registration(
+            "vecenv/" + to_string(numEnvironments) + "/" + to_string(threads),
+            [threads](State &state) { benchmarkVecEnv(state, threads); },
+            600);
+
+        if (maxThreads == 1) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+const bool registered = registerVecEnvBenchmarks();
+
+} // namespace
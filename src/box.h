@@ -6,7 +6,9 @@
 
 namespace sim {
 
+//! Draw a single box, use RenderBatch when drawing many
 void renderBox(const Matrixf &model,
                const Matrixf &view,
                const Matrixf &projection);
-}
+
+} // namespace sim
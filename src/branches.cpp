@@ -0,0 +1,73 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "branches.h"
+#include "profiler.h"
+#include "threadpool.h"
+
+using namespace std;
+
+namespace sim {
+
+Branches::Branch::Branch(const World::Settings &worldSettings,
+                         const Fleet::Layout &layout)
+    : world(worldSettings)
+    , fleet(world.dynamicsWorld.get(), &world.arena) {
+    fleet.spawn(layout);
+}
+
+Branches::Branches(size_t count,
+                   const World::Settings &worldSettings,
+                   const Fleet::Layout &layout,
+                   ThreadPool *pool)
+    : pool(pool) {
+    branches.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        branches.push_back(make_unique<Branch>(worldSettings, layout));
+    }
+}
+
+void Branches::fork(const WorldState &state, bool exact) {
+    SIM_PROFILE("fork branches");
+
+    auto forkOne = [&](size_t i) {
+        auto &world = *branches[i]->world.dynamicsWorld;
+        state.restore(world);
+        if (exact) {
+            resetWorldCaches(world);
+        }
+    };
+
+    if (pool) {
+        pool->parallelFor(size(), forkOne);
+    }
+    else {
+        for (size_t i = 0; i < size(); ++i) {
+            forkOne(i);
+        }
+    }
+}
+
+void Branches::run(size_t steps, double dt, const Control &control) {
+    SIM_PROFILE("run branches");
+
+    const auto step = static_cast<btScalar>(dt);
+
+    auto runOne = [&](size_t i) {
+        auto &branch = *branches[i];
+        for (size_t s = 0; s < steps; ++s) {
+            control(i, s, branch.fleet);
+            branch.world.dynamicsWorld->stepSimulation(step, 1, step);
+        }
+    };
+
+    if (pool) {
+        pool->parallelFor(size(), runOne);
+    }
+    else {
+        for (size_t i = 0; i < size(); ++i) {
+            runOne(i);
+        }
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,68 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "fleet.h"
+#include "world.h"
+#include "worldstate.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace sim {
+
+class ThreadPool;
+
+//! Copies of a world with a fleet that are forked from the same
+//! WorldState and then continued with different inputs, for what-if
+//! analysis
+//!
+//! The worlds are built once, with the same layout as the fleet that the
+//! state is captured from, so that a fork only copies the state of the
+//! bodies and hinges into them instead of constructing any vehicles
+class Branches {
+public:
+    struct Branch {
+        Branch(const World::Settings &worldSettings,
+               const Fleet::Layout &layout);
+
+        World world;
+        Fleet fleet;
+    };
+
+    //! Sets the controls of a branch before every step
+    using Control =
+        std::function<void(size_t branch, size_t step, Fleet &fleet)>;
+
+    //! Without a pool everything runs on the calling thread
+    Branches(size_t count,
+             const World::Settings &worldSettings,
+             const Fleet::Layout &layout,
+             ThreadPool *pool = nullptr);
+
+    //! Put every branch in the state. With 'exact' the contact caches are
+    //! thrown away as well, so that the branches continues exactly like a
+    //! replay would, which costs about as much as rebuilding the
+    //! broadphase. Throws std::runtime_error if the world does not match
+    void fork(const WorldState &state, bool exact = true);
+
+    //! Step every branch 'steps' times with the timestep dt, each branch on
+    //! its own task
+    void run(size_t steps, double dt, const Control &control);
+
+    size_t size() const {
+        return branches.size();
+    }
+
+    Branch &operator[](size_t index) {
+        return *branches[index];
+    }
+
+private:
+    ThreadPool *pool;
+
+    std::vector<std::unique_ptr<Branch>> branches;
+};
+
+} // namespace sim
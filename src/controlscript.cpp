@@ -0,0 +1,75 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "controlscript.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace sim {
+
+ControlScript::ControlScript(std::vector<Control> c)
+    : controls(move(c)) {
+    stable_sort(controls.begin(),
+                controls.end(),
+                [](const Control &a, const Control &b) {
+                    return a.time < b.time;
+                });
+}
+
+ControlScript ControlScript::load(istream &stream) {
+    vector<Control> controls;
+
+    string line;
+    for (size_t lineNumber = 1; getline(stream, line); ++lineNumber) {
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') {
+            continue;
+        }
+
+        istringstream ss(line);
+        Control control;
+        if (!(ss >> control.time >> control.throttle >> control.steering)) {
+            throw runtime_error("control script: could not parse line " +
+                                to_string(lineNumber) + ": " + line);
+        }
+        controls.push_back(control);
+    }
+
+    return ControlScript(move(controls));
+}
+
+ControlScript ControlScript::load(const string &filename) {
+    ifstream file(filename);
+    if (!file) {
+        throw runtime_error("control script: could not open " + filename);
+    }
+
+    return load(file);
+}
+
+ControlScript::Control ControlScript::at(double time) const {
+    auto it = upper_bound(
+        controls.begin(), controls.end(), time, [](double t, const Control &c) {
+            return t < c.time;
+        });
+
+    if (it == controls.begin()) {
+        return {time, 0, 0};
+    }
+
+    return *(it - 1);
+}
+
+double ControlScript::duration() const {
+    if (controls.empty()) {
+        return 0;
+    }
+
+    return controls.back().time;
+}
+
+} // namespace sim
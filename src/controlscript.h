@@ -0,0 +1,37 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include <istream>
+#include <vector>
+
+namespace sim {
+
+//! Scripted throttle and steering input used instead of the keyboard
+//! The text format is one "time throttle steering" triple per line, lines
+//! starting with '#' are ignored. Values are held until the next line
+class ControlScript {
+public:
+    struct Control {
+        double time = 0;
+        double throttle = 0;
+        double steering = 0;
+    };
+
+    ControlScript() = default;
+    ControlScript(std::vector<Control> controls);
+
+    //! Throws std::runtime_error on malformed input
+    static ControlScript load(std::istream &stream);
+    static ControlScript load(const std::string &filename);
+
+    //! Get the control that is active at the specified simulation time
+    Control at(double time) const;
+
+    //! Time of the last control change
+    double duration() const;
+
+    std::vector<Control> controls;
+};
+
+} // namespace sim
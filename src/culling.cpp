@@ -0,0 +1,63 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sim {
+
+Culling::Culling(const Matrixf &view,
+                 const Matrixf &projection,
+                 float viewportHeight)
+    : viewProjection(projection * view), halfHeight(viewportHeight / 2) {
+    auto &m = viewProjection;
+
+    // Rows of the column major matrix
+    const std::array<float, 4> rows[4] = {
+        {m.x1, m.x2, m.x3, m.x4},
+        {m.y1, m.y2, m.y3, m.y4},
+        {m.z1, m.z2, m.z3, m.z4},
+        {m.w1, m.w2, m.w3, m.w4},
+    };
+
+    // A point is inside when -w <= x, y, z <= w in clip space
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 4; ++j) {
+            planes[i * 2][j] = rows[3][j] + rows[i][j];
+            planes[i * 2 + 1][j] = rows[3][j] - rows[i][j];
+        }
+    }
+}
+
+bool Culling::visible(const btVector3 &min, const btVector3 &max) const {
+    for (auto &plane : planes) {
+        // The corner that is furthest in along the plane normal
+        auto x = static_cast<float>(plane[0] > 0 ? max.x() : min.x());
+        auto y = static_cast<float>(plane[1] > 0 ? max.y() : min.y());
+        auto z = static_cast<float>(plane[2] > 0 ? max.z() : min.z());
+
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+float Culling::pixels(const btVector3 &min, const btVector3 &max) const {
+    auto center = (min + max) / 2;
+    auto radius = static_cast<float>((max - min).length() / 2);
+
+    auto &m = viewProjection;
+    auto w = m.w1 * static_cast<float>(center.x()) +
+             m.w2 * static_cast<float>(center.y()) +
+             m.w3 * static_cast<float>(center.z()) + m.w4;
+
+    // How much a length in world space is scaled along the screens y axis
+    auto scale = std::sqrt(m.y1 * m.y1 + m.y2 * m.y2 + m.y3 * m.y3);
+
+    return radius * scale / std::max(w, 1e-3f) * halfHeight;
+}
+
+} // namespace sim
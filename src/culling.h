@@ -0,0 +1,46 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "LinearMath/btVector3.h"
+#include "matrix.h"
+
+#include <array>
+
+namespace sim {
+
+//! Decides what is worth drawing, created once per frame from the camera
+//!
+//! Boxes are tested against the same planes that the gpu clips against, so
+//! everything that is culled would not have produced any pixels anyway
+class Culling {
+public:
+    Culling(const Matrixf &view,
+            const Matrixf &projection,
+            float viewportHeight);
+
+    //! False if the box is completely outside the view
+    bool visible(const btVector3 &min, const btVector3 &max) const;
+
+    //! Approximate radius in pixels of the box on screen
+    float pixels(const btVector3 &min, const btVector3 &max) const;
+
+    //! True when a box is so small on screen that its details can not be
+    //! seen. The view can zoom in and out without moving, so the size on
+    //! screen is used instead of the distance to the camera
+    bool isDetailed(const btVector3 &min, const btVector3 &max) const {
+        return pixels(min, max) >= detailPixels;
+    }
+
+    //! Groups smaller than this on screen are drawn as a single box
+    float detailPixels = 12;
+
+private:
+    //! Left, right, bottom, top, near and far, as ax + by + cz + d >= 0
+    std::array<std::array<float, 4>, 6> planes;
+
+    Matrixf viewProjection;
+    float halfHeight;
+};
+
+} // namespace sim
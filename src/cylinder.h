@@ -1,9 +1,12 @@
 // Copyright © Mattias Larsson Sköld 2020
 
+#pragma once
+
 #include "matrix.h"
 
 namespace sim {
 
+//! Draw a single cylinder, use RenderBatch when drawing many
 void renderCylinder(const Matrixf &model,
                     const Matrixf &view,
                     const Matrixf &projection);
@@ -18,4 +21,9 @@ void renderCylinderY(const Matrixf &model,
                      const Matrixf &view,
                      const Matrixf &projection);
 
+//! Rotations that puts the center of the cylinder along the x or y axis
+//! These are baked into the CylinderX and CylinderY meshes in MeshCache
+extern const Matrixf cylinderXRotation;
+extern const Matrixf cylinderYRotation;
+
 } // namespace sim
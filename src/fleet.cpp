@@ -0,0 +1,181 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "fleet.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace sim {
+
+btVector3 Fleet::Layout::halfExtents() const {
+    auto rows = (count + columns - 1) / columns;
+    return btVector3(static_cast<btScalar>(columns * spacingX / 2),
+                     static_cast<btScalar>(rows * spacingY / 2),
+                     0);
+}
+
+btTransform Fleet::Layout::transform(size_t i) const {
+    auto column = i % columns;
+    auto row = i / columns;
+
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin(
+        origin - halfExtents() +
+        btVector3(static_cast<btScalar>((column + .5) * spacingX),
+                  static_cast<btScalar>((row + .5) * spacingY),
+                  0));
+    return transform;
+}
+
+Fleet::Fleet(btDynamicsWorld *world, Arena *arena)
+    : world(world)
+    , vehicles(ArenaAllocator<Vehicle1>(arena)) {
+}
+
+Vehicle1 &Fleet::spawn(const btTransform &transform,
+                       const Vehicle1::Vehicle1Settings &settings) {
+    auto &shape = shapes[shapeKey(settings)];
+    if (!shape) {
+        shape = make_shared<Vehicle1::Shapes>(settings);
+    }
+
+    return vehicles.emplace_back(world, transform, settings, shape);
+}
+
+void Fleet::spawn(const Layout &layout) {
+    for (size_t i = 0; i < layout.count; ++i) {
+        spawn(layout.transform(i), layout.settings);
+    }
+}
+
+void Fleet::despawn(size_t count) {
+    for (size_t i = 0; i < count && !vehicles.empty(); ++i) {
+        vehicles.pop_back();
+    }
+
+    if (holdFull.size() > vehicles.size()) {
+        holdFull.resize(vehicles.size());
+    }
+}
+
+void Fleet::control(const double *throttle, const double *steering) {
+    SIM_PROFILE("fleet control");
+
+    size_t i = 0;
+    for (auto &vehicle : vehicles) {
+        vehicle.throttle(throttle[i]);
+        vehicle.steering(steering[i]);
+        ++i;
+    }
+}
+
+void Fleet::control(double throttle, double steering) {
+    SIM_PROFILE("fleet control");
+
+    for (auto &vehicle : vehicles) {
+        vehicle.throttle(throttle);
+        vehicle.steering(steering);
+    }
+}
+
+size_t Fleet::numSleeping() const {
+    size_t count = 0;
+    for (auto &vehicle : vehicles) {
+        count += vehicle.isSleeping();
+    }
+    return count;
+}
+
+void Fleet::updateDetail(const std::vector<btVector3> &focus,
+                         const Detail &detail) {
+    SIM_PROFILE("fleet detail");
+
+    holdFull.resize(vehicles.size(), 0);
+
+    // Only proxies have a user pointer, to the vehicle
+    touching.clear();
+    auto dispatcher = world->getDispatcher();
+    for (int i = 0; i < dispatcher->getNumManifolds(); ++i) {
+        auto manifold = dispatcher->getManifoldByIndexInternal(i);
+        if (!manifold->getNumContacts()) {
+            continue;
+        }
+
+        auto check = [&](const btCollisionObject *proxy,
+                         const btCollisionObject *other) {
+            if (proxy->getUserPointer() && !other->isStaticOrKinematicObject()) {
+                touching.push_back(
+                    static_cast<const Vehicle1 *>(proxy->getUserPointer()));
+            }
+        };
+
+        check(manifold->getBody0(), manifold->getBody1());
+        check(manifold->getBody1(), manifold->getBody0());
+    }
+
+    auto isNear = [&](const btVector3 &position, double radius) {
+        auto radius2 = static_cast<btScalar>(radius * radius);
+        for (auto &point : focus) {
+            if (position.distance2(point) < radius2) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    size_t i = 0;
+    for (auto &vehicle : vehicles) {
+        auto &hold = holdFull[i++];
+        auto &position = vehicle.frontBody.getWorldTransform().getOrigin();
+
+        if (vehicle.isProxy()) {
+            if (find(touching.begin(), touching.end(), &vehicle) !=
+                touching.end()) {
+                hold = detail.contactHold;
+                vehicle.useFullModel();
+            }
+            else if (isNear(position, detail.focusRadius)) {
+                vehicle.useFullModel();
+            }
+        }
+        else if (hold) {
+            --hold;
+        }
+        else if (!isNear(position, detail.focusRadius + detail.hysteresis)) {
+            vehicle.useProxy();
+        }
+    }
+}
+
+size_t Fleet::numProxies() const {
+    size_t count = 0;
+    for (auto &vehicle : vehicles) {
+        count += vehicle.isProxy();
+    }
+    return count;
+}
+
+Fleet::ShapeKey Fleet::shapeKey(const Vehicle1::Vehicle1Settings &s) {
+    // Everything that Vehicle1::Shapes depends on, the center joint offset
+    // places the halves in the proxy shape
+    return {s.wheelRadius,
+            s.wheelHalfWidth,
+            s.bodyHalfWidth,
+            s.bodyHalfHeight,
+            s.centerJointOffset,
+            s.rearBodyHalfLength,
+            s.frontBodyHalfLength,
+            s.frontWheight,
+            s.rearWheight,
+            s.wheelWheigt,
+            s.bucketHalfWidth,
+            s.bucketHalfHeight,
+            s.bucketHalfLength,
+            s.bucketWallHalfThickness,
+            s.bucketWheight};
+}
+
+} // namespace sim
@@ -0,0 +1,129 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "arena.h"
+#include "vehicle1.h"
+
+#include <array>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace sim {
+
+//! Many Vehicle1 in one world
+//! Vehicles are stored in a deque so that they are allocated in contiguous
+//! chunks and never moves, and vehicles with the same settings share their
+//! collision shapes
+class Fleet {
+public:
+    //! Vehicles spawned in a grid centered around origin
+    struct Layout {
+        size_t count = 100;
+        size_t columns = 10;
+        double spacingX = 12;
+        double spacingY = 16;
+        btVector3 origin = {0, 0, -3};
+
+        Vehicle1::Vehicle1Settings settings;
+
+        //! Half the size of the area that the vehicles takes up
+        btVector3 halfExtents() const;
+
+        //! Where vehicle i of the layout is spawned
+        btTransform transform(size_t i) const;
+    };
+
+    //! Physics level of detail, see updateDetail()
+    struct Detail {
+        //! Vehicles closer than this to a focus point use the full model
+        double focusRadius = 40;
+
+        //! A vehicle has to be this much further away before it goes back
+        //! to the proxy, so that it does not switch at every step at the
+        //! border
+        double hysteresis = 10;
+
+        //! Updates that a vehicle keeps the full model after it was woken
+        //! by a contact
+        size_t contactHold = 120;
+    };
+
+    //! The vehicles are stored in the arena if there is one, usually
+    //! World::arena, which then has to outlive the fleet. Despawned
+    //! vehicles leave their memory to the next ones that are spawned
+    Fleet(btDynamicsWorld *world, Arena *arena = nullptr);
+
+    Fleet(const Fleet &) = delete;
+    Fleet &operator=(const Fleet &) = delete;
+
+    Vehicle1 &spawn(const btTransform &transform,
+                    const Vehicle1::Vehicle1Settings &settings);
+
+    void spawn(const Layout &layout);
+
+    //! Remove the vehicles that was spawned last
+    void despawn(size_t count);
+
+    //! Apply the controls to every vehicle in one pass
+    //! The arrays needs to have one value per vehicle
+    void control(const double *throttle, const double *steering);
+
+    //! Apply the same control to every vehicle
+    void control(double throttle, double steering);
+
+    size_t size() const {
+        return vehicles.size();
+    }
+
+    //! Number of vehicles that are not stepped
+    size_t numSleeping() const;
+
+    //! Let vehicles far from every focus point use a VehicleProxy and the
+    //! rest the full model. Focus points are the camera, sensors and
+    //! anything else that needs detailed vehicles around it. A proxy that
+    //! touches anything that is not static, like another vehicle, also gets
+    //! the full model. Call once per step, before stepping
+    void updateDetail(const std::vector<btVector3> &focus,
+                      const Detail &detail);
+
+    //! Number of vehicles that use a VehicleProxy
+    size_t numProxies() const;
+
+    //! Number of distinct shape sets, for statistics
+    size_t numShapes() const {
+        return shapes.size();
+    }
+
+    Vehicle1 &operator[](size_t index) {
+        return vehicles[index];
+    }
+
+    auto begin() {
+        return vehicles.begin();
+    }
+
+    auto end() {
+        return vehicles.end();
+    }
+
+private:
+    using ShapeKey = std::array<double, 15>;
+
+    static ShapeKey shapeKey(const Vehicle1::Vehicle1Settings &settings);
+
+    btDynamicsWorld *world;
+
+    std::map<ShapeKey, std::shared_ptr<Vehicle1::Shapes>> shapes;
+    std::deque<Vehicle1, ArenaAllocator<Vehicle1>> vehicles;
+
+    //! Updates left that each vehicle has to keep the full model
+    std::vector<size_t> holdFull;
+
+    //! Proxies in contact with something, reused between updates
+    std::vector<const Vehicle1 *> touching;
+};
+
+} // namespace sim
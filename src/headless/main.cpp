@@ -0,0 +1,899 @@
+//! Copyright © Mattias Larsson Sköld
+
+// Runs the vehicle scene without any window or graphics context, as fast
+// as the cpu allows, with input from a control script instead of the
+// keyboard
+
+#include "branches.h"
+#include "controlscript.h"
+#include "fleet.h"
+#include "profiler.h"
+#include "rangesensor.h"
+#include "recorder.h"
+#include "scenariorunner.h"
+#include "soil.h"
+#include "telemetry.h"
+#include "terrain.h"
+#include "threadpool.h"
+#include "trajectory.h"
+#include "vehicle1.h"
+#include "world.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+void printUsage() {
+    cout << "usage: headless [options]\n"
+         << "  --script <file>   control script with lines of\n"
+         << "                    'time throttle steering'\n"
+         << "  --time <seconds>  simulated time to run (default script "
+            "length or 10)\n"
+         << "  --dt <seconds>    fixed timestep (default 1/60)\n"
+         << "  --print <steps>   print the vehicle position every n steps\n"
+         << "  --vehicles <n>    number of vehicles in the world (default 1)\n"
+         << "  --trace <file>    save the latest profiler events as a chrome\n"
+         << "                    trace, including bullets internal zones\n"
+         << "  --record <file>   record input and keyframes of the run\n"
+         << "  --keyframe-interval <steps>\n"
+         << "                    steps between keyframes (default 600)\n"
+         << "  --replay <file>   replay a recording, needs the same\n"
+         << "                    --vehicles as when it was recorded\n"
+         << "  --seek <step>     start the replay from the closest keyframe\n"
+         << "  --verify          check that the replay matches every keyframe\n"
+         << "  --terrain <dir>   drive on streamed heightfield tiles from dir\n"
+         << "                    instead of the ground box\n"
+         << "  --generate-terrain <n>\n"
+         << "                    write a test map of n * n tiles to the\n"
+         << "                    --terrain directory before running\n"
+         << "  --scenarios <file>\n"
+         << "                    run one world per line of the file in\n"
+         << "                    parallel, lines are 'name key=value...'\n"
+         << "  --sweep <setting> <from> <to> <count>\n"
+         << "                    run count worlds in parallel with the\n"
+         << "                    setting spread evenly from 'from' to 'to'\n"
+         << "  --trajectory <file>\n"
+         << "                    save the position of the first vehicle at\n"
+         << "                    every step\n"
+         << "  --compare <file>  compare the run with a trajectory saved by\n"
+         << "                    another build, eg the float build against\n"
+         << "                    the double build\n"
+         << "  --tolerance <m>   error that counts as diverged in --compare\n"
+         << "                    (default .1)\n"
+         << "  --telemetry <target>\n"
+         << "                    stream the state of every vehicle at every\n"
+         << "                    step to a file or to unix:<socket path>\n"
+         << "  --sensors <rays>  scan a range sensor with rays * 16 rays on\n"
+         << "                    every vehicle at every step\n"
+         << "  --detail-radius <m>\n"
+         << "                    only vehicles this close to the first one\n"
+         << "                    use the full model, the rest a raycast\n"
+         << "                    vehicle proxy\n"
+         << "  --branches <k>    at the end, fork the world into k branches\n"
+         << "                    that continue with steering spread from\n"
+         << "                    -1 to 1, in parallel\n"
+         << "  --branch-time <seconds>\n"
+         << "                    simulated time of each branch (default 5)\n"
+         << "  --soil <particles>\n"
+         << "                    the first vehicle digs into a pile of soil\n"
+         << "                    with about this many particles, driving\n"
+         << "                    in, lifting and backing out over and over\n"
+         << "  --dig-cycle <seconds>\n"
+         << "                    time of one dig cycle (default 8)\n"
+         << "  --threads <n>     threads used for scenarios, sensors,\n"
+         << "                    branches and soil (default all)\n"
+         << "  --bullet-threads <n>\n"
+         << "                    threads used to step the world, 0 is one\n"
+         << "                    per hardware thread (default 1, needs a\n"
+         << "                    BT_THREADSAFE build for anything else)\n";
+}
+
+struct Settings {
+    string scriptFile;
+    double time = 0;
+    double dt = 1. / 60.;
+    size_t printInterval = 0;
+    size_t threads = 0;
+    size_t bulletThreads = 1;
+    size_t vehicles = 1;
+
+    string traceFile;
+
+    string recordFile;
+    size_t keyframeInterval = 600;
+
+    string replayFile;
+    size_t seekStep = 0;
+    bool verify = false;
+
+    string terrainDirectory;
+    int generateTerrain = 0;
+
+    string telemetryTarget;
+
+    size_t sensorRays = 0;
+
+    double detailRadius = 0;
+
+    size_t branches = 0;
+    double branchTime = 5;
+
+    size_t soilParticles = 0;
+    double digCycle = 8;
+
+    string trajectoryFile;
+    string compareFile;
+    double tolerance = .1;
+
+    string scenarioFile;
+
+    string sweepSetting;
+    double sweepFrom = 0;
+    double sweepTo = 0;
+    size_t sweepCount = 0;
+};
+
+Settings parseArguments(int argc, char **argv) {
+    Settings settings;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+
+        auto next = [&]() -> string {
+            if (i + 1 >= argc) {
+                throw runtime_error("missing value after " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--script") {
+            settings.scriptFile = next();
+        }
+        else if (arg == "--time") {
+            settings.time = stod(next());
+        }
+        else if (arg == "--dt") {
+            settings.dt = stod(next());
+        }
+        else if (arg == "--print") {
+            settings.printInterval = stoul(next());
+        }
+        else if (arg == "--scenarios") {
+            settings.scenarioFile = next();
+        }
+        else if (arg == "--sweep") {
+            settings.sweepSetting = next();
+            settings.sweepFrom = stod(next());
+            settings.sweepTo = stod(next());
+            settings.sweepCount = stoul(next());
+        }
+        else if (arg == "--vehicles") {
+            settings.vehicles = stoul(next());
+        }
+        else if (arg == "--trace") {
+            settings.traceFile = next();
+        }
+        else if (arg == "--record") {
+            settings.recordFile = next();
+        }
+        else if (arg == "--keyframe-interval") {
+            settings.keyframeInterval = stoul(next());
+        }
+        else if (arg == "--replay") {
+            settings.replayFile = next();
+        }
+        else if (arg == "--seek") {
+            settings.seekStep = stoul(next());
+        }
+        else if (arg == "--verify") {
+            settings.verify = true;
+        }
+        else if (arg == "--terrain") {
+            settings.terrainDirectory = next();
+        }
+        else if (arg == "--generate-terrain") {
+            settings.generateTerrain = stoi(next());
+        }
+        else if (arg == "--telemetry") {
+            settings.telemetryTarget = next();
+        }
+        else if (arg == "--sensors") {
+            settings.sensorRays = stoul(next());
+        }
+        else if (arg == "--detail-radius") {
+            settings.detailRadius = stod(next());
+        }
+        else if (arg == "--branches") {
+            settings.branches = stoul(next());
+        }
+        else if (arg == "--branch-time") {
+            settings.branchTime = stod(next());
+        }
+        else if (arg == "--soil") {
+            settings.soilParticles = stoul(next());
+        }
+        else if (arg == "--dig-cycle") {
+            settings.digCycle = stod(next());
+        }
+        else if (arg == "--trajectory") {
+            settings.trajectoryFile = next();
+        }
+        else if (arg == "--compare") {
+            settings.compareFile = next();
+        }
+        else if (arg == "--tolerance") {
+            settings.tolerance = stod(next());
+        }
+        else if (arg == "--threads") {
+            settings.threads = stoul(next());
+        }
+        else if (arg == "--bullet-threads") {
+            settings.bulletThreads = stoul(next());
+        }
+        else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            exit(0);
+        }
+        else {
+            throw runtime_error("unknown argument " + arg);
+        }
+    }
+
+    if (settings.dt <= 0) {
+        throw runtime_error("--dt must be positive");
+    }
+
+    if (settings.generateTerrain && settings.terrainDirectory.empty()) {
+        throw runtime_error("--generate-terrain needs --terrain");
+    }
+
+    // Proxies are added and removed during the run, the same as terrain
+    if (settings.detailRadius > 0 &&
+        !(settings.recordFile.empty() && settings.replayFile.empty())) {
+        throw runtime_error(
+            "--detail-radius can not be combined with --record or --replay");
+    }
+
+    // The branches are built from the layout of the fleet, without terrain
+    // tiles or proxies
+    if (settings.branches &&
+        (!settings.terrainDirectory.empty() || settings.detailRadius > 0)) {
+        throw runtime_error(
+            "--branches can not be combined with --terrain or "
+            "--detail-radius");
+    }
+
+    // The soil lies on the flat ground and is not part of the world state
+    if (settings.soilParticles &&
+        (!settings.terrainDirectory.empty() || settings.branches ||
+         !(settings.recordFile.empty() && settings.replayFile.empty()))) {
+        throw runtime_error("--soil can not be combined with --terrain, "
+                            "--branches, --record or --replay");
+    }
+
+    if (settings.digCycle <= 0) {
+        throw runtime_error("--dig-cycle must be positive");
+    }
+
+    // Terrain tiles are added and removed during the run, which the
+    // keyframes can not follow
+    if (!settings.terrainDirectory.empty() &&
+        !(settings.recordFile.empty() && settings.replayFile.empty())) {
+        throw runtime_error(
+            "--terrain can not be combined with --record or --replay");
+    }
+
+    // The multithreaded solver does not solve the islands in the same
+    // order every time, so the keyframes would not match
+    if (settings.bulletThreads != 1 &&
+        !(settings.recordFile.empty() && settings.replayFile.empty())) {
+        throw runtime_error("--bullet-threads can not be combined with "
+                            "--record or --replay");
+    }
+
+    return settings;
+}
+
+int runScenarios(const vector<sim::Scenario> &scenarios, size_t threads) {
+    sim::ThreadPool pool(threads);
+
+    cout << "running " << scenarios.size() << " scenarios on " << pool.size()
+         << " threads" << endl;
+
+    auto report = sim::runScenarios(scenarios, pool);
+
+    cout << left << setw(30) << "name" << right << setw(10) << "steps"
+         << setw(12) << "wall [s]" << setw(12) << "distance" << setw(12)
+         << "max speed" << setw(12) << "x" << setw(12) << "y" << setw(12)
+         << "z"
+         << "\n";
+
+    for (auto &result : report.results) {
+        cout << left << setw(30) << result.name << right << setw(10)
+             << result.steps << setw(12) << result.wallTime << setw(12)
+             << result.distance << setw(12) << result.maxSpeed << setw(12)
+             << result.finalX << setw(12) << result.finalY << setw(12)
+             << result.finalZ << "\n";
+    }
+
+    cout << "total steps: " << report.totalSteps << "\n"
+         << "wall time: " << report.wallTime << " s\n"
+         << "steps per second: " << report.stepsPerSecond() << endl;
+
+    return 0;
+}
+
+//! Input to a loader that drives into a pile with the bucket down, lifts
+//! the bucket and backs out to where it started, over and over
+struct DigInput {
+    double throttle;
+    double lift;
+};
+
+DigInput digCycle(double time, double period) {
+    auto phase = fmod(time, period) / period;
+    if (phase < .4) {
+        return {.5, -1};
+    }
+    if (phase < .6) {
+        return {0, 1};
+    }
+    return {-.5, 0};
+}
+
+//! Fork the world into branches that steers differently, and print where
+//! the first vehicle ends up in each of them
+void runBranches(btDynamicsWorld &world,
+                 sim::World::Settings worldSettings,
+                 const sim::Fleet::Layout &layout,
+                 const Settings &settings) {
+    using Clock = chrono::steady_clock;
+
+    // The branches runs in parallel with each other instead
+    worldSettings.threads = 1;
+
+    sim::ThreadPool pool(settings.threads);
+
+    auto start = Clock::now();
+    sim::Branches branches(settings.branches, worldSettings, layout, &pool);
+    auto built = Clock::now();
+
+    sim::WorldState state;
+    state.capture(world);
+    branches.fork(state);
+    auto forked = Clock::now();
+
+    auto steps = static_cast<size_t>(settings.branchTime / settings.dt + .5);
+    auto count = settings.branches;
+
+    auto steering = [count](size_t branch) {
+        return count > 1 ? -1 + 2 * static_cast<double>(branch) /
+                                    static_cast<double>(count - 1)
+                         : 0.;
+    };
+
+    branches.run(steps,
+                 settings.dt,
+                 [&steering](size_t branch, size_t, sim::Fleet &fleet) {
+                     fleet.control(1, steering(branch));
+                 });
+
+    auto finished = Clock::now();
+
+    auto seconds = [](Clock::time_point from, Clock::time_point to) {
+        return chrono::duration<double>(to - from).count();
+    };
+
+    cout << left << setw(10) << "branch" << right << setw(12) << "steering"
+         << setw(12) << "x" << setw(12) << "y" << setw(12) << "z"
+         << "\n";
+
+    for (size_t i = 0; i < branches.size(); ++i) {
+        auto &origin =
+            branches[i].fleet[0].frontBody.getWorldTransform().getOrigin();
+        cout << left << setw(10) << i << right << setw(12) << steering(i)
+             << setw(12) << origin.x() << setw(12) << origin.y() << setw(12)
+             << origin.z() << "\n";
+    }
+
+    cout << "branches built in: " << seconds(start, built) << " s\n"
+         << "branches forked in: " << seconds(built, forked) << " s\n"
+         << "branches ran " << steps << " steps in: "
+         << seconds(forked, finished) << " s" << endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Settings settings;
+    sim::ControlScript script;
+
+    try {
+        settings = parseArguments(argc, argv);
+
+        if (settings.scriptFile.empty()) {
+            script = sim::ControlScript({{0, 1, 0}});
+        }
+        else {
+            script = sim::ControlScript::load(settings.scriptFile);
+        }
+    }
+    catch (std::exception &e) {
+        cerr << e.what() << endl;
+        printUsage();
+        return 1;
+    }
+
+    if (settings.time <= 0) {
+        settings.time = script.duration() > 0 ? script.duration() : 10;
+    }
+
+    if (!settings.scenarioFile.empty() || settings.sweepCount) {
+        sim::Scenario defaults;
+        defaults.script = script;
+        defaults.time = settings.time;
+        defaults.dt = settings.dt;
+
+        vector<sim::Scenario> scenarios;
+
+        try {
+            if (!settings.scenarioFile.empty()) {
+                ifstream file(settings.scenarioFile);
+                if (!file) {
+                    throw runtime_error("could not open " +
+                                        settings.scenarioFile);
+                }
+                scenarios = sim::loadScenarios(file, defaults);
+            }
+
+            if (settings.sweepCount) {
+                auto sweep = sim::createSweep(settings.sweepSetting,
+                                              settings.sweepFrom,
+                                              settings.sweepTo,
+                                              settings.sweepCount,
+                                              defaults);
+                scenarios.insert(scenarios.end(), sweep.begin(), sweep.end());
+            }
+        }
+        catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+
+        return runScenarios(scenarios, settings.threads);
+    }
+
+    sim::Fleet::Layout layout;
+    layout.count = max<size_t>(settings.vehicles, 1);
+    layout.columns = static_cast<size_t>(
+        ceil(sqrt(static_cast<double>(layout.count))));
+
+    auto fleetExtents = layout.halfExtents();
+    auto groundHalfExtent = max<double>(
+        50, max(fleetExtents.x(), fleetExtents.y()) + layout.spacingY);
+
+    sim::World::Settings worldSettings;
+    worldSettings.groundHalfExtent =
+        settings.terrainDirectory.empty() ? groundHalfExtent : 0;
+    worldSettings.threads = settings.bulletThreads;
+
+    unique_ptr<sim::World> worldPointer;
+    try {
+        worldPointer = make_unique<sim::World>(worldSettings);
+    }
+    catch (std::exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    auto &world = *worldPointer;
+
+    unique_ptr<sim::Terrain> terrain;
+    vector<btVector3> terrainPoints;
+
+    if (!settings.terrainDirectory.empty()) {
+        sim::Terrain::Settings terrainSettings;
+        terrainSettings.directory = settings.terrainDirectory;
+
+        try {
+            if (settings.generateTerrain) {
+                sim::generateTerrain(terrainSettings, settings.generateTerrain);
+            }
+        }
+        catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+
+        terrain = make_unique<sim::Terrain>(world.dynamicsWorld.get(),
+                                            terrainSettings);
+    }
+
+    sim::Fleet fleet(world.dynamicsWorld.get(), &world.arena);
+
+    if (settings.soilParticles) {
+        // Only the first vehicle gets a bucket and digs, the rest of the
+        // fleet can still switch to the proxy
+        auto loader = layout.settings;
+        loader.bucket = true;
+        fleet.spawn(layout.transform(0), loader);
+
+        for (size_t i = 1; i < layout.count; ++i) {
+            fleet.spawn(layout.transform(i), layout.settings);
+        }
+    }
+    else {
+        fleet.spawn(layout);
+    }
+
+    // Loads the tiles around every vehicle
+    auto updateTerrain = [&] {
+        if (!terrain) {
+            return;
+        }
+
+        SIM_PROFILE("terrain");
+
+        terrainPoints.clear();
+        for (auto &v : fleet) {
+            auto &transform = v.frontBody.getWorldTransform();
+            terrainPoints.push_back(transform.getOrigin());
+        }
+        terrain->update(terrainPoints);
+    };
+
+    updateTerrain();
+
+    auto &vehicle = fleet[0];
+
+    unique_ptr<sim::Replay> replay;
+    size_t firstStep = 0;
+
+    ofstream recordFile;
+    unique_ptr<sim::Recorder> recorder;
+
+    try {
+        if (!settings.replayFile.empty()) {
+            ifstream file(settings.replayFile, ios::binary);
+            if (!file) {
+                throw runtime_error("could not open " + settings.replayFile);
+            }
+            replay = make_unique<sim::Replay>(file);
+            settings.dt = replay->dt();
+            firstStep = replay->seek(*world.dynamicsWorld, settings.seekStep);
+        }
+        else if (!settings.recordFile.empty()) {
+            recordFile.open(settings.recordFile, ios::binary);
+            if (!recordFile) {
+                throw runtime_error("could not open " + settings.recordFile);
+            }
+            recorder = make_unique<sim::Recorder>(
+                recordFile, settings.dt, settings.keyframeInterval);
+        }
+    }
+    catch (std::exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    const auto steps =
+        replay ? replay->numSteps()
+               : static_cast<size_t>(settings.time / settings.dt + .5);
+    const auto dt = static_cast<btScalar>(settings.dt);
+
+    unique_ptr<sim::Telemetry> telemetry;
+
+    if (!settings.telemetryTarget.empty()) {
+        try {
+            telemetry = make_unique<sim::Telemetry>(
+                sim::openTelemetrySink(settings.telemetryTarget),
+                settings.dt);
+        }
+        catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
+    // Shared by the sensors and the soil, they run one after the other
+    unique_ptr<sim::ThreadPool> pool;
+    if (settings.sensorRays || settings.soilParticles) {
+        pool = make_unique<sim::ThreadPool>(settings.threads);
+    }
+
+    unique_ptr<sim::RangeSensors> sensors;
+    double sensorTime = 0;
+
+    if (settings.sensorRays) {
+        sensors =
+            make_unique<sim::RangeSensors>(*world.dynamicsWorld, pool.get());
+
+        sim::RangeSensor::Settings sensorSettings;
+        sensorSettings.horizontalRays = settings.sensorRays;
+
+        // Above the front body, so the rays clear the bucket
+        btTransform mount;
+        mount.setIdentity();
+        mount.setOrigin({0, 0, 2});
+
+        for (auto &v : fleet) {
+            sensors->add(sim::RangeSensor(v, mount, sensorSettings));
+        }
+    }
+
+    unique_ptr<sim::Soil> soil;
+    double soilTime = 0;
+    size_t maxCarried = 0;
+
+    if (settings.soilParticles) {
+        soil = make_unique<sim::Soil>(pool.get());
+
+        // A meter in front of the bucket, which reaches the pile when it is
+        // lowered
+        auto &bucket = *vehicle.bucketBody;
+        soil->fillPile(
+            bucket.getWorldTransform() *
+                btVector3(0, vehicle.settings.bucketHalfLength + 1, 0),
+            settings.soilParticles);
+
+        // Only the first vehicle collides with the soil, the others drive
+        // through it
+        soil->addBody(vehicle.frontBody);
+        soil->addBody(vehicle.rearBody);
+        soil->addBody(bucket);
+        for (auto &wheel : vehicle.wheels) {
+            soil->addBody(wheel.body);
+        }
+    }
+
+    // Everything inside the walls of the bucket
+    auto carried = [&] {
+        auto &s = vehicle.settings;
+        return soil->countInside(vehicle.bucketBody->getWorldTransform(),
+                                 btVector3(s.bucketHalfWidth,
+                                           s.bucketHalfLength,
+                                           s.bucketHalfHeight));
+    };
+
+    sim::Fleet::Detail detail;
+    detail.focusRadius = settings.detailRadius;
+    vector<btVector3> detailFocus(1);
+
+    sim::Trajectory trajectory;
+    const bool saveTrajectory =
+        !settings.trajectoryFile.empty() || !settings.compareFile.empty();
+
+    if (saveTrajectory) {
+        trajectory.precision = sim::Trajectory::currentPrecision();
+        trajectory.dt = settings.dt;
+        trajectory.samples.reserve(steps - firstStep);
+    }
+
+    if (terrain) {
+        cout << "terrain tiles loaded: " << terrain->size() << " ("
+             << terrain->numLoads() << " loads, " << terrain->numUnloads()
+             << " unloads)" << endl;
+    }
+
+    if (!settings.traceFile.empty()) {
+        sim::Profiler::instance().enableBulletProfiling();
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    for (size_t step = firstStep; step < steps; ++step) {
+        sim::ControlInput input;
+
+        if (replay) {
+            try {
+                input = replay->step(
+                    *world.dynamicsWorld, step, settings.verify);
+            }
+            catch (std::exception &e) {
+                cerr << e.what() << endl;
+                return 1;
+            }
+        }
+        else {
+            auto control = script.at(static_cast<double>(step) * settings.dt);
+            input = {control.throttle, control.steering};
+
+            if (recorder) {
+                recorder->step(*world.dynamicsWorld, step, input);
+            }
+        }
+
+        fleet.control(input.throttle, input.steering);
+
+        // Only the first vehicle has a bucket, the rest of the fleet keeps
+        // driving by the script
+        if (soil) {
+            auto dig =
+                digCycle(static_cast<double>(step) * settings.dt,
+                         settings.digCycle);
+            vehicle.throttle(dig.throttle);
+            vehicle.lift(dig.lift);
+        }
+
+        updateTerrain();
+
+        if (settings.detailRadius > 0) {
+            detailFocus.front() =
+                vehicle.frontBody.getWorldTransform().getOrigin();
+            fleet.updateDetail(detailFocus, detail);
+        }
+
+        if (soil) {
+            auto soilStart = chrono::steady_clock::now();
+            soil->step(settings.dt);
+            soilTime += chrono::duration<double>(chrono::steady_clock::now() -
+                                                 soilStart)
+                            .count();
+        }
+
+        {
+            SIM_PROFILE("stepSimulation");
+            world.dynamicsWorld->stepSimulation(dt, 1, dt);
+        }
+
+        if (sensors) {
+            sensors->scan();
+            sensorTime += sensors->lastScanTime();
+        }
+
+        // Outside of the soil time, counting goes through every particle
+        if (soil) {
+            maxCarried = max(maxCarried, carried());
+        }
+
+        if (telemetry) {
+            SIM_PROFILE("telemetry");
+            uint32_t index = 0;
+            for (auto &v : fleet) {
+                telemetry->record(sim::captureTelemetry(v, step, index++));
+            }
+        }
+
+        if (saveTrajectory) {
+            auto &origin = vehicle.frontBody.getWorldTransform().getOrigin();
+            trajectory.samples.push_back(
+                {step, origin.x(), origin.y(), origin.z()});
+        }
+
+        if (settings.printInterval && step % settings.printInterval == 0) {
+            auto &origin = vehicle.frontBody.getWorldTransform().getOrigin();
+            cout << step << " " << origin.x() << " " << origin.y() << " "
+                 << origin.z() << "\n";
+        }
+    }
+
+    auto wallTime =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    auto simTime = static_cast<double>(steps - firstStep) * settings.dt;
+    auto &origin = vehicle.frontBody.getWorldTransform().getOrigin();
+
+    if (replay && settings.verify) {
+        cout << "replay matches all keyframes from step " << firstStep << "\n";
+    }
+
+    cout << "vehicles: " << fleet.size() << "\n"
+         << "sleeping vehicles: " << fleet.numSleeping() << "\n"
+         << "proxy vehicles: " << fleet.numProxies() << "\n"
+         << "bullet threads: " << world.threads() << "\n"
+         << "steps: " << steps - firstStep << "\n"
+         << "sim time: " << simTime << " s\n"
+         << "wall time: " << wallTime << " s\n"
+         << "sim seconds per wall second: " << simTime / wallTime << "\n"
+         << "steps per second: "
+         << static_cast<double>(steps - firstStep) / wallTime
+         << "\n"
+         << "final position: " << origin.x() << " " << origin.y() << " "
+         << origin.z() << endl;
+
+    if (terrain && terrain->numFailures()) {
+        cout << "terrain tiles failed to load: " << terrain->numFailures()
+             << " (" << terrain->lastError() << ")" << endl;
+    }
+
+    if (sensors) {
+        auto rays = static_cast<double>(sensors->numRays()) *
+                    static_cast<double>(steps - firstStep);
+        cout << "sensor rays per step: " << sensors->numRays() << " on "
+             << pool->size() << " threads\n"
+             << "sensor time: " << sensorTime << " s\n"
+             << "rays per second: " << rays / sensorTime << "\n"
+             << "rays per second needed for real time: "
+             << static_cast<double>(sensors->numRays()) / settings.dt
+             << endl;
+    }
+
+    if (soil) {
+        auto particleSteps = static_cast<double>(soil->size()) *
+                             static_cast<double>(soil->settings.subSteps) *
+                             static_cast<double>(steps - firstStep);
+        cout << "soil particles: " << soil->size() << " on " << pool->size()
+             << " threads\n"
+             << "soil time: " << soilTime << " s\n"
+             << "soil sim seconds per wall second: " << simTime / soilTime
+             << "\n"
+             << "particle substeps per second: " << particleSteps / soilTime
+             << "\n"
+             << "particles in the bucket: " << carried() << " (at most "
+             << maxCarried << ")" << endl;
+    }
+
+    if (telemetry) {
+        telemetry->stop();
+        cout << "telemetry records: " << telemetry->written() << " ("
+             << telemetry->dropped() << " dropped)\n";
+    }
+
+    if (saveTrajectory) {
+        trajectory.wallTime = wallTime;
+
+        try {
+            if (!settings.trajectoryFile.empty()) {
+                trajectory.save(settings.trajectoryFile);
+                cout << "trajectory written to " << settings.trajectoryFile
+                     << endl;
+            }
+
+            if (!settings.compareFile.empty()) {
+                auto reference = sim::Trajectory::load(settings.compareFile);
+                auto divergence =
+                    sim::compare(reference, trajectory, settings.tolerance);
+
+                cout << "compared " << trajectory.precision << " with "
+                     << reference.precision << " over " << divergence.samples
+                     << " steps\n"
+                     << "max error: " << divergence.maxError << "\n"
+                     << "mean error: " << divergence.meanError << "\n"
+                     << "final error: " << divergence.finalError << "\n";
+
+                if (divergence.exceedsTolerance) {
+                    cout << "diverged more than " << settings.tolerance
+                         << " at step " << divergence.firstStepOverTolerance
+                         << "\n";
+                }
+                else {
+                    cout << "within " << settings.tolerance << "\n";
+                }
+
+                cout << "speedup: " << divergence.speedup << endl;
+            }
+        }
+        catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
+    if (settings.branches) {
+        try {
+            runBranches(*world.dynamicsWorld, worldSettings, layout, settings);
+        }
+        catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
+    if (!settings.traceFile.empty()) {
+        if (!sim::Profiler::instance().exportChromeTrace(settings.traceFile)) {
+            cerr << "could not write trace to " << settings.traceFile << endl;
+            return 1;
+        }
+        cout << "trace written to " << settings.traceFile << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "instancebuffer.h"
+
+namespace sim {
+
+static_assert(sizeof(Matrixf) == sizeof(float) * 16,
+              "matrices are uploaded directly as instance data");
+
+InstanceBuffer::InstanceBuffer() {
+    glCall(glGenBuffers(1, &buffer));
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    glDeleteBuffers(1, &buffer);
+}
+
+void InstanceBuffer::attach(size_t first) {
+    glCall(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+
+    for (GLuint i = 0; i < 4; ++i) {
+        glCall(glEnableVertexAttribArray(location + i));
+        glCall(glVertexAttribPointer(
+            location + i,
+            4,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(Matrixf),
+            reinterpret_cast<const void *>(sizeof(Matrixf) * first +
+                                           sizeof(float) * 4 * i)));
+        glCall(glVertexAttribDivisor(location + i, 1));
+    }
+}
+
+void InstanceBuffer::upload(const std::vector<Matrixf> &models) {
+    glCall(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+
+    auto size = models.size() * sizeof(Matrixf);
+
+    if (models.size() > capacity) {
+        capacity = models.size() * 2;
+    }
+
+    // Orphan the old storage so that the upload does not have to wait for
+    // draws that still use it
+    glCall(glBufferData(GL_ARRAY_BUFFER,
+                        static_cast<GLsizeiptr>(capacity * sizeof(Matrixf)),
+                        nullptr,
+                        GL_STREAM_DRAW));
+
+    glCall(glBufferSubData(
+        GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(size), models.data()));
+}
+
+} // namespace sim
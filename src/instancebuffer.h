@@ -0,0 +1,39 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "matgui/matgl.h"
+#include "matrix.h"
+
+#include <vector>
+
+namespace sim {
+
+//! Per instance model matrices for instanced drawing
+//! The matrices are read by the instanced shader as a mat4 attribute that
+//! takes up the locations from 'location' to 'location + 3'
+class InstanceBuffer {
+public:
+    static constexpr GLuint location = 2;
+
+    InstanceBuffer();
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    //! Setup the instance attributes on the currently bound vertex array
+    //! 'first' is the index of the matrix used for the first instance,
+    //! since there is no base instance in gl 3.3 several draws that share
+    //! the buffer points the attributes to their own part of it instead
+    void attach(size_t first = 0);
+
+    //! Replace the content of the buffer, the buffer grows if needed
+    void upload(const std::vector<Matrixf> &models);
+
+private:
+    GLuint buffer = 0;
+    size_t capacity = 0;
+};
+
+} // namespace sim
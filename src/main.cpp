@@ -11,28 +11,35 @@
 #include "assets.h"
 #include "modelobject.h"
 
+#include "articulatedvehicle.h"
 #include "box.h"
+#include "culling.h"
 #include "cylinder.h"
+#include "multibodyvehicle1.h"
+#include "physicsloop.h"
+#include "profileoverlay.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "renderbatch.h"
+#include "renderstate.h"
+#include "telemetry.h"
+#include "terrain.h"
+#include "terrainrender.h"
 #include "vehicle1.h"
+#include "world.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 using namespace std;
 using namespace Engine;
 using namespace MatGui;
 
-std::unique_ptr<btRigidBody> createRigidBody(btScalar mass,
-                                             btCollisionShape *shape) {
-    bool isDynamic = mass != 0.;
-
-    btVector3 localInertia(0, 0, 0);
-    if (isDynamic) {
-        shape->calculateLocalInertia(mass, localInertia);
-    }
-
-    return make_unique<btRigidBody>(mass, nullptr, shape, localInertia);
-}
-
 int main(int argc, char **argv) {
     Application app(argc, argv);
 
@@ -44,41 +51,85 @@ int main(int argc, char **argv) {
 
     Application::ContinuousUpdates(true);
 
-    // ---------------- physics ------------------------
-
-    auto collisionConfiguration =
-        make_unique<btDefaultCollisionConfiguration>();
-
-    auto dispatcher =
-        make_unique<btCollisionDispatcher>(collisionConfiguration.get());
-
-    auto broadphase = make_unique<btDbvtBroadphase>();
-
-    auto solver = make_unique<btSequentialImpulseConstraintSolver>();
+    // --record <file> saves the session, --replay <file> plays it back
+    // instead of reading the keyboard. --terrain <directory> replaces the
+    // ground box with heightfield tiles that are streamed around the vehicle.
+    // --vehicle <file> adds a vehicle from a definition file next to the
+    // first one, that is driven with the same keys. --telemetry <target>
+    // streams the state of the vehicle to a file or to unix:<socket path>.
+    // --time-scale <x> runs the simulation x times faster than real time,
+    // Z and X halves and doubles it while running. When the simulation can
+    // not keep up it is reported in the terminal. --multibody adds the
+    // btMultiBody version of the vehicle on the other side of the first one
+    string recordFilename;
+    string replayFilename;
+    string terrainDirectory;
+    string vehicleFilename;
+    string telemetryTarget;
+    double timeScale = 1;
+    bool multiBody = false;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = string{argv[i]};
+        if (arg == "--multibody") {
+            multiBody = true;
+        }
+        else if (i + 1 >= argc) {
+            break;
+        }
+        else if (arg == "--record") {
+            recordFilename = argv[++i];
+        }
+        else if (arg == "--replay") {
+            replayFilename = argv[++i];
+        }
+        else if (arg == "--terrain") {
+            terrainDirectory = argv[++i];
+        }
+        else if (arg == "--vehicle") {
+            vehicleFilename = argv[++i];
+        }
+        else if (arg == "--telemetry") {
+            telemetryTarget = argv[++i];
+        }
+        else if (arg == "--time-scale") {
+            timeScale = stod(argv[++i]);
+        }
+    }
 
-    auto dynamicsWorld =
-        make_unique<btDiscreteDynamicsWorld>(dispatcher.get(),
-                                             broadphase.get(),
-                                             solver.get(),
-                                             collisionConfiguration.get());
+    if (!(timeScale > 0)) {
+        cerr << "--time-scale must be positive" << endl;
+        return 1;
+    }
 
-    dynamicsWorld->setGravity(btVector3(0, 0, -100));
+    // Tiles are added and removed while running, which recordings can not
+    // follow
+    if (!terrainDirectory.empty() &&
+        !(recordFilename.empty() && replayFilename.empty())) {
+        cerr << "--terrain can not be combined with --record or --replay"
+             << endl;
+        return 1;
+    }
 
-    // -- shopes etc
+    // Keyframes only hold rigid bodies
+    if (multiBody && !(recordFilename.empty() && replayFilename.empty())) {
+        cerr << "--multibody can not be combined with --record or --replay"
+             << endl;
+        return 1;
+    }
 
-    // ground
+    // ---------------- physics ------------------------
 
-    auto groundShape = std::make_unique<btBoxShape>(
-        btVector3(btScalar(50.), btScalar(50.), btScalar(50.)));
+    sim::World::Settings worldSettings;
+    worldSettings.groundHalfExtent = terrainDirectory.empty() ? 50 : 0;
+    worldSettings.multiBody = multiBody;
 
-    btTransform groundTransform;
-    groundTransform.setIdentity();
-    groundTransform.setOrigin(btVector3(0, 0, -51));
+    sim::World world(worldSettings);
 
-    auto groundBody = createRigidBody(0, groundShape.get());
-    groundBody->setWorldTransform(groundTransform);
+    auto &dynamicsWorld = world.dynamicsWorld;
+    auto &groundBody = world.groundBody;
 
-    dynamicsWorld->addRigidBody(groundBody.get());
+    // -- shopes etc
 
     const bool enableBasicTestShapes = false;
 
@@ -92,20 +143,20 @@ int main(int argc, char **argv) {
     // rb1
     testTransform.setOrigin(btVector3(0 + 10, 0, 0));
 
-    auto testBody = createRigidBody(1, testShape.get());
+    auto testBody = sim::createRigidBody(1, testShape.get());
 
     // rb2
 
     testTransform.setOrigin(btVector3(.5f + 10, 0, 1.f));
 
-    auto testBody2 = createRigidBody(1, testShape.get());
+    auto testBody2 = sim::createRigidBody(1, testShape.get());
     testBody2->setWorldTransform(testTransform);
 
     // cyl
 
     auto cylinderShape = make_unique<btCylinderShape>(btVector3(1, 1, 1));
     testTransform.setOrigin(btVector3(-.8f + 10, 0, 1));
-    auto testBody3 = createRigidBody(1, cylinderShape.get());
+    auto testBody3 = sim::createRigidBody(1, cylinderShape.get());
     testBody3->setWorldTransform(testTransform);
 
     // constraint
@@ -134,6 +185,51 @@ int main(int argc, char **argv) {
     sim::Vehicle1::Vehicle1Settings settings;
     sim::Vehicle1 vehicle(dynamicsWorld.get(), vehicleTransform, settings);
 
+    sim::VehicleDefinitionCache definitions;
+    std::unique_ptr<sim::ArticulatedVehicle> articulatedVehicle;
+
+    if (!vehicleFilename.empty()) {
+        try {
+            auto transform = vehicleTransform;
+            transform.getOrigin() += btVector3(15, 0, 0);
+            articulatedVehicle = make_unique<sim::ArticulatedVehicle>(
+                dynamicsWorld.get(),
+                transform,
+                definitions.get(vehicleFilename),
+                &world.arena);
+        }
+        catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
+    std::unique_ptr<sim::MultiBodyVehicle1> multiBodyVehicle;
+
+    if (multiBody) {
+        auto transform = vehicleTransform;
+        transform.getOrigin() += btVector3(-15, 0, 0);
+        multiBodyVehicle = make_unique<sim::MultiBodyVehicle1>(
+            world.multiBodyWorld(), transform, settings, vehicle.shapes);
+    }
+
+    // -- Terrain ----------
+
+    std::unique_ptr<sim::Terrain> terrain;
+    std::unique_ptr<sim::TerrainRenderer> terrainRenderer;
+
+    if (!terrainDirectory.empty()) {
+        sim::Terrain::Settings terrainSettings;
+        terrainSettings.directory = terrainDirectory;
+
+        terrain =
+            make_unique<sim::Terrain>(dynamicsWorld.get(), terrainSettings);
+        terrainRenderer = make_unique<sim::TerrainRenderer>(terrainSettings);
+
+        // Load the ground under the vehicle before it starts falling
+        terrain->update({vehicleTransform.getOrigin()});
+    }
+
     // -------------------------------------------------
 
     auto projection =
@@ -145,57 +241,234 @@ int main(int argc, char **argv) {
 
     double x = 0, y = 0;
     double scale = 2;
-    double steering = 0;
-    double throttle = 0;
 
-    window.frameUpdate.connect([&](double t) {
-        static double phase = 0;
+    // Written from the gui thread and read from the physics thread
+    std::atomic<double> steering{0};
+    std::atomic<double> throttle{0};
 
-        vehicle.steering(steering);
-        vehicle.throttle(throttle);
+    std::ofstream recordFile;
+    std::unique_ptr<sim::Recorder> recorder;
+    std::unique_ptr<sim::Replay> replay;
 
-        dynamicsWorld->stepSimulation(static_cast<btScalar>(t));
+    sim::PhysicsLoop::Settings physicsSettings;
+    physicsSettings.timeScale = timeScale;
 
-        phase += .01;
+    try {
+        if (!recordFilename.empty()) {
+            recordFile.open(recordFilename, ios::binary);
+            if (!recordFile) {
+                throw runtime_error("could not open " + recordFilename);
+            }
+            recorder = make_unique<sim::Recorder>(
+                recordFile, physicsSettings.fixedTimeStep);
+        }
+        else if (!replayFilename.empty()) {
+            std::ifstream file(replayFilename, ios::binary);
+            if (!file) {
+                throw runtime_error("could not open " + replayFilename);
+            }
+            replay = make_unique<sim::Replay>(file);
+            physicsSettings.fixedTimeStep = replay->dt();
+        }
+    }
+    catch (std::exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
 
-        Matrixd transform;
-        testBody->getWorldTransform().getOpenGLMatrix(&transform.x1);
+    // Declared before the physics loop so that it outlives the thread
+    std::unique_ptr<sim::Telemetry> telemetry;
 
-        auto viewTransform = Matrixf::RotationX(pi / 2. + .8 + y) *
-                             Matrixf::RotationZ(x * 2) *
-                             Matrixf::Scale(.05f * scale); // *
-        //                             Matrixf::Translation(-transform.row(3));
+    if (!telemetryTarget.empty()) {
+        try {
+            telemetry = make_unique<sim::Telemetry>(
+                sim::openTelemetrySink(telemetryTarget),
+                physicsSettings.fixedTimeStep);
+        }
+        catch (std::exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
+    // Steps with a fixed timestep on its own thread, the rendering only
+    // reads the snapshots that it publishes
+    sim::PhysicsLoop physics(*dynamicsWorld, physicsSettings);
 
-        groundBody->getWorldTransform().getOpenGLMatrix(&transform.x1);
-        sim::renderBox(transform.scale(50, 50, 50), viewTransform, projection);
+    // Counted on the physics thread, read by the seek keys
+    std::atomic<size_t> step{0};
 
-        vehicle.render(viewTransform, projection);
+    physics.preStep = [&](double) {
+        sim::ControlInput input{throttle, steering};
 
-        if (enableBasicTestShapes) {
-            sim::renderBox(transform, viewTransform, projection);
+        if (replay) {
+            input = replay->step(*dynamicsWorld, step);
+        }
+        else if (recorder) {
+            recorder->step(*dynamicsWorld, step, input);
+        }
 
-            testBody2->getWorldTransform().getOpenGLMatrix(&transform.x1);
-            sim::renderBox(transform, viewTransform, projection);
+        vehicle.steering(input.steering);
+        vehicle.throttle(input.throttle);
 
-            testBody3->getWorldTransform().getOpenGLMatrix(&transform.x1);
-            transform = transform * Matrixf::RotationX(pi / 2.);
-            sim::renderCylinder(transform, viewTransform, projection);
-            //        sim::renderBox(
-            //            Matrixf::RotationZ(phase).rotate(phase, Vec(1,
-            //            1).normalize()), Matrixf(), Matrixf::Scale(.5));
+        if (articulatedVehicle) {
+            articulatedVehicle->steering(input.steering);
+            articulatedVehicle->throttle(input.throttle);
+        }
 
-            //        sim::renderCylinder(
-            //            Matrixf::RotationZ(phase).rotate(-phase, Vec(1,
-            //            1).normalize()), Matrixf(), Matrixf::Scale(.5));
+        if (multiBodyVehicle) {
+            multiBodyVehicle->steering(input.steering);
+            multiBodyVehicle->throttle(input.throttle);
         }
 
-        if (false) {
-            auto mouseBoxTransform = Matrixf::Identity() *
-                                     Matrixf::Translation(x * 20., y * 20., -1);
-            sim::renderBox(mouseBoxTransform, viewTransform, projection);
+        if (terrain) {
+            auto &transform = vehicle.frontBody.getWorldTransform();
+            terrain->update({transform.getOrigin()});
         }
 
-        cout << transform.z4 << endl;
+        ++step;
+    };
+
+    if (telemetry) {
+        physics.postStep = [&](double) {
+            telemetry->record(sim::captureTelemetry(vehicle, step - 1, 0));
+        };
+    }
+
+    physics.addToSnapshot = [&](sim::TransformSnapshot &snapshot) {
+        vehicle.addToSnapshot(snapshot);
+    };
+
+    physics.fallingBehind = [](const sim::PhysicsLoop::WatchdogReport &report) {
+        cout << "simulation is behind: " << report.achievedTimeScale
+             << "x of requested " << report.requestedTimeScale << "x, "
+             << report.droppedTime << " s dropped" << endl;
+    };
+
+    // Jump to the keyframe at or before the given step, Q and E use this to
+    // move through a replay
+    auto seek = [&](size_t target) {
+        physics.post([&, target] {
+            step = replay->seek(*dynamicsWorld, target);
+        });
+    };
+
+    // Everything is collected here and drawn with one call per primitive
+    sim::RenderBatch batch;
+
+    // Press P to show the profiler timeline and T to save a trace
+    sim::ProfileOverlay profileOverlay;
+    sim::Profiler::instance().enableBulletProfiling();
+
+    uint64_t lastFrameEnd = 0;
+    uint64_t lastSummary = 0;
+
+    window.frameUpdate.connect([&](double) {
+        static double phase = 0;
+
+        physics.poll();
+
+        auto &profiler = sim::Profiler::instance();
+
+        // The time outside of the callback is mostly spent swapping buffers
+        // and handling events in the gui library
+        if (lastFrameEnd) {
+            profiler.record("swap and events", lastFrameEnd, profiler.now(), 0);
+        }
+
+        {
+            SIM_PROFILE("frame");
+
+            // The gui library binds its own programs and vertex arrays
+            // between frames
+            sim::RenderState::instance().reset();
+
+            auto frame = physics.frame();
+            auto transforms = frame.transforms();
+
+            phase += .01;
+
+            Matrix<btScalar> transform;
+            transforms(*testBody).getOpenGLMatrix(&transform.x1);
+
+            auto viewTransform = Matrixf::RotationX(pi / 2. + .8 + y) *
+                                 Matrixf::RotationZ(x * 2) *
+                                 Matrixf::Scale(.05f * scale); // *
+            //                         Matrixf::Translation(-transform.row(3));
+
+            btVector3 center{0, 0, 0};
+
+            if (terrainRenderer) {
+                // The map is too large to fit in the view, follow the
+                // vehicle instead
+                center = transforms(vehicle.frontBody).getOrigin();
+                viewTransform =
+                    viewTransform *
+                    Matrixf::Translation(static_cast<float>(-center.x()),
+                                         static_cast<float>(-center.y()),
+                                         static_cast<float>(-center.z()));
+            }
+
+            sim::Culling culling(
+                viewTransform, projection, static_cast<float>(height));
+
+            if (groundBody) {
+                transforms(*groundBody).getOpenGLMatrix(&transform.x1);
+                auto ground = world.groundHalfExtent;
+                batch.box(transform.scale(ground, ground, ground));
+            }
+
+            if (terrainRenderer) {
+                terrainRenderer->render(
+                    center, viewTransform, projection, culling);
+            }
+
+            vehicle.render(batch, transforms, culling);
+
+            if (articulatedVehicle) {
+                articulatedVehicle->render(batch, transforms, culling);
+            }
+
+            if (multiBodyVehicle) {
+                multiBodyVehicle->render(batch, transforms, culling);
+            }
+
+            if (enableBasicTestShapes) {
+                batch.box(transform);
+
+                transforms(*testBody2).getOpenGLMatrix(&transform.x1);
+                batch.box(transform);
+
+                transforms(*testBody3).getOpenGLMatrix(&transform.x1);
+                transform = transform * Matrixf::RotationX(pi / 2.);
+                batch.cylinder(transform);
+                //        sim::renderBox(
+                //            Matrixf::RotationZ(phase).rotate(phase, Vec(1,
+                //            1).normalize()), Matrixf(), Matrixf::Scale(.5));
+
+                //        sim::renderCylinder(
+                //            Matrixf::RotationZ(phase).rotate(-phase, Vec(1,
+                //            1).normalize()), Matrixf(), Matrixf::Scale(.5));
+            }
+
+            if (false) {
+                auto mouseBoxTransform =
+                    Matrixf::Identity() *
+                    Matrixf::Translation(x * 20., y * 20., -1);
+                batch.box(mouseBoxTransform);
+            }
+
+            batch.flush(viewTransform, projection);
+
+            profileOverlay.render();
+        }
+
+        lastFrameEnd = profiler.now();
+
+        if (profileOverlay.visible && lastFrameEnd - lastSummary > 1000000000) {
+            profileOverlay.printSummary(cout, 1);
+            lastSummary = lastFrameEnd;
+        }
     });
 
     window.pointerMoved.connect([&](View::PointerArgument arg) {
@@ -210,11 +483,11 @@ int main(int argc, char **argv) {
         if (arg.repeats == 0) {
             switch (arg.scanCode) {
             case Keys::W:
-                throttle += 1;
+                throttle = throttle + 1;
                 break;
 
             case Keys::S:
-                throttle -= 1;
+                throttle = throttle - 1;
                 break;
 
             case Keys::A:
@@ -224,6 +497,39 @@ int main(int argc, char **argv) {
             case Keys::D:
                 steering = 1;
                 break;
+
+            case Keys::Q:
+                if (replay) {
+                    size_t interval = replay->keyframeInterval();
+                    seek(step > interval ? step - interval : 0);
+                }
+                break;
+
+            case Keys::E:
+                if (replay) {
+                    seek(step + replay->keyframeInterval());
+                }
+                break;
+
+            case Keys::P:
+                profileOverlay.visible = !profileOverlay.visible;
+                break;
+
+            case Keys::Z:
+                physics.timeScale(max(physics.timeScale() / 2, 1. / 16.));
+                cout << "time scale " << physics.timeScale() << endl;
+                break;
+
+            case Keys::X:
+                physics.timeScale(min(physics.timeScale() * 2, 128.));
+                cout << "time scale " << physics.timeScale() << endl;
+                break;
+
+            case Keys::T:
+                if (sim::Profiler::instance().exportChromeTrace("trace.json")) {
+                    cout << "saved trace.json" << endl;
+                }
+                break;
             }
         }
     });
@@ -231,11 +537,11 @@ int main(int argc, char **argv) {
     window.keyUp.connect([&](View::KeyArgument arg) {
         switch (arg.scanCode) {
         case Keys::W:
-            throttle -= 1;
+            throttle = throttle - 1;
             break;
 
         case Keys::S:
-            throttle += 1;
+            throttle = throttle + 1;
             break;
 
         case Keys::A:
@@ -248,7 +554,17 @@ int main(int argc, char **argv) {
         }
     });
 
+    physics.start();
+
     app.mainLoop();
 
+    physics.stop();
+
+    if (telemetry) {
+        telemetry->stop();
+        cout << "telemetry records: " << telemetry->written() << " ("
+             << telemetry->dropped() << " dropped)" << endl;
+    }
+
     return 0;
 }
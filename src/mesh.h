@@ -29,3 +29,14 @@ struct Mesh {
     std::vector<Vertex> vertices;
     std::vector<unsigned> indices;
 };
+
+namespace sim {
+
+//! Box from -1 to 1 along every axis with one normal per side
+Mesh createBoxMesh();
+
+//! Cylinder with radius 1 along the z axis from -1 to 1
+//! numPoints is the number of segments around the circle
+Mesh createCylinderMesh(unsigned numPoints = 40);
+
+} // namespace sim
@@ -0,0 +1,182 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "meshcache.h"
+#include "cylinder.h"
+#include "renderstate.h"
+
+#include "matgui/constants.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+vec4 transformed(const Matrixf &m, const vec4 &v) {
+    return {m.x1 * v.x + m.x2 * v.y + m.x3 * v.z + m.x4 * v.w,
+            m.y1 * v.x + m.y2 * v.y + m.y3 * v.z + m.y4 * v.w,
+            m.z1 * v.x + m.z2 * v.y + m.z3 * v.z + m.z4 * v.w,
+            v.w};
+}
+
+Mesh rotated(Mesh mesh, const Matrixf &rotation) {
+    for (auto &vertex : mesh.vertices) {
+        vertex.pos = transformed(rotation, vertex.pos);
+        vertex.normal = transformed(rotation, vertex.normal);
+    }
+    return mesh;
+}
+
+} // namespace
+
+static_assert(sizeof(Vertex) == sizeof(float) * 8,
+              "vertices are uploaded as they are in memory");
+
+GpuMesh::GpuMesh(const Mesh &mesh)
+    : numIndices(static_cast<GLsizei>(mesh.indices.size())) {
+    glCall(glGenVertexArrays(1, &vao));
+    RenderState::instance().bindVertexArray(vao);
+
+    auto vertexBytes = mesh.vertices.size() * sizeof(Vertex);
+
+    glCall(glGenBuffers(1, &vertexBuffer));
+    glCall(glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer));
+    glCall(glBufferData(GL_ARRAY_BUFFER,
+                        static_cast<GLsizeiptr>(vertexBytes),
+                        mesh.vertices.data(),
+                        GL_STATIC_DRAW));
+
+    glCall(glEnableVertexAttribArray(0));
+    glCall(glVertexAttribPointer(0,
+                                 4,
+                                 GL_FLOAT,
+                                 GL_FALSE,
+                                 sizeof(Vertex),
+                                 reinterpret_cast<const void *>(
+                                     offsetof(Vertex, pos))));
+
+    glCall(glEnableVertexAttribArray(1));
+    glCall(glVertexAttribPointer(1,
+                                 4,
+                                 GL_FLOAT,
+                                 GL_FALSE,
+                                 sizeof(Vertex),
+                                 reinterpret_cast<const void *>(
+                                     offsetof(Vertex, normal))));
+
+    glCall(glGenBuffers(1, &indexBuffer));
+    glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer));
+
+    size_t indexBytes = 0;
+
+    if (mesh.vertices.size() <= numeric_limits<uint16_t>::max()) {
+        vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+        indexBytes = shortIndices.size() * sizeof(uint16_t);
+        indexType = GL_UNSIGNED_SHORT;
+        glCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(indexBytes),
+                            shortIndices.data(),
+                            GL_STATIC_DRAW));
+    }
+    else {
+        indexBytes = mesh.indices.size() * sizeof(unsigned);
+        indexType = GL_UNSIGNED_INT;
+        glCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(indexBytes),
+                            mesh.indices.data(),
+                            GL_STATIC_DRAW));
+    }
+
+    numBytes = vertexBytes + indexBytes;
+
+    RenderState::instance().bindVertexArray(0);
+}
+
+GpuMesh::~GpuMesh() {
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void GpuMesh::bind() const {
+    RenderState::instance().bindVertexArray(vao);
+}
+
+void GpuMesh::draw() const {
+    bind();
+    glCall(glDrawElements(GL_TRIANGLES, numIndices, indexType, nullptr));
+}
+
+void GpuMesh::drawInstanced(int count) const {
+    bind();
+    glCall(glDrawElementsInstanced(
+        GL_TRIANGLES, numIndices, indexType, nullptr, count));
+}
+
+MeshCache &MeshCache::instance() {
+    static MeshCache cache;
+    return cache;
+}
+
+const GpuMesh &MeshCache::get(Primitive primitive, int level) {
+    if (primitive == Box) {
+        level = 0;
+    }
+
+    auto &mesh = meshes[{primitive, level}];
+
+    if (!mesh) {
+        // The cpu side mesh is only kept until it is uploaded
+        switch (primitive) {
+        case Box:
+            mesh = make_unique<GpuMesh>(createBoxMesh());
+            break;
+        case Cylinder:
+            mesh = make_unique<GpuMesh>(createCylinderMesh(8u << level));
+            break;
+        case CylinderX:
+            mesh = make_unique<GpuMesh>(
+                rotated(createCylinderMesh(8u << level), cylinderXRotation));
+            break;
+        case CylinderY:
+            mesh = make_unique<GpuMesh>(
+                rotated(createCylinderMesh(8u << level), cylinderYRotation));
+            break;
+        }
+    }
+
+    return *mesh;
+}
+
+int MeshCache::level(Primitive primitive, double pixels) {
+    if (primitive == Box) {
+        return 0;
+    }
+
+    // The edges between the segments cuts the corner of the circle by
+    // r * (1 - cos(pi / segments)), keep that under half a pixel
+    for (int level = 0; level < numLevels - 1; ++level) {
+        auto segments = static_cast<double>(8 << level);
+        if (pixels * (1 - cos(MatGui::pif / segments)) < .5) {
+            return level;
+        }
+    }
+
+    return numLevels - 1;
+}
+
+size_t MeshCache::bytes() const {
+    size_t sum = 0;
+    for (auto &it : meshes) {
+        sum += it.second->bytes();
+    }
+    return sum;
+}
+
+} // namespace sim
@@ -0,0 +1,82 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "matgui/matgl.h"
+#include "mesh.h"
+
+#include <map>
+#include <memory>
+#include <utility>
+
+namespace sim {
+
+//! A mesh that only lives on the gpu
+//! Positions and normals are uploaded interleaved in one buffer, and the
+//! indices are stored as 16 bit when the mesh is small enough
+class GpuMesh {
+public:
+    GpuMesh(const Mesh &mesh);
+    ~GpuMesh();
+
+    GpuMesh(const GpuMesh &) = delete;
+    GpuMesh &operator=(const GpuMesh &) = delete;
+
+    //! Bind the vertex array, attach instance buffers after this
+    //! Does nothing if it is already bound, see RenderState
+    void bind() const;
+
+    //! Binds and draws
+    void draw() const;
+    void drawInstanced(int count) const;
+
+    //! Size of the buffers on the gpu
+    size_t bytes() const {
+        return numBytes;
+    }
+
+private:
+    GLuint vao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLsizei numIndices = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t numBytes = 0;
+};
+
+//! Meshes of the basic primitives, created on first use and shared by
+//! everything that draws them
+class MeshCache {
+public:
+    //! The x and y cylinders have the rotation baked into the vertices so
+    //! that it does not have to be multiplied into every model matrix
+    enum Primitive {
+        Box,
+        Cylinder,
+        CylinderX,
+        CylinderY,
+    };
+
+    //! Cylinders have 8 segments on the lowest level and twice as many on
+    //! every level above that
+    static constexpr int numLevels = 4;
+
+    static MeshCache &instance();
+
+    //! Mesh with the given level of tessellation, boxes only have one
+    const GpuMesh &get(Primitive primitive, int level = numLevels - 1);
+
+    //! Lowest level that still looks smooth when the radius of the
+    //! primitive is the given number of pixels on screen
+    static int level(Primitive primitive, double pixels);
+
+    //! Total size of the meshes on the gpu
+    size_t bytes() const;
+
+private:
+    MeshCache() = default;
+
+    std::map<std::pair<Primitive, int>, std::unique_ptr<GpuMesh>> meshes;
+};
+
+} // namespace sim
@@ -0,0 +1,139 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+// Geometry only, no gl calls, so that it can be used by the benchmarks
+
+#include "cylinder.h"
+#include "mesh.h"
+
+#include "matgui/constants.h"
+
+#include <cmath>
+
+using namespace MatGui;
+
+namespace sim {
+
+Mesh createBoxMesh() {
+    Mesh mesh;
+
+    auto &vertices = mesh.vertices;
+    auto &indices = mesh.indices;
+
+    for (float i : {1, -1}) {
+        const auto start = static_cast<unsigned>(vertices.size());
+        vec4 n = {0, 0, i};
+        vertices.emplace_back(vec4{-1, -1, i}, n);
+        vertices.emplace_back(vec4{1, -1, i}, n);
+        vertices.emplace_back(vec4{1, 1, i}, n);
+        vertices.emplace_back(vec4{-1, 1, i}, n);
+
+        indices.insert(indices.begin(), {start, start + 1, start + 2});
+        indices.insert(indices.begin(), {start, start + 2, start + 3});
+    }
+
+    for (float i : {1, -1}) {
+        const auto start = static_cast<unsigned>(vertices.size());
+        vec4 n = {0, i, 0};
+        vertices.emplace_back(vec4{-1, i, -1}, n);
+        vertices.emplace_back(vec4{1, i, -1}, n);
+        vertices.emplace_back(vec4{1, i, 1}, n);
+        vertices.emplace_back(vec4{-1, i, 1}, n);
+
+        indices.insert(indices.begin(), {start, start + 1, start + 2});
+        indices.insert(indices.begin(), {start, start + 2, start + 3});
+    }
+
+    for (float i : {1, -1}) {
+        const auto start = static_cast<unsigned>(vertices.size());
+        vec4 n = {i, 0, 0};
+        vertices.emplace_back(vec4{i, -1, -1}, n);
+        vertices.emplace_back(vec4{i, 1, -1}, n);
+        vertices.emplace_back(vec4{i, 1, 1}, n);
+        vertices.emplace_back(vec4{i, -1, 1}, n);
+
+        indices.insert(indices.begin(), {start, start + 1, start + 2});
+        indices.insert(indices.begin(), {start, start + 2, start + 3});
+    }
+
+    return mesh;
+}
+
+Mesh createCylinderMesh(unsigned numPoints) {
+    Mesh mesh;
+
+    auto &vertices = mesh.vertices;
+    auto &indices = mesh.indices;
+
+    for (float z : {1, -1}) {
+        const unsigned circleStart = static_cast<unsigned>(vertices.size()) + 1;
+
+        auto n = vec4{0, 0, z};
+        vertices.push_back({{0, 0, z}, n});
+
+        for (size_t i = 0; i < numPoints; ++i) {
+            auto angle = pi2f / numPoints * i;
+            vertices.push_back({{sinf(angle), cosf(angle), z}, n});
+        }
+
+        for (unsigned i = 1; i < numPoints; ++i) {
+            indices.push_back(circleStart);
+            indices.push_back(circleStart + i);
+            indices.push_back(circleStart + i - 1);
+        }
+
+        indices.push_back(0);
+        indices.push_back(circleStart);
+        indices.push_back(circleStart + numPoints - 1);
+    }
+
+    // ---- Walls -------
+
+    unsigned wallStart = static_cast<unsigned>(vertices.size());
+
+    for (unsigned int i = 0; i < numPoints; ++i) {
+        auto angle = pi2f / numPoints * i;
+        auto s = sinf(angle);
+        auto c = cosf(angle);
+        auto n = vec4{s, c};
+        vertices.push_back({{s, c, 1}, n});
+        vertices.push_back({{s, c, -1}, n});
+    }
+
+    for (unsigned i = 1; i < numPoints; ++i) {
+        indices.push_back(wallStart + i * 2);
+        indices.push_back(wallStart + i * 2 + 1);
+        indices.push_back(wallStart + (i - 1) * 2 + 1);
+
+        indices.push_back(wallStart + i * 2);
+        indices.push_back(wallStart + (i - 1) * 2);
+        indices.push_back(wallStart + (i - 1) * 2 + 1);
+    }
+
+    indices.push_back(wallStart);
+    indices.push_back(wallStart + 1);
+    indices.push_back(wallStart + (numPoints - 1) * 2 + 1);
+
+    indices.push_back(wallStart);
+    indices.push_back(wallStart + (numPoints - 1) * 2);
+    indices.push_back(wallStart + (numPoints - 1) * 2 + 1);
+
+    return mesh;
+}
+
+// clang-format off
+const Matrixf cylinderXRotation (
+        0, 0,-1, 0,
+        0, 1, 0, 0,
+        1, 0, 0, 0,
+        0, 0, 0, 1
+        );
+
+const Matrixf cylinderYRotation (
+        1, 0, 0, 0,
+        0, 0, 1, 0,
+        0,-1, 0, 0,
+        0, 0, 0, 1
+        );
+// clang-format on
+
+} // namespace sim
@@ -0,0 +1,207 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "multibodyvehicle1.h"
+
+#include <algorithm>
+
+using namespace std;
+
+using Settings = sim::Vehicle1::Vehicle1Settings;
+
+namespace {
+
+// Positions relative to the ground under the center of the vehicle, the
+// same as the ones Vehicle1 uses
+
+btVector3 centerPosition(const Settings &s) {
+    return btVector3(0, 0, s.axisZOffset + s.wheelRadius);
+}
+
+btVector3 frontPosition(const Settings &s) {
+    return centerPosition(s) + s.frontOffset();
+}
+
+btVector3 rearPosition(const Settings &s) {
+    return centerPosition(s) + s.rearOffset();
+}
+
+btVector3 wheelPosition(const Settings &s, int side, bool front) {
+    return centerPosition(s) + s.wheelOffset(side, front);
+}
+
+} // namespace
+
+namespace sim {
+
+MultiBodyVehicle1::MultiBodyVehicle1(btMultiBodyDynamicsWorld *world,
+                                     btTransform center,
+                                     Vehicle1::Vehicle1Settings s)
+    : MultiBodyVehicle1(
+          world, center, s, make_shared<Vehicle1::Shapes>(s)) {
+}
+
+MultiBodyVehicle1::MultiBodyVehicle1(
+    btMultiBodyDynamicsWorld *world,
+    btTransform center,
+    Vehicle1::Vehicle1Settings s,
+    std::shared_ptr<Vehicle1::Shapes> sharedShapes)
+    : settings(s)
+    , shapes(move(sharedShapes))
+    , world(world) {
+    auto front = frontPosition(s);
+    auto rear = rearPosition(s);
+
+    // The masses are the same as in Vehicle1, where the rear body also
+    // uses frontWheight
+    multiBody = make_unique<btMultiBody>(NumLinks,
+                                         static_cast<btScalar>(s.frontWheight),
+                                         shapes->frontInertia,
+                                         false,
+                                         true);
+
+    multiBody->setBaseWorldTransform(
+        btTransform(center.getBasis(), center * front));
+
+    // Rigid bodies are not damped by default, keep it that way
+    multiBody->setLinearDamping(0);
+    multiBody->setAngularDamping(0);
+
+    auto identity = btQuaternion::getIdentity();
+
+    // Vehicle1 has the waist hinge with the front body as A, a joint moves
+    // the link relative to its parent, so the steering changes sign
+    multiBody->setupRevolute(Rear,
+                             static_cast<btScalar>(s.frontWheight),
+                             shapes->rearInertia,
+                             Front,
+                             identity,
+                             btVector3(0, 0, 1),
+                             centerPosition(s) - front,
+                             rear - centerPosition(s),
+                             true);
+
+    struct WheelLink {
+        Link link;
+        int side;
+        bool front;
+    };
+
+    const WheelLink wheelLinks[] = {
+        {FrontLeftWheel, -1, true},
+        {RearLeftWheel, -1, false},
+        {FrontRightWheel, 1, true},
+        {RearRightWheel, 1, false},
+    };
+
+    for (auto &wheel : wheelLinks) {
+        auto position = wheelPosition(s, wheel.side, wheel.front);
+        multiBody->setupRevolute(wheel.link,
+                                 static_cast<btScalar>(s.wheelWheigt),
+                                 shapes->wheelInertia,
+                                 wheel.front ? Front : Rear,
+                                 identity,
+                                 btVector3(-1, 0, 0),
+                                 position - (wheel.front ? front : rear),
+                                 btVector3(0, 0, 0),
+                                 true);
+    }
+
+    multiBody->finalizeMultiDof();
+
+    world->addMultiBody(multiBody.get());
+
+    auto addCollider = [&](int link,
+                           btCollisionShape &shape,
+                           const btVector3 &position,
+                           btScalar friction) {
+        auto &collider = colliders[static_cast<size_t>(link + 1)];
+        collider = make_unique<btMultiBodyLinkCollider>(multiBody.get(), link);
+        collider->setCollisionShape(&shape);
+        collider->setWorldTransform(
+            btTransform(center.getBasis(), center * position));
+        collider->setFriction(friction);
+
+        world->addCollisionObject(collider.get(),
+                                  btBroadphaseProxy::DefaultFilter,
+                                  btBroadphaseProxy::AllFilter);
+
+        if (link == Front) {
+            multiBody->setBaseCollider(collider.get());
+        }
+        else {
+            multiBody->getLink(link).m_collider = collider.get();
+        }
+    };
+
+    // Same friction as the default for rigid bodies and Vehicle1 wheels
+    addCollider(Front, shapes->front, front, .5);
+    addCollider(Rear, shapes->rear, rear, .5);
+
+    for (auto &wheel : wheelLinks) {
+        addCollider(wheel.link,
+                    shapes->wheel,
+                    wheelPosition(s, wheel.side, wheel.front),
+                    10);
+    }
+
+    for (int link = 0; link < NumLinks; ++link) {
+        auto maxImpulse = link == Rear ? 10 : 1;
+        auto &motor = motors[static_cast<size_t>(link)];
+        motor = make_unique<btMultiBodyJointMotor>(
+            multiBody.get(), link, 0, static_cast<btScalar>(maxImpulse));
+        world->addMultiBodyConstraint(motor.get());
+    }
+}
+
+MultiBodyVehicle1::~MultiBodyVehicle1() {
+    for (auto &motor : motors) {
+        world->removeMultiBodyConstraint(motor.get());
+    }
+
+    for (auto &collider : colliders) {
+        world->removeCollisionObject(collider.get());
+    }
+
+    world->removeMultiBody(multiBody.get());
+}
+
+void MultiBodyVehicle1::steering(double value) {
+    if (value != 0) {
+        wake();
+    }
+    motors[Rear]->setVelocityTarget(
+        static_cast<btScalar>(-value * settings.steeringScaling));
+}
+
+void MultiBodyVehicle1::throttle(double value) {
+    if (value != 0) {
+        wake();
+    }
+    for (int link = FrontLeftWheel; link < NumLinks; ++link) {
+        motors[static_cast<size_t>(link)]->setVelocityTarget(
+            static_cast<btScalar>(value * settings.throttleScaling));
+    }
+}
+
+double MultiBodyVehicle1::jointError() const {
+    double max = 0;
+
+    for (int link = 0; link < NumLinks; ++link) {
+        auto &data = multiBody->getLink(link);
+
+        // The pivot seen from the parent and from the link
+        auto parent = collider(data.m_parent).getWorldTransform() *
+                      data.m_eVector;
+        auto child = collider(link).getWorldTransform() * -data.m_dVector;
+
+        max = std::max(max, static_cast<double>(parent.distance(child)));
+    }
+
+    return max;
+}
+
+void MultiBodyVehicle1::wake() {
+    multiBody->wakeUp();
+}
+
+} // namespace sim
@@ -0,0 +1,104 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "vehicle1.h"
+
+#include "BulletDynamics/Featherstone/btMultiBody.h"
+#include "BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h"
+#include "BulletDynamics/Featherstone/btMultiBodyJointMotor.h"
+#include "BulletDynamics/Featherstone/btMultiBodyLinkCollider.h"
+#include "transformsnapshot.h"
+
+#include <array>
+#include <memory>
+
+namespace sim {
+
+class Culling;
+class RenderBatch;
+
+//! The same vehicle as Vehicle1, built as one btMultiBody in reduced
+//! coordinates instead of rigid bodies held together by hinges
+//!
+//! The front body is the base, the rear body is a revolute link at the
+//! waist and every wheel is a revolute link on the body it sits on. The
+//! joints can not drift apart, so larger steps and fewer solver iterations
+//! can be used. Needs a World created with Settings::multiBody, where it
+//! can be mixed with hinge based vehicles
+class MultiBodyVehicle1 {
+public:
+    //! Link indices, the front body is the base and has index -1
+    enum Link {
+        Front = -1,
+        Rear = 0,
+        FrontLeftWheel,
+        RearLeftWheel,
+        FrontRightWheel,
+        RearRightWheel,
+        NumLinks,
+    };
+
+    MultiBodyVehicle1(btMultiBodyDynamicsWorld *world,
+                      btTransform center,
+                      Vehicle1::Vehicle1Settings settings);
+
+    //! Shapes are created with the same settings, as for Vehicle1
+    MultiBodyVehicle1(btMultiBodyDynamicsWorld *world,
+                      btTransform center,
+                      Vehicle1::Vehicle1Settings settings,
+                      std::shared_ptr<Vehicle1::Shapes> shapes);
+
+    //! Removes everything from the world
+    ~MultiBodyVehicle1();
+
+    MultiBodyVehicle1(const MultiBodyVehicle1 &) = delete;
+    MultiBodyVehicle1 &operator=(const MultiBodyVehicle1 &) = delete;
+
+    //! Any input other than 0 wakes the vehicle up and keeps it awake
+    void steering(double value);
+    void throttle(double value);
+
+    void wake();
+
+    //! The whole multibody sleeps as one
+    bool isSleeping() const {
+        return !multiBody->isAwake();
+    }
+
+    //! Same as Vehicle1::jointError, only rounding errors since the links
+    //! are placed from the joint angles
+    double jointError() const;
+
+    //! The collision object of a link, Front for the base
+    const btMultiBodyLinkCollider &collider(int link) const {
+        return *colliders[static_cast<size_t>(link + 1)];
+    }
+
+    //! Defined in multibodyvehicle1render.cpp
+    void render(RenderBatch &batch,
+                const InterpolatedTransforms &transforms,
+                const Culling &culling) const;
+
+    bool bounds(const InterpolatedTransforms &transforms,
+                btVector3 &min,
+                btVector3 &max) const;
+
+    Vehicle1::Vehicle1Settings settings;
+
+    std::shared_ptr<Vehicle1::Shapes> shapes;
+
+    std::unique_ptr<btMultiBody> multiBody;
+
+private:
+    btMultiBodyDynamicsWorld *world;
+
+    //! The base first and then one per link
+    std::array<std::unique_ptr<btMultiBodyLinkCollider>, NumLinks + 1>
+        colliders;
+
+    //! One per link, the waist and the wheels
+    std::array<std::unique_ptr<btMultiBodyJointMotor>, NumLinks> motors;
+};
+
+} // namespace sim
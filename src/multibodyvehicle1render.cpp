@@ -0,0 +1,66 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "culling.h"
+#include "multibodyvehicle1.h"
+#include "renderbatch.h"
+
+namespace sim {
+
+void MultiBodyVehicle1::render(RenderBatch &batch,
+                               const InterpolatedTransforms &transforms,
+                               const Culling &culling) const {
+    btVector3 min, max;
+    if (!bounds(transforms, min, max) || !culling.visible(min, max)) {
+        return;
+    }
+
+    if (!culling.isDetailed(min, max)) {
+        auto center = (min + max) / 2;
+        auto halfExtents = (max - min) / 2;
+        batch.box(Matrixd::Translation(center.x(), center.y(), center.z()) *
+                  Matrixd::Scale(
+                      halfExtents.x(), halfExtents.y(), halfExtents.z()));
+        return;
+    }
+
+    Matrix<btScalar> transform;
+    transforms(collider(Front)).getOpenGLMatrix(&transform.x1);
+    transform *= Matrixd::Scale(settings.bodyHalfWidth,
+                                settings.frontBodyHalfLength,
+                                settings.bodyHalfHeight);
+    batch.box(transform);
+
+    transforms(collider(Rear)).getOpenGLMatrix(&transform.x1);
+    transform *= Matrixd::Scale(settings.bodyHalfWidth,
+                                settings.rearBodyHalfLength,
+                                settings.bodyHalfHeight);
+    batch.box(transform);
+
+    for (int link = FrontLeftWheel; link < NumLinks; ++link) {
+        transforms(collider(link)).getOpenGLMatrix(&transform.x1);
+        transform *= Matrixd::Scale(settings.wheelHalfWidth,
+                                    settings.wheelRadius,
+                                    settings.wheelRadius);
+        batch.cylinderX(transform);
+    }
+}
+
+bool MultiBodyVehicle1::bounds(const InterpolatedTransforms &transforms,
+                               btVector3 &min,
+                               btVector3 &max) const {
+    if (!transforms.bounds(collider(Front), min, max)) {
+        return false;
+    }
+
+    for (int link = Rear; link < NumLinks; ++link) {
+        btVector3 linkMin, linkMax;
+        if (transforms.bounds(collider(link), linkMin, linkMax)) {
+            min.setMin(linkMin);
+            max.setMax(linkMax);
+        }
+    }
+
+    return true;
+}
+
+} // namespace sim
@@ -0,0 +1,274 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "physicsloop.h"
+#include "profiler.h"
+
+#include "btBulletDynamicsCommon.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace sim {
+
+InterpolatedTransforms PhysicsLoop::Frame::transforms() const {
+    return {previous.get(), current.get(), alpha};
+}
+
+PhysicsLoop::PhysicsLoop(btDynamicsWorld &world, Settings settings)
+    : world(world)
+    , settings(settings)
+    , scale(settings.timeScale) {
+    if (!(scale > 0)) {
+        throw invalid_argument("time scale must be positive");
+    }
+
+    // Make sure there is something to render before the first step
+    publish();
+    publish();
+}
+
+PhysicsLoop::PhysicsLoop(btDynamicsWorld &world)
+    : PhysicsLoop(world, Settings{}) {
+}
+
+PhysicsLoop::~PhysicsLoop() {
+    stop();
+}
+
+void PhysicsLoop::start() {
+    if (running) {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(clockMutex);
+        clockStart = Clock::now();
+        clockSimulationTime = simulationTime;
+    }
+
+    watchdogStart = Clock::now();
+    watchdogSteps = 0;
+    watchdogDropped = 0;
+
+    running = true;
+
+#ifndef __EMSCRIPTEN__
+    thread = std::thread([this] { run(); });
+#endif
+}
+
+void PhysicsLoop::poll() {
+#ifdef __EMSCRIPTEN__
+    if (running) {
+        update();
+    }
+#endif
+}
+
+void PhysicsLoop::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void PhysicsLoop::post(std::function<void()> f) {
+    lock_guard<mutex> lock(postMutex);
+    posted.push_back(move(f));
+}
+
+PhysicsLoop::Frame PhysicsLoop::frame() const {
+    Frame frame;
+
+    {
+        lock_guard<mutex> lock(snapshotMutex);
+        frame.previous = previousSnapshot;
+        frame.current = currentSnapshot;
+    }
+
+    double renderTime = 0;
+
+    // Render one step behind so that there is always a snapshot on each
+    // side of the rendered time
+    {
+        lock_guard<mutex> lock(clockMutex);
+        renderTime = targetTime(Clock::now()) - settings.fixedTimeStep;
+    }
+
+    auto span = frame.current->time - frame.previous->time;
+    if (span > 0) {
+        frame.alpha = clamp((renderTime - frame.previous->time) / span, 0., 1.);
+    }
+
+    return frame;
+}
+
+void PhysicsLoop::timeScale(double scale) {
+    if (!(scale > 0)) {
+        throw invalid_argument("time scale must be positive");
+    }
+
+    auto now = Clock::now();
+
+    lock_guard<mutex> lock(clockMutex);
+    clockSimulationTime = targetTime(now);
+    clockStart = now;
+    this->scale = scale;
+}
+
+double PhysicsLoop::timeScale() const {
+    lock_guard<mutex> lock(clockMutex);
+    return scale;
+}
+
+double PhysicsLoop::targetTime(Clock::time_point now) const {
+    return clockSimulationTime +
+           chrono::duration<double>(now - clockStart).count() * scale;
+}
+
+void PhysicsLoop::run() {
+    while (running) {
+        this_thread::sleep_until(update());
+    }
+}
+
+PhysicsLoop::Clock::time_point PhysicsLoop::update() {
+    const auto fixedTimeStep = settings.fixedTimeStep;
+
+    auto now = Clock::now();
+    double target = 0;
+    double currentScale = 1;
+
+    {
+        lock_guard<mutex> lock(clockMutex);
+        target = targetTime(now);
+        currentScale = scale;
+    }
+
+    auto numSteps =
+        static_cast<int>(floor((target - simulationTime) / fixedTimeStep));
+
+    // Faster time needs more steps per wall second, so the limit
+    // follows the time scale instead of dropping time at once
+    auto maxSteps = max(
+        1, static_cast<int>(ceil(settings.maxSubSteps * currentScale)));
+
+    if (numSteps > maxSteps) {
+        auto dropped = (numSteps - maxSteps) * fixedTimeStep;
+        simulationTime += dropped;
+        droppedSeconds = droppedSeconds + dropped;
+        watchdogDropped += dropped;
+        numSteps = maxSteps;
+    }
+
+    for (int i = 0; i < numSteps && running; ++i) {
+        step();
+        publish();
+    }
+
+    watchdog(Clock::now());
+
+    lock_guard<mutex> lock(clockMutex);
+    return clockStart +
+           chrono::duration_cast<Clock::duration>(chrono::duration<double>(
+               (simulationTime + fixedTimeStep - clockSimulationTime) /
+               scale));
+}
+
+void PhysicsLoop::watchdog(Clock::time_point now) {
+    auto elapsed = chrono::duration<double>(now - watchdogStart).count();
+    if (elapsed < settings.watchdogInterval) {
+        return;
+    }
+
+    WatchdogReport report;
+    report.requestedTimeScale = timeScale();
+    report.achievedTimeScale = static_cast<double>(watchdogSteps) *
+                               settings.fixedTimeStep / elapsed;
+    report.droppedTime = watchdogDropped;
+
+    auto behind = report.achievedTimeScale <
+                  report.requestedTimeScale * settings.watchdogTolerance;
+
+    if (behind && fallingBehind) {
+        fallingBehind(report);
+    }
+
+    watchdogStart = now;
+    watchdogSteps = 0;
+    watchdogDropped = 0;
+}
+
+void PhysicsLoop::step() {
+    SIM_PROFILE("physics step");
+
+    {
+        lock_guard<mutex> lock(postMutex);
+        swap(posted, postedRunning);
+    }
+    for (auto &f : postedRunning) {
+        f();
+    }
+    postedRunning.clear();
+
+    auto dt = settings.fixedTimeStep;
+
+    if (preStep) {
+        SIM_PROFILE("controls");
+        preStep(dt);
+    }
+
+    {
+        SIM_PROFILE("stepSimulation");
+        world.stepSimulation(
+            static_cast<btScalar>(dt), 1, static_cast<btScalar>(dt));
+    }
+
+    if (postStep) {
+        SIM_PROFILE("post step");
+        postStep(dt);
+    }
+
+    simulationTime += dt;
+    ++stepCount;
+    ++watchdogSteps;
+}
+
+void PhysicsLoop::publish() {
+    SIM_PROFILE("snapshot");
+
+    // A snapshot that is only referenced from the pool is neither published
+    // nor held by the renderer and can be reused
+    auto it = find_if(snapshotPool.begin(),
+                      snapshotPool.end(),
+                      [](auto &snapshot) { return snapshot.use_count() == 1; });
+
+    if (it == snapshotPool.end()) {
+        snapshotPool.push_back(make_shared<TransformSnapshot>());
+        it = snapshotPool.end() - 1;
+    }
+    else {
+        // use_count() is a relaxed load, so without the fence the writes
+        // below could be ordered before the renderer's last reads of the
+        // snapshot, before it released its reference
+        atomic_thread_fence(memory_order_acquire);
+    }
+
+    auto &snapshot = **it;
+    snapshot.capture(world);
+    if (addToSnapshot) {
+        addToSnapshot(snapshot);
+    }
+    snapshot.time = simulationTime;
+    snapshot.step = stepCount;
+
+    lock_guard<mutex> lock(snapshotMutex);
+    previousSnapshot = move(currentSnapshot);
+    currentSnapshot = *it;
+}
+
+} // namespace sim
@@ -0,0 +1,168 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "transformsnapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class btDynamicsWorld;
+
+namespace sim {
+
+//! Steps a world with a fixed timestep on a thread of its own and publishes
+//! a snapshot of all transforms after every step
+//!
+//! The world must not be touched from other threads while the loop is
+//! running, use post() to make changes to it
+//!
+//! The web build has no threads, there start() does not start a thread and
+//! the steps are taken from poll() on the gui thread instead
+class PhysicsLoop {
+public:
+    struct Settings {
+        double fixedTimeStep = 1. / 120.;
+
+        //! Maximum number of steps to catch up with in one go at a time
+        //! scale of 1, it is scaled up with the time scale. If the
+        //! simulation falls further behind than that, the time is dropped
+        int maxSubSteps = 8;
+
+        //! Simulated seconds per wall second
+        double timeScale = 1;
+
+        //! Wall seconds between the checks of how fast the simulation runs
+        double watchdogInterval = 1;
+
+        //! The simulation counts as behind when it reaches less than this
+        //! part of the requested time scale
+        double watchdogTolerance = .9;
+    };
+
+    //! How fast the simulation ran during the last watchdog interval
+    struct WatchdogReport {
+        double requestedTimeScale = 1;
+        double achievedTimeScale = 1;
+
+        //! Simulation time dropped during the interval
+        double droppedTime = 0;
+    };
+
+    //! A frame as seen by the renderer. Holds on to the snapshots so they
+    //! are not reused while rendering
+    struct Frame {
+        InterpolatedTransforms transforms() const;
+
+        std::shared_ptr<const TransformSnapshot> previous;
+        std::shared_ptr<const TransformSnapshot> current;
+        double alpha = 1;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    PhysicsLoop(btDynamicsWorld &world, Settings settings);
+    PhysicsLoop(btDynamicsWorld &world);
+
+    //! Stops the thread
+    ~PhysicsLoop();
+
+    PhysicsLoop(const PhysicsLoop &) = delete;
+    PhysicsLoop &operator=(const PhysicsLoop &) = delete;
+
+    void start();
+    void stop();
+
+    //! Take the steps that are due, only does something in the web build
+    //! where there is no physics thread. Call it before every frame
+    void poll();
+
+    //! Run on the physics thread before the next step
+    void post(std::function<void()> f);
+
+    //! Latest two snapshots with interpolation factor for the current time
+    Frame frame() const;
+
+    //! Run faster or slower than real time, the simulation continues from
+    //! where it is without jumping. Must be positive
+    void timeScale(double scale);
+    double timeScale() const;
+
+    //! Called on the physics thread before every fixed step
+    std::function<void(double dt)> preStep;
+
+    //! Called on the physics thread after every fixed step, before the
+    //! snapshot is published
+    std::function<void(double dt)> postStep;
+
+    //! Called on the physics thread after the world is captured in a
+    //! snapshot, to add objects that are not in the world
+    std::function<void(TransformSnapshot &snapshot)> addToSnapshot;
+
+    //! Called on the physics thread at the end of every watchdog interval
+    //! where the simulation did not keep up with the time scale
+    std::function<void(const WatchdogReport &)> fallingBehind;
+
+    size_t steps() const {
+        return stepCount;
+    }
+
+    //! Simulation time that has been thrown away because of falling behind
+    double droppedTime() const {
+        return droppedSeconds;
+    }
+
+private:
+    void run();
+
+    //! Take the steps that are due and return when the next one is
+    Clock::time_point update();
+
+    void step();
+    void publish();
+    void watchdog(Clock::time_point now);
+
+    //! The simulation time that should have been reached at 'now'
+    //! Call with clockMutex locked
+    double targetTime(Clock::time_point now) const;
+
+    btDynamicsWorld &world;
+    Settings settings;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    mutable std::mutex snapshotMutex;
+    std::shared_ptr<TransformSnapshot> previousSnapshot;
+    std::shared_ptr<TransformSnapshot> currentSnapshot;
+    //! Only touched from the physics thread
+    std::vector<std::shared_ptr<TransformSnapshot>> snapshotPool;
+
+    std::mutex postMutex;
+    std::vector<std::function<void()>> posted;
+    std::vector<std::function<void()>> postedRunning;
+
+    //! Simulation time is clockSimulationTime at clockStart and moves
+    //! scale times faster than the wall clock after that
+    mutable std::mutex clockMutex;
+    Clock::time_point clockStart;
+    double clockSimulationTime = 0;
+    double scale = 1;
+
+    double simulationTime = 0;
+
+    //! Only touched from the physics thread
+    Clock::time_point watchdogStart;
+    size_t watchdogSteps = 0;
+    double watchdogDropped = 0;
+
+    std::atomic<size_t> stepCount{0};
+    std::atomic<double> droppedSeconds{0};
+};
+
+} // namespace sim
@@ -0,0 +1,94 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "profileoverlay.h"
+#include "profiler.h"
+
+#include <iomanip>
+#include <map>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+const unsigned maxDepth = 6;
+const float rowHeight = .02f;
+const float rowSpacing = .005f;
+
+} // namespace
+
+namespace sim {
+
+void ProfileOverlay::render() {
+    if (!visible) {
+        return;
+    }
+
+    auto now = Profiler::now();
+    auto span = static_cast<uint64_t>(timeSpan * 1e9);
+    auto begin = now > span ? now - span : 0;
+
+    for (auto &event : Profiler::instance().events()) {
+        if (event.start + event.duration < begin || event.depth >= maxDepth) {
+            continue;
+        }
+
+        auto start = max(event.start, begin);
+        auto end = event.start + event.duration;
+
+        // Screen coordinates goes from -1 to 1
+        auto left = static_cast<float>(start - begin) / span * 2.f - 1.f;
+        auto right = static_cast<float>(end - begin) / span * 2.f - 1.f;
+        auto row = event.thread * maxDepth + event.depth;
+        auto top = 1.f - static_cast<float>(row) * (rowHeight + rowSpacing);
+
+        // Make sure that short events are still visible
+        auto halfWidth = max((right - left) / 2.f, .001f);
+
+        batch.box(Matrixf::Translation(
+                      left + halfWidth, top - rowHeight / 2.f, -.99f) *
+                  Matrixf::Scale(halfWidth, rowHeight / 2.f, .001f));
+    }
+
+    batch.flush(Matrixf::Identity(), Matrixf::Identity());
+}
+
+void ProfileOverlay::printSummary(std::ostream &stream, double seconds) {
+    struct Zone {
+        size_t count = 0;
+        uint64_t total = 0;
+    };
+
+    auto now = Profiler::now();
+    auto span = static_cast<uint64_t>(seconds * 1e9);
+    auto begin = now > span ? now - span : 0;
+
+    map<string, Zone> zones;
+
+    for (auto &event : Profiler::instance().events()) {
+        if (event.start < begin) {
+            continue;
+        }
+
+        auto &zone = zones[event.name];
+        ++zone.count;
+        zone.total += event.duration;
+    }
+
+    stream << left << setw(40) << "zone" << right << setw(10) << "count"
+           << setw(14) << "total [ms]" << setw(14) << "avg [us]"
+           << "\n";
+
+    for (auto &[name, zone] : zones) {
+        stream << left << setw(40) << name << right << setw(10) << zone.count
+               << setw(14) << static_cast<double>(zone.total) / 1e6
+               << setw(14)
+               << static_cast<double>(zone.total) / 1e3 /
+                      static_cast<double>(zone.count)
+               << "\n";
+    }
+
+    stream.flush();
+}
+
+} // namespace sim
@@ -0,0 +1,31 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "renderbatch.h"
+
+#include <ostream>
+
+namespace sim {
+
+//! Draws the latest profiler events as a timeline on top of the scene
+//! Time goes from left to right and ends at the current time. There is one
+//! row per thread and nesting level, starting from the top of the screen
+class ProfileOverlay {
+public:
+    void render();
+
+    //! Print count, total and average time per zone for the events that
+    //! started during the last 'seconds' seconds
+    void printSummary(std::ostream &stream, double seconds);
+
+    //! The time in seconds that the width of the screen represents
+    double timeSpan = .05;
+
+    bool visible = false;
+
+private:
+    RenderBatch batch;
+};
+
+} // namespace sim
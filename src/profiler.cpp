@@ -0,0 +1,197 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "profiler.h"
+
+#include "LinearMath/btQuickprof.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+namespace {
+
+const auto profilerStart = chrono::steady_clock::now();
+
+struct BulletZone {
+    const char *name;
+    uint64_t start;
+};
+
+thread_local vector<BulletZone> bulletZones;
+
+void enterBulletZone(const char *name) {
+    bulletZones.push_back({name, sim::Profiler::now()});
+    ++sim::Profiler::threadDepth();
+}
+
+void leaveBulletZone() {
+    if (bulletZones.empty()) {
+        return;
+    }
+
+    auto zone = bulletZones.back();
+    bulletZones.pop_back();
+
+    auto depth = --sim::Profiler::threadDepth();
+    sim::Profiler::instance().record(
+        zone.name, zone.start, sim::Profiler::now(), depth);
+}
+
+void writeJsonString(ostream &stream, const char *str) {
+    stream << '"';
+    for (; *str; ++str) {
+        switch (*str) {
+        case '"':
+            stream << "\\\"";
+            break;
+        case '\\':
+            stream << "\\\\";
+            break;
+        default:
+            if (static_cast<unsigned char>(*str) >= 0x20) {
+                stream << *str;
+            }
+        }
+    }
+    stream << '"';
+}
+
+} // namespace
+
+namespace sim {
+
+Profiler::Profiler()
+    : slots(make_unique<Slot[]>(capacity)) {
+}
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now() {
+    return static_cast<uint64_t>(
+        chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() -
+                                                   profilerStart)
+            .count());
+}
+
+void Profiler::record(const char *name,
+                      uint64_t start,
+                      uint64_t end,
+                      uint32_t depth) {
+    if (!enabled.load(memory_order_relaxed)) {
+        return;
+    }
+
+    auto index = writeIndex.fetch_add(1, memory_order_relaxed);
+    auto &slot = slots[index % capacity];
+
+    // Zero marks the slot as being written
+    slot.sequence.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot.name.store(name, memory_order_relaxed);
+    slot.start.store(start, memory_order_relaxed);
+    slot.duration.store(end - start, memory_order_relaxed);
+    slot.thread.store(threadIndex(), memory_order_relaxed);
+    slot.depth.store(depth, memory_order_relaxed);
+
+    slot.sequence.store(index + 1, memory_order_release);
+}
+
+std::vector<ProfileEvent> Profiler::events() const {
+    vector<ProfileEvent> events;
+    events.reserve(capacity);
+
+    for (size_t i = 0; i < capacity; ++i) {
+        auto &slot = slots[i];
+
+        auto sequence = slot.sequence.load(memory_order_acquire);
+        if (sequence == 0) {
+            continue;
+        }
+
+        ProfileEvent event;
+        event.name = slot.name.load(memory_order_relaxed);
+        event.start = slot.start.load(memory_order_relaxed);
+        event.duration = slot.duration.load(memory_order_relaxed);
+        event.thread = slot.thread.load(memory_order_relaxed);
+        event.depth = slot.depth.load(memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (slot.sequence.load(memory_order_relaxed) != sequence) {
+            // Overwritten while reading
+            continue;
+        }
+
+        events.push_back(event);
+    }
+
+    sort(events.begin(), events.end(), [](auto &a, auto &b) {
+        return a.start < b.start;
+    });
+
+    return events;
+}
+
+void Profiler::exportChromeTrace(std::ostream &stream) const {
+    auto events = this->events();
+
+    auto flags = stream.flags();
+    auto precision = stream.precision();
+    stream << fixed << setprecision(3);
+
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    bool first = true;
+    for (auto &event : events) {
+        if (!first) {
+            stream << ",\n";
+        }
+        first = false;
+
+        stream << "{\"name\":";
+        writeJsonString(stream, event.name);
+        stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+               << ",\"ts\":" << static_cast<double>(event.start) / 1000.
+               << ",\"dur\":" << static_cast<double>(event.duration) / 1000.
+               << "}";
+    }
+
+    stream << "\n]}\n";
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+bool Profiler::exportChromeTrace(const std::string &filename) const {
+    ofstream file(filename);
+    if (!file) {
+        return false;
+    }
+
+    exportChromeTrace(file);
+    return static_cast<bool>(file);
+}
+
+void Profiler::enableBulletProfiling() {
+    btSetCustomEnterProfileZoneFunc(enterBulletZone);
+    btSetCustomLeaveProfileZoneFunc(leaveBulletZone);
+}
+
+uint32_t Profiler::threadIndex() {
+    static atomic<uint32_t> numThreads{0};
+    thread_local uint32_t index = numThreads++;
+    return index;
+}
+
+uint32_t &Profiler::threadDepth() {
+    thread_local uint32_t depth = 0;
+    return depth;
+}
+
+} // namespace sim
@@ -0,0 +1,109 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+struct ProfileEvent {
+    //! Needs to outlive the profiler, use string literals
+    const char *name = nullptr;
+
+    //! Nanoseconds since the profiler was created
+    uint64_t start = 0;
+    uint64_t duration = 0;
+
+    uint32_t thread = 0;
+
+    //! Nesting level on the thread
+    uint32_t depth = 0;
+};
+
+//! Collects timed events from all threads into a lock free ring buffer
+//! When the buffer is full the oldest events are overwritten
+class Profiler {
+public:
+    static constexpr size_t capacity = 1 << 16;
+
+    static Profiler &instance();
+
+    //! Nanoseconds since the profiler was created
+    static uint64_t now();
+
+    void record(const char *name, uint64_t start, uint64_t end, uint32_t depth);
+
+    //! The events currently in the buffer, sorted by start time
+    std::vector<ProfileEvent> events() const;
+
+    //! Write the events in the chrome trace event format, open the file in
+    //! chrome://tracing or in perfetto
+    void exportChromeTrace(std::ostream &stream) const;
+    bool exportChromeTrace(const std::string &filename) const;
+
+    //! Route bullets internal profiling zones (solver, broadphase, narrow
+    //! phase...) into this profiler instead of bullets CProfileManager
+    void enableBulletProfiling();
+
+    //! Index of the calling thread, given in order of first use
+    static uint32_t threadIndex();
+
+    //! Nesting depth of the calling thread, used by the scoped timers
+    static uint32_t &threadDepth();
+
+    std::atomic<bool> enabled{true};
+
+private:
+    Profiler();
+
+    //! Every field is atomic so that reading while writing is well defined,
+    //! the sequence number tells if the slot was changed during the read
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> start{0};
+        std::atomic<uint64_t> duration{0};
+        std::atomic<uint32_t> thread{0};
+        std::atomic<uint32_t> depth{0};
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<uint64_t> writeIndex{0};
+};
+
+//! Records the time from construction to destruction
+class ProfileScope {
+public:
+    ProfileScope(const char *name)
+        : name(name)
+        , depth(Profiler::threadDepth()++)
+        , start(Profiler::now()) {
+    }
+
+    ~ProfileScope() {
+        Profiler::instance().record(name, start, Profiler::now(), depth);
+        --Profiler::threadDepth();
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    uint32_t depth;
+    uint64_t start;
+};
+
+} // namespace sim
+
+#define SIM_PROFILE_CONCAT_INNER(a, b) a##b
+#define SIM_PROFILE_CONCAT(a, b) SIM_PROFILE_CONCAT_INNER(a, b)
+
+//! Time the rest of the current scope, name must be a string literal
+#define SIM_PROFILE(name)                                                      \
+    ::sim::ProfileScope SIM_PROFILE_CONCAT(simProfileScope, __LINE__)(name)
@@ -0,0 +1,267 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "rangesensor.h"
+#include "profiler.h"
+#include "threadpool.h"
+#include "vehicle1.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+//! Only keeps the closest object and fraction, ClosestRayResultCallback
+//! also calculates the hit point and normal
+struct ClosestHit : public btCollisionWorld::RayResultCallback {
+    ClosestHit(const RangeSensor &sensor)
+        : ignored(sensor.ignored), owner(sensor.owner) {
+    }
+
+    bool needsCollision(btBroadphaseProxy *proxy) const override {
+        if (!RayResultCallback::needsCollision(proxy)) {
+            return false;
+        }
+
+        auto object =
+            static_cast<const btCollisionObject *>(proxy->m_clientObject);
+        if (owner && object->getUserPointer() == owner) {
+            return false;
+        }
+        return find(ignored.begin(), ignored.end(), object) == ignored.end();
+    }
+
+    btScalar addSingleResult(btCollisionWorld::LocalRayResult &result,
+                             bool) override {
+        m_closestHitFraction = result.m_hitFraction;
+        m_collisionObject = result.m_collisionObject;
+        return result.m_hitFraction;
+    }
+
+    const vector<const btCollisionObject *> &ignored;
+    const void *owner;
+};
+
+//! Tests the shape of every leaf in the broadphase that the ray passes
+struct LeafTest : public btDbvt::ICollide {
+    LeafTest(const btVector3 &from, const btVector3 &to, ClosestHit &hit)
+        : hit(hit) {
+        this->from.setIdentity();
+        this->from.setOrigin(from);
+        this->to.setIdentity();
+        this->to.setOrigin(to);
+
+        auto direction = to - from;
+        length = direction.length();
+        direction /= length;
+
+        for (int i = 0; i < 3; ++i) {
+            inverseDirection[i] =
+                direction[i] == 0 ? BT_LARGE_FLOAT : 1 / direction[i];
+            signs[i] = inverseDirection[i] < 0;
+        }
+    }
+
+    void Process(const btDbvtNode *leaf) override {
+        auto proxy = static_cast<btBroadphaseProxy *>(leaf->data);
+        if (!hit.needsCollision(proxy)) {
+            return;
+        }
+
+        // The box is further away than something that is already hit
+        btVector3 bounds[2] = {leaf->volume.Mins(), leaf->volume.Maxs()};
+        btScalar enter = 0;
+        if (!btRayAabb2(from.getOrigin(),
+                        inverseDirection,
+                        signs,
+                        bounds,
+                        enter,
+                        0,
+                        length * hit.m_closestHitFraction)) {
+            return;
+        }
+
+        auto object = static_cast<btCollisionObject *>(proxy->m_clientObject);
+        btCollisionWorld::rayTestSingle(from,
+                                        to,
+                                        object,
+                                        object->getCollisionShape(),
+                                        object->getWorldTransform(),
+                                        hit);
+    }
+
+    btTransform from;
+    btTransform to;
+    btVector3 inverseDirection;
+    unsigned signs[3];
+    btScalar length;
+    ClosestHit &hit;
+};
+
+} // namespace
+
+RangeSensor::RangeSensor(const btCollisionObject &body,
+                         const btTransform &mount,
+                         Settings settings)
+    : body(&body), mount(mount), settings(settings), ignored{&body} {
+    auto horizontal = settings.horizontalRays;
+    auto vertical = settings.verticalRays;
+
+    directions.reserve(horizontal * vertical);
+
+    for (size_t v = 0; v < vertical; ++v) {
+        auto elevation =
+            vertical == 1
+                ? (settings.minElevation + settings.maxElevation) / 2
+                : settings.minElevation +
+                      (settings.maxElevation - settings.minElevation) *
+                          static_cast<double>(v) /
+                          static_cast<double>(vertical - 1);
+
+        for (size_t h = 0; h < horizontal; ++h) {
+            // Centered in each step, so that a full circle does not get
+            // the same direction at both ends
+            auto azimuth = settings.horizontalFov *
+                           ((static_cast<double>(h) + .5) /
+                                static_cast<double>(horizontal) -
+                            .5);
+
+            directions.emplace_back(
+                static_cast<btScalar>(cos(elevation) * sin(azimuth)),
+                static_cast<btScalar>(cos(elevation) * cos(azimuth)),
+                static_cast<btScalar>(sin(elevation)));
+        }
+    }
+}
+
+RangeSensor::RangeSensor(const Vehicle1 &vehicle,
+                         const btTransform &mount,
+                         Settings settings)
+    : RangeSensor(vehicle.frontBody, mount, settings) {
+    owner = &vehicle;
+    ignored.push_back(&vehicle.rearBody);
+    if (vehicle.bucketBody) {
+        ignored.push_back(vehicle.bucketBody.get());
+    }
+    for (auto &wheel : vehicle.wheels) {
+        ignored.push_back(&wheel.body);
+    }
+}
+
+RangeSensors::RangeSensors(btCollisionWorld &world,
+                           ThreadPool *pool,
+                           Settings settings)
+    : broadphase(dynamic_cast<btDbvtBroadphase *>(world.getBroadphase())),
+      pool(pool), settings(settings) {
+    if (!broadphase) {
+        throw runtime_error("range sensors needs a btDbvtBroadphase");
+    }
+
+    if (!settings.raysPerTask) {
+        throw runtime_error("range sensors needs at least one ray per task");
+    }
+
+    stacks.resize((pool ? pool->size() : 0) + 1);
+}
+
+RangeSensors::RangeSensors(btCollisionWorld &world, ThreadPool *pool)
+    : RangeSensors(world, pool, Settings{}) {
+}
+
+size_t RangeSensors::add(RangeSensor sensor) {
+    auto index = sensors.size();
+    auto first = results.size();
+    auto count = sensor.numRays();
+    auto range = static_cast<btScalar>(sensor.settings.range);
+
+    for (size_t begin = 0; begin < count; begin += settings.raysPerTask) {
+        auto end = min(begin + settings.raysPerTask, count);
+        tasks.push_back({index, begin, end});
+    }
+
+    results.resize(first + count, RangeHit{range, nullptr});
+    sensors.push_back({move(sensor), first, {}});
+
+    return index;
+}
+
+void RangeSensors::scan() {
+    SIM_PROFILE("range sensors");
+
+    auto start = chrono::steady_clock::now();
+
+    for (auto &mounted : sensors) {
+        mounted.transform =
+            mounted.sensor.body->getWorldTransform() * mounted.sensor.mount;
+    }
+
+    if (pool) {
+        pool->parallelFor(tasks.size(), [this](size_t i) {
+            // The calling thread has index -1
+            auto thread = pool->currentThreadIndex() + 1;
+            cast(tasks[i], stacks.at(static_cast<size_t>(thread)));
+        });
+    }
+    else {
+        for (auto &task : tasks) {
+            cast(task, stacks.front());
+        }
+    }
+
+    scanTime =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+btVector3 RangeSensors::point(size_t index, size_t ray) const {
+    auto &mounted = sensors[index];
+    auto direction = mounted.transform.getBasis() *
+                     mounted.sensor.directions.at(ray);
+    return mounted.transform.getOrigin() +
+           direction * results[mounted.first + ray].distance;
+}
+
+void RangeSensors::cast(const Task &task,
+                        btAlignedObjectArray<const btDbvtNode *> &stack) {
+    auto &mounted = sensors[task.sensor];
+    auto &sensor = mounted.sensor;
+    auto &basis = mounted.transform.getBasis();
+    auto &origin = mounted.transform.getOrigin();
+    auto range = static_cast<btScalar>(sensor.settings.range);
+    auto out = results.data() + mounted.first;
+
+    const btVector3 zero(0, 0, 0);
+
+    for (size_t i = task.begin; i < task.end; ++i) {
+        auto to = origin + (basis * sensor.directions[i]) * range;
+
+        ClosestHit hit(sensor);
+        LeafTest test(origin, to, hit);
+
+        for (auto &set : broadphase->m_sets) {
+            set.rayTestInternal(set.m_root,
+                                origin,
+                                to,
+                                test.inverseDirection,
+                                test.signs,
+                                range,
+                                zero,
+                                zero,
+                                stack,
+                                test);
+        }
+
+        if (hit.hasHit()) {
+            out[i] = {hit.m_closestHitFraction * range, hit.m_collisionObject};
+        }
+        else {
+            out[i] = {range, nullptr};
+        }
+    }
+}
+
+} // namespace sim
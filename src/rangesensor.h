@@ -0,0 +1,160 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "btBulletCollisionCommon.h"
+
+#include <vector>
+
+namespace sim {
+
+class ThreadPool;
+class Vehicle1;
+
+//! A lidar like sensor fixed to a body, that measures the distance along a
+//! grid of rays spread over the horizontal and vertical field of view
+struct RangeSensor {
+    struct Settings {
+        size_t horizontalRays = 360;
+        size_t verticalRays = 16;
+
+        //! Radians around the forward direction (y) of the mount
+        double horizontalFov = 6.283185307179586;
+
+        //! Radians above and below the horizontal plane of the mount
+        double minElevation = -.26;
+        double maxElevation = .26;
+
+        double range = 100;
+    };
+
+    //! 'mount' is relative to the body
+    RangeSensor(const btCollisionObject &body,
+                const btTransform &mount,
+                Settings settings);
+
+    //! Mounted on the front body, rays never hit the vehicle itself, with
+    //! the full model or with a VehicleProxy
+    RangeSensor(const Vehicle1 &vehicle,
+                const btTransform &mount,
+                Settings settings);
+
+    size_t numRays() const {
+        return directions.size();
+    }
+
+    const btCollisionObject *body;
+    btTransform mount;
+    Settings settings;
+
+    //! Unit vectors relative to the mount, horizontal index changes fastest
+    std::vector<btVector3> directions;
+
+    //! Objects that the rays pass through, usually the body it is mounted
+    //! on and everything attached to it
+    std::vector<const btCollisionObject *> ignored;
+
+    //! Objects with this user pointer are passed through as well, set to
+    //! the vehicle so that its proxy chassis is not hit
+    const void *owner = nullptr;
+};
+
+//! Result of a single ray
+struct RangeHit {
+    //! The range of the sensor if nothing was hit
+    btScalar distance;
+
+    //! Null if nothing was hit
+    const btCollisionObject *object;
+};
+
+//! Casts the rays of all sensors in a world at once
+//!
+//! The rays are split in tasks that runs in parallel on the thread pool.
+//! The broadphase trees are traversed directly with one stack per thread,
+//! since btCollisionWorld::rayTest shares a single stack between all
+//! callers unless bullet is built with BT_THREADSAFE. Objects whose box is
+//! further away than the closest hit so far are skipped without testing
+//! the shape. The results are written to a buffer that is allocated when
+//! the sensors are added, so scanning does not allocate
+//!
+//! The world must not be stepped while scanning
+class RangeSensors {
+public:
+    struct Settings {
+        //! Rays that are cast in the same task
+        size_t raysPerTask = 256;
+    };
+
+    //! Without a pool everything runs on the calling thread
+    //! The world needs to use btDbvtBroadphase
+    RangeSensors(btCollisionWorld &world, ThreadPool *pool = nullptr);
+    RangeSensors(btCollisionWorld &world, ThreadPool *pool, Settings settings);
+
+    //! Returns the index of the sensor
+    size_t add(RangeSensor sensor);
+
+    //! Cast all rays from the current position of the bodies
+    void scan();
+
+    size_t size() const {
+        return sensors.size();
+    }
+
+    const RangeSensor &sensor(size_t index) const {
+        return sensors[index].sensor;
+    }
+
+    //! Results from the last scan, one per direction of the sensor
+    const RangeHit *hits(size_t index) const {
+        return results.data() + sensors[index].first;
+    }
+
+    //! World position of a hit from the last scan
+    btVector3 point(size_t index, size_t ray) const;
+
+    //! Total number of rays cast every scan
+    size_t numRays() const {
+        return results.size();
+    }
+
+    //! Time spent in the last scan
+    double lastScanTime() const {
+        return scanTime;
+    }
+
+private:
+    struct Mounted {
+        RangeSensor sensor;
+
+        //! Index of the first result
+        size_t first;
+
+        //! World transform of the mount, updated at the start of a scan
+        btTransform transform;
+    };
+
+    struct Task {
+        size_t sensor;
+        size_t begin;
+        size_t end;
+    };
+
+    void cast(const Task &task,
+              btAlignedObjectArray<const btDbvtNode *> &stack);
+
+    btDbvtBroadphase *broadphase;
+    ThreadPool *pool;
+    Settings settings;
+
+    std::vector<Mounted> sensors;
+    std::vector<Task> tasks;
+    std::vector<RangeHit> results;
+
+    //! One per worker in the pool and one for the calling thread
+    std::vector<btAlignedObjectArray<const btDbvtNode *>> stacks;
+
+    double scanTime = 0;
+};
+
+} // namespace sim
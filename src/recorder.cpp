@@ -0,0 +1,192 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "recorder.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const char magic[8] = {'v', 's', 'r', 'e', 'c', '1', 0, 0};
+
+enum RecordType : uint8_t {
+    InputRecord = 1,
+    KeyframeRecord = 2,
+    EndRecord = 3,
+};
+
+template <typename T>
+void writeValue(ostream &stream, const T &value) {
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T readValue(istream &stream) {
+    T value;
+    if (!stream.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+        throw runtime_error("replay: unexpected end of stream");
+    }
+    return value;
+}
+
+void writeVarint(ostream &stream, uint64_t value) {
+    while (value >= 0x80) {
+        stream.put(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    stream.put(static_cast<char>(value));
+}
+
+uint64_t readVarint(istream &stream) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        auto byte = readValue<uint8_t>(stream);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw runtime_error("replay: malformed varint");
+}
+
+} // namespace
+
+namespace sim {
+
+Recorder::Recorder(std::ostream &stream, double dt, size_t keyframeInterval)
+    : stream(stream)
+    , keyframeInterval(max<size_t>(keyframeInterval, 1)) {
+    stream.write(magic, sizeof(magic));
+    writeValue(stream, static_cast<uint32_t>(sizeof(btScalar)));
+    writeValue(stream, dt);
+    writeValue(stream, static_cast<uint32_t>(this->keyframeInterval));
+}
+
+Recorder::~Recorder() {
+    writeValue(stream, EndRecord);
+    writeVarint(stream, numSteps);
+    stream.flush();
+}
+
+void Recorder::step(btDynamicsWorld &world, size_t step, ControlInput input) {
+    if (isKeyframe(step, keyframeInterval)) {
+        resetWorldCaches(world);
+        state.capture(world);
+
+        writeValue(stream, KeyframeRecord);
+        writeVarint(stream, step);
+        state.write(stream);
+    }
+
+    if (!hasInput || input != lastInput) {
+        writeValue(stream, InputRecord);
+        writeVarint(stream, step - lastInputStep);
+        writeValue(stream, input.throttle);
+        writeValue(stream, input.steering);
+
+        lastInput = input;
+        lastInputStep = step;
+        hasInput = true;
+    }
+
+    numSteps = step + 1;
+}
+
+Replay::Replay(std::istream &stream) {
+    char header[sizeof(magic)];
+    if (!stream.read(header, sizeof(header)) ||
+        memcmp(header, magic, sizeof(magic)) != 0) {
+        throw runtime_error("replay: not a recording");
+    }
+
+    if (readValue<uint32_t>(stream) != sizeof(btScalar)) {
+        throw runtime_error(
+            "replay: recorded with a different precision of btScalar");
+    }
+
+    timeStep = readValue<double>(stream);
+    interval = readValue<uint32_t>(stream);
+
+    if (!(timeStep > 0) || !isfinite(timeStep)) {
+        throw runtime_error("replay: time step must be positive");
+    }
+
+    if (interval == 0) {
+        throw runtime_error("replay: keyframe interval must not be 0");
+    }
+
+    size_t inputStep = 0;
+
+    while (true) {
+        auto type = readValue<uint8_t>(stream);
+
+        if (type == InputRecord) {
+            inputStep += readVarint(stream);
+            ControlInput input;
+            input.throttle = readValue<double>(stream);
+            input.steering = readValue<double>(stream);
+            inputs[inputStep] = input;
+        }
+        else if (type == KeyframeRecord) {
+            auto step = readVarint(stream);
+            keyframes[step].read(stream);
+        }
+        else if (type == EndRecord) {
+            steps = readVarint(stream);
+            break;
+        }
+        else {
+            throw runtime_error("replay: unknown record type");
+        }
+    }
+
+    if (keyframes.empty() || keyframes.begin()->first != 0) {
+        throw runtime_error("replay: recording has no initial keyframe");
+    }
+}
+
+size_t Replay::seek(btDynamicsWorld &world, size_t step) const {
+    auto it = keyframes.upper_bound(step);
+    --it; // There is always a keyframe at step 0
+
+    it->second.restore(world);
+    resetWorldCaches(world);
+
+    return it->first;
+}
+
+ControlInput Replay::step(btDynamicsWorld &world,
+                          size_t step,
+                          bool verify) const {
+    if (Recorder::isKeyframe(step, interval)) {
+        resetWorldCaches(world);
+
+        if (verify) {
+            auto it = keyframes.find(step);
+            if (it != keyframes.end()) {
+                WorldState state;
+                state.capture(world);
+                if (state != it->second) {
+                    throw runtime_error("replay: state differs at step " +
+                                        to_string(step));
+                }
+            }
+        }
+    }
+
+    return input(step);
+}
+
+ControlInput Replay::input(size_t step) const {
+    auto it = inputs.upper_bound(step);
+    if (it == inputs.begin()) {
+        return {};
+    }
+
+    return (--it)->second;
+}
+
+} // namespace sim
@@ -0,0 +1,113 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "worldstate.h"
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <vector>
+
+namespace sim {
+
+//! Control input as given to Vehicle1::throttle and Vehicle1::steering
+struct ControlInput {
+    double throttle = 0;
+    double steering = 0;
+
+    bool operator==(const ControlInput &other) const {
+        return throttle == other.throttle && steering == other.steering;
+    }
+
+    bool operator!=(const ControlInput &other) const {
+        return !(*this == other);
+    }
+};
+
+//! Records the control input for every fixed step together with keyframes
+//! of the full world state, so that a session can be replayed exactly
+//!
+//! Stream format, all values in native byte order:
+//!   header:   "vsrec1\0\0", uint32 sizeof(btScalar), float64 dt,
+//!             uint32 keyframe interval
+//!   records:  uint8 type followed by
+//!     input:    varint steps since the previous input, float64 throttle,
+//!               float64 steering. Only written when the input changes
+//!     keyframe: varint step, WorldState
+//!     end:      varint number of steps
+class Recorder {
+public:
+    Recorder(std::ostream &stream, double dt, size_t keyframeInterval = 600);
+
+    //! Writes the end marker
+    ~Recorder();
+
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    //! Call before every step, before the input is applied to the vehicles
+    //! Writes keyframes when it is time for it
+    void step(btDynamicsWorld &world, size_t step, ControlInput input);
+
+    static bool isKeyframe(size_t step, size_t keyframeInterval) {
+        return step % keyframeInterval == 0;
+    }
+
+private:
+    std::ostream &stream;
+    size_t keyframeInterval;
+    size_t lastInputStep = 0;
+    size_t numSteps = 0;
+    ControlInput lastInput;
+    bool hasInput = false;
+    WorldState state;
+};
+
+//! Plays back a stream written by Recorder
+class Replay {
+public:
+    //! Reads the whole stream, throws std::runtime_error on errors
+    Replay(std::istream &stream);
+
+    //! Restore the world to the last keyframe at or before step
+    //! Returns the step that the world is now at
+    size_t seek(btDynamicsWorld &world, size_t step) const;
+
+    //! Call before every step instead of Recorder::step. Returns the input
+    //! to apply for the step. If verify is true, the world state is compared
+    //! to the recorded keyframes, and std::runtime_error is thrown if it
+    //! differs
+    ControlInput step(btDynamicsWorld &world,
+                      size_t step,
+                      bool verify = false) const;
+
+    ControlInput input(size_t step) const;
+
+    double dt() const {
+        return timeStep;
+    }
+
+    size_t numSteps() const {
+        return steps;
+    }
+
+    size_t keyframeInterval() const {
+        return interval;
+    }
+
+    size_t numKeyframes() const {
+        return keyframes.size();
+    }
+
+private:
+    double timeStep = 0;
+    size_t interval = 0;
+    size_t steps = 0;
+
+    //! Step to input that starts at that step
+    std::map<size_t, ControlInput> inputs;
+    std::map<size_t, WorldState> keyframes;
+};
+
+} // namespace sim
@@ -0,0 +1,172 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "renderbatch.h"
+#include "instancebuffer.h"
+#include "profiler.h"
+#include "renderstate.h"
+#include "shaders.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+float length(float x, float y, float z) {
+    return sqrt(x * x + y * y + z * z);
+}
+
+//! Radius of a transformed unit cylinder in normalized device coordinates,
+//! used to pick how many segments it needs
+float screenRadius(MeshCache::Primitive primitive,
+                   const Matrixf &model,
+                   const Matrixf &viewProjection) {
+    // The columns of the model that are across the center of the cylinder
+    auto x = length(model.x1, model.y1, model.z1);
+    auto y = length(model.x2, model.y2, model.z2);
+    auto z = length(model.x3, model.y3, model.z3);
+
+    float radius = 0;
+    switch (primitive) {
+    case MeshCache::CylinderX:
+        radius = max(y, z);
+        break;
+    case MeshCache::CylinderY:
+        radius = max(x, z);
+        break;
+    default:
+        radius = max(x, y);
+        break;
+    }
+
+    auto &m = viewProjection;
+    auto w = m.w1 * model.x4 + m.w2 * model.y4 + m.w3 * model.z4 + m.w4;
+    auto scale = length(m.y1, m.y2, m.y3);
+
+    return radius * scale / max(w, 1e-3f);
+}
+
+} // namespace
+
+RenderBatch::RenderBatch() = default;
+RenderBatch::~RenderBatch() = default;
+
+void RenderBatch::box(const Matrixf &model) {
+    models[MeshCache::Box].push_back(model);
+}
+
+void RenderBatch::cylinder(const Matrixf &model) {
+    models[MeshCache::Cylinder].push_back(model);
+}
+
+void RenderBatch::cylinderX(const Matrixf &model) {
+    models[MeshCache::CylinderX].push_back(model);
+}
+
+void RenderBatch::cylinderY(const Matrixf &model) {
+    models[MeshCache::CylinderY].push_back(model);
+}
+
+void RenderBatch::flush(const Matrixf &view, const Matrixf &projection) {
+    if (!size()) {
+        return;
+    }
+
+    SIM_PROFILE("draw batch");
+
+    struct Draw {
+        const GpuMesh *mesh;
+        size_t first;
+        size_t count;
+    };
+
+    // At most one draw per primitive and level
+    array<Draw, numPrimitives * MeshCache::numLevels> draws;
+    size_t numDraws = 0;
+
+    auto &cache = MeshCache::instance();
+
+    packed.clear();
+
+    auto add = [&](const GpuMesh &mesh, const vector<Matrixf> &list) {
+        if (list.empty()) {
+            return;
+        }
+        draws[numDraws++] = {&mesh, packed.size(), list.size()};
+        packed.insert(packed.end(), list.begin(), list.end());
+    };
+
+    {
+        SIM_PROFILE("sort cylinders");
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        auto halfHeight = static_cast<float>(viewport[3]) / 2.f;
+
+        auto viewProjection = projection * view;
+
+        add(cache.get(MeshCache::Box), models[MeshCache::Box]);
+
+        for (int i = MeshCache::Cylinder; i < numPrimitives; ++i) {
+            auto primitive = static_cast<MeshCache::Primitive>(i);
+            auto &primitiveLevels = levels[i];
+
+            for (auto &model : models[i]) {
+                auto pixels =
+                    screenRadius(primitive, model, viewProjection) * halfHeight;
+                primitiveLevels[MeshCache::level(primitive, pixels)].push_back(
+                    model);
+            }
+
+            for (int level = 0; level < MeshCache::numLevels; ++level) {
+                add(cache.get(primitive, level), primitiveLevels[level]);
+                primitiveLevels[level].clear();
+            }
+        }
+    }
+
+    if (!instances) {
+        instances = make_unique<InstanceBuffer>();
+    }
+
+    {
+        SIM_PROFILE("upload instances");
+        instances->upload(packed);
+    }
+
+    SIM_PROFILE("draw instances");
+
+    auto &state = RenderState::instance();
+    state.camera(view, projection);
+    state.use(instancedShader());
+
+    for (size_t i = 0; i < numDraws; ++i) {
+        auto &draw = draws[i];
+        draw.mesh->bind();
+        instances->attach(draw.first);
+        draw.mesh->drawInstanced(static_cast<int>(draw.count));
+    }
+
+    clear();
+}
+
+void RenderBatch::clear() {
+    // clear() keeps the capacity so there is no allocations after the first
+    // few frames
+    for (auto &list : models) {
+        list.clear();
+    }
+}
+
+size_t RenderBatch::size() const {
+    size_t sum = 0;
+    for (auto &list : models) {
+        sum += list.size();
+    }
+    return sum;
+}
+
+} // namespace sim
@@ -0,0 +1,64 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "matrix.h"
+#include "meshcache.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace sim {
+
+class InstanceBuffer;
+
+//! Collects model matrices during a frame and draws every primitive type
+//! with instanced draw calls when flushed
+//!
+//! All matrices of a flush is uploaded with one write to a single streaming
+//! buffer, and the draws are ordered so that the shader is bound once and
+//! every mesh once
+class RenderBatch {
+public:
+    RenderBatch();
+    ~RenderBatch();
+
+    RenderBatch(const RenderBatch &) = delete;
+    RenderBatch &operator=(const RenderBatch &) = delete;
+
+    void box(const Matrixf &model);
+    void cylinder(const Matrixf &model);
+
+    //! Cylinder with the center along the x axis
+    void cylinderX(const Matrixf &model);
+
+    //! Cylinder with the center along the y axis
+    void cylinderY(const Matrixf &model);
+
+    //! Draw everything that is collected and clear the batch
+    void flush(const Matrixf &view, const Matrixf &projection);
+
+    //! Drop everything without drawing
+    void clear();
+
+    size_t size() const;
+
+private:
+    static constexpr int numPrimitives = MeshCache::CylinderY + 1;
+
+    //! Model matrices for each primitive in the order they were added
+    std::array<std::vector<Matrixf>, numPrimitives> models;
+
+    //! Cylinders sorted by level of tessellation during flush
+    std::array<std::array<std::vector<Matrixf>, MeshCache::numLevels>,
+               numPrimitives>
+        levels;
+
+    //! Everything that is uploaded, kept to avoid allocations
+    std::vector<Matrixf> packed;
+
+    std::unique_ptr<InstanceBuffer> instances;
+};
+
+} // namespace sim
@@ -0,0 +1,92 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "renderstate.h"
+
+#include <cstring>
+
+namespace sim {
+
+static_assert(sizeof(Matrixf) == sizeof(float) * 16,
+              "matrices are copied directly into the camera block");
+
+RenderState &RenderState::instance() {
+    static RenderState state;
+    return state;
+}
+
+RenderState::~RenderState() {
+    if (cameraBuffer) {
+        glDeleteBuffers(1, &cameraBuffer);
+    }
+}
+
+void RenderState::reset() {
+    currentProgram = nullptr;
+    vertexArrayKnown = false;
+}
+
+void RenderState::use(ShaderProgram *program) {
+    if (program == currentProgram) {
+        return;
+    }
+
+    program->use();
+    currentProgram = program;
+    ++programChanges;
+}
+
+void RenderState::bindVertexArray(GLuint vao) {
+    if (vertexArrayKnown && vao == currentVertexArray) {
+        return;
+    }
+
+    glCall(glBindVertexArray(vao));
+    currentVertexArray = vao;
+    vertexArrayKnown = true;
+    ++vertexArrayChanges;
+}
+
+void RenderState::camera(const Matrixf &view, const Matrixf &projection) {
+    if (!cameraBuffer) {
+        glCall(glGenBuffers(1, &cameraBuffer));
+        glCall(glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer));
+        glCall(glBufferData(GL_UNIFORM_BUFFER,
+                            sizeof(Matrixf) * 2,
+                            nullptr,
+                            GL_DYNAMIC_DRAW));
+        glCall(
+            glBindBufferBase(GL_UNIFORM_BUFFER, cameraBinding, cameraBuffer));
+    }
+    else if (hasCamera &&
+             !memcmp(&view, &cameraView, sizeof(Matrixf)) &&
+             !memcmp(&projection, &cameraProjection, sizeof(Matrixf))) {
+        return;
+    }
+
+    cameraView = view;
+    cameraProjection = projection;
+    hasCamera = true;
+
+    glCall(glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer));
+    glCall(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Matrixf), &view));
+    glCall(glBufferSubData(
+        GL_UNIFORM_BUFFER, sizeof(Matrixf), sizeof(Matrixf), &projection));
+}
+
+void RenderState::bindCameraBlock(ShaderProgram *program) {
+    // The gui library does not expose the name of the program, so it is
+    // read back after binding it
+    program->use();
+    GLint current = 0;
+    glCall(glGetIntegerv(GL_CURRENT_PROGRAM, &current));
+
+    auto id = static_cast<GLuint>(current);
+    auto index = glGetUniformBlockIndex(id, "Camera");
+    if (index != GL_INVALID_INDEX) {
+        glCall(glUniformBlockBinding(id, index, cameraBinding));
+    }
+
+    instance().currentProgram = nullptr;
+}
+
+} // namespace sim
@@ -0,0 +1,66 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "matgui/matgl.h"
+#include "matgui/shaderprogram.h"
+#include "matrix.h"
+
+namespace sim {
+
+//! The gl state that changes between draws, and the camera that is shared
+//! by all shaders
+//!
+//! Programs and vertex arrays are only bound when they differ from the
+//! ones bound before, so draws that use the same shader and mesh does not
+//! issue any state at all. Anything that binds things without going through
+//! this, like the gui library, makes the cache wrong, so reset() is called
+//! at the start of every frame
+class RenderState {
+public:
+    //! Binding point of the uniform block
+    //!
+    //!     layout (std140) uniform Camera {
+    //!         mat4 uView;
+    //!         mat4 uProjection;
+    //!     };
+    static constexpr GLuint cameraBinding = 0;
+
+    static RenderState &instance();
+
+    ~RenderState();
+
+    RenderState(const RenderState &) = delete;
+    RenderState &operator=(const RenderState &) = delete;
+
+    //! Forget what is bound
+    void reset();
+
+    void use(ShaderProgram *program);
+    void bindVertexArray(GLuint vao);
+
+    //! Uploaded once per frame, and only if it changed
+    void camera(const Matrixf &view, const Matrixf &projection);
+
+    //! Connect the Camera block of a program to cameraBinding
+    static void bindCameraBlock(ShaderProgram *program);
+
+    //! State changes that was actually made since the counters were
+    //! cleared, for statistics
+    size_t programChanges = 0;
+    size_t vertexArrayChanges = 0;
+
+private:
+    RenderState() = default;
+
+    ShaderProgram *currentProgram = nullptr;
+    GLuint currentVertexArray = 0;
+    bool vertexArrayKnown = false;
+
+    GLuint cameraBuffer = 0;
+    Matrixf cameraView;
+    Matrixf cameraProjection;
+    bool hasCamera = false;
+};
+
+} // namespace sim
@@ -0,0 +1,179 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "scenariorunner.h"
+#include "threadpool.h"
+#include "world.h"
+
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace sim {
+
+ScenarioResult runScenario(const Scenario &scenario) {
+    ScenarioResult result;
+    result.name = scenario.name;
+
+    if (!(scenario.dt > 0) || !(scenario.time >= 0)) {
+        throw runtime_error("scenario " + scenario.name +
+                            ": dt must be positive and time not negative");
+    }
+
+    World world;
+
+    btTransform vehicleTransform;
+    vehicleTransform.setIdentity();
+    vehicleTransform.setOrigin({0, 0, -3});
+    Vehicle1 vehicle(
+        world.dynamicsWorld.get(), vehicleTransform, scenario.settings);
+
+    const auto steps = static_cast<size_t>(scenario.time / scenario.dt + .5);
+    const auto dt = static_cast<btScalar>(scenario.dt);
+
+    auto lastPosition = vehicle.frontBody.getWorldTransform().getOrigin();
+
+    auto start = chrono::steady_clock::now();
+
+    for (size_t step = 0; step < steps; ++step) {
+        auto control = scenario.script.at(static_cast<double>(step) *
+                                          scenario.dt);
+
+        vehicle.steering(control.steering);
+        vehicle.throttle(control.throttle);
+
+        world.dynamicsWorld->stepSimulation(dt, 1, dt);
+
+        auto &position = vehicle.frontBody.getWorldTransform().getOrigin();
+        result.distance += static_cast<double>(position.distance(lastPosition));
+        lastPosition = position;
+
+        result.maxSpeed =
+            max(result.maxSpeed,
+                static_cast<double>(
+                    vehicle.frontBody.getLinearVelocity().length()));
+    }
+
+    result.wallTime =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.steps = steps;
+    result.simTime = static_cast<double>(steps) * scenario.dt;
+    result.finalX = static_cast<double>(lastPosition.x());
+    result.finalY = static_cast<double>(lastPosition.y());
+    result.finalZ = static_cast<double>(lastPosition.z());
+
+    return result;
+}
+
+ScenarioRunReport runScenarios(const std::vector<Scenario> &scenarios,
+                               ThreadPool &pool) {
+    ScenarioRunReport report;
+    report.results.resize(scenarios.size());
+
+    auto start = chrono::steady_clock::now();
+
+    pool.parallelFor(scenarios.size(), [&](size_t i) {
+        report.results[i] = runScenario(scenarios[i]);
+    });
+
+    report.wallTime =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    for (auto &result : report.results) {
+        report.totalSteps += result.steps;
+    }
+
+    return report;
+}
+
+std::vector<Scenario> loadScenarios(std::istream &stream,
+                                    const Scenario &defaults) {
+    vector<Scenario> scenarios;
+
+    string line;
+    for (size_t lineNumber = 1; getline(stream, line); ++lineNumber) {
+        istringstream ss(line);
+        string name;
+        if (!(ss >> name) || name.front() == '#') {
+            continue;
+        }
+
+        auto scenario = defaults;
+        scenario.name = name;
+
+        auto fail = [&](const string &message) {
+            throw runtime_error("scenarios line " + to_string(lineNumber) +
+                                ": " + message);
+        };
+
+        for (string word; ss >> word;) {
+            auto split = word.find('=');
+            if (split == string::npos) {
+                fail("expected key=value, got " + word);
+            }
+
+            auto key = word.substr(0, split);
+            auto value = word.substr(split + 1);
+
+            if (key == "script") {
+                scenario.script = ControlScript::load(value);
+                continue;
+            }
+
+            double number;
+            try {
+                number = stod(value);
+            }
+            catch (std::exception &) {
+                fail("not a number: " + word);
+            }
+
+            if (key == "time") {
+                if (!(number >= 0)) {
+                    fail("time must not be negative: " + word);
+                }
+                scenario.time = number;
+            }
+            else if (key == "dt") {
+                if (!(number > 0)) {
+                    fail("dt must be positive: " + word);
+                }
+                scenario.dt = number;
+            }
+            else if (!scenario.settings.set(key, number)) {
+                fail("unknown setting " + key);
+            }
+        }
+
+        scenarios.push_back(move(scenario));
+    }
+
+    return scenarios;
+}
+
+std::vector<Scenario> createSweep(const std::string &setting,
+                                  double from,
+                                  double to,
+                                  size_t count,
+                                  const Scenario &defaults) {
+    vector<Scenario> scenarios;
+
+    for (size_t i = 0; i < count; ++i) {
+        auto value = (count > 1) ? from + (to - from) *
+                                              static_cast<double>(i) /
+                                              static_cast<double>(count - 1)
+                                 : from;
+
+        auto scenario = defaults;
+        if (!scenario.settings.set(setting, value)) {
+            throw runtime_error("unknown setting " + setting);
+        }
+        scenario.name = setting + "=" + to_string(value);
+        scenarios.push_back(move(scenario));
+    }
+
+    return scenarios;
+}
+
+} // namespace sim
@@ -0,0 +1,68 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "controlscript.h"
+#include "vehicle1.h"
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+class ThreadPool;
+
+//! One independent simulation, typically one point in a parameter sweep
+struct Scenario {
+    std::string name;
+    Vehicle1::Vehicle1Settings settings;
+    ControlScript script;
+    double time = 10;
+    double dt = 1. / 60.;
+};
+
+struct ScenarioResult {
+    std::string name;
+    size_t steps = 0;
+    double simTime = 0;
+    double wallTime = 0;
+
+    double finalX = 0, finalY = 0, finalZ = 0;
+    double distance = 0;
+    double maxSpeed = 0;
+};
+
+struct ScenarioRunReport {
+    std::vector<ScenarioResult> results;
+    size_t totalSteps = 0;
+    double wallTime = 0;
+
+    double stepsPerSecond() const {
+        return wallTime > 0 ? static_cast<double>(totalSteps) / wallTime : 0;
+    }
+};
+
+//! Builds a world of its own and runs the scenario to the end on the
+//! calling thread. Never touches any graphics
+ScenarioResult runScenario(const Scenario &scenario);
+
+//! Run every scenario as a separate task on the pool, one world per task
+//! Results are in the same order as the scenarios
+ScenarioRunReport runScenarios(const std::vector<Scenario> &scenarios,
+                               ThreadPool &pool);
+
+//! Parse scenarios, one per line: "name key=value key=value..."
+//! Keys are Vehicle1Settings member names or one of "time", "dt" and
+//! "script" (a control script file). Throws std::runtime_error on errors
+std::vector<Scenario> loadScenarios(std::istream &stream,
+                                    const Scenario &defaults = {});
+
+//! Create count scenarios where setting goes linearly from 'from' to 'to'
+std::vector<Scenario> createSweep(const std::string &setting,
+                                  double from,
+                                  double to,
+                                  size_t count,
+                                  const Scenario &defaults = {});
+
+} // namespace sim
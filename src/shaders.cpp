@@ -1,12 +1,14 @@
 // Copyright © Mattias Larsson Sköld 2020
 
 #include "shaders.h"
+#include "renderstate.h"
 
 #include <memory>
 
 namespace {
 
 std::unique_ptr<ShaderProgram> plainShader;
+std::unique_ptr<ShaderProgram> instancedShader;
 
 const std::string plainVertexCode =
     R"_(
@@ -17,12 +19,41 @@ const std::string plainVertexCode =
 
         out vec3 fNormal;
 
-        uniform mat4 uMVP;
-        uniform mat4 uMV;
+        layout (std140) uniform Camera {
+            mat4 uView;
+            mat4 uProjection;
+        };
+
+        uniform mat4 uModel;
+
+        void main() {
+            mat4 mv = uView * uModel;
+            gl_Position = uProjection * mv * vPosition;
+            fNormal = normalize(mat3(mv) * vNormal);
+        }
+)_";
+
+// Same as the plain shader but with the model matrix as a per instance
+// attribute, see InstanceBuffer
+const std::string instancedVertexCode =
+    R"_(
+        #version 330
+
+        layout (location = 0) in vec4 vPosition;
+        layout (location = 1) in vec3 vNormal;
+        layout (location = 2) in mat4 iModel;
+
+        out vec3 fNormal;
+
+        layout (std140) uniform Camera {
+            mat4 uView;
+            mat4 uProjection;
+        };
 
         void main() {
-            gl_Position = uMVP * vPosition;
-            fNormal = normalize(mat3(uMV) * vNormal);
+            mat4 mv = uView * iModel;
+            gl_Position = uProjection * mv * vPosition;
+            fNormal = normalize(mat3(mv) * vNormal);
         }
 )_";
 
@@ -49,9 +80,20 @@ ShaderProgram *plainShader() {
     if (!::plainShader) {
         ::plainShader =
             std::make_unique<ShaderProgram>(plainVertexCode, plainFragmentCode);
+        RenderState::bindCameraBlock(::plainShader.get());
     }
 
     return ::plainShader.get();
 }
 
+ShaderProgram *instancedShader() {
+    if (!::instancedShader) {
+        ::instancedShader = std::make_unique<ShaderProgram>(instancedVertexCode,
+                                                            plainFragmentCode);
+        RenderState::bindCameraBlock(::instancedShader.get());
+    }
+
+    return ::instancedShader.get();
+}
+
 } // namespace sim
@@ -6,7 +6,13 @@
 
 namespace sim {
 
+//! Shader with the model matrix in the uniform uModel, view and projection
+//! is read from the camera block, see RenderState
 //! Returns non owning pointer
 ShaderProgram *plainShader();
 
+//! Plain shader that takes the model matrix per instance
+//! Returns non owning pointer
+ShaderProgram *instancedShader();
+
 } // namespace sim
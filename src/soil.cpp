@@ -0,0 +1,617 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "soil.h"
+#include "profiler.h"
+#include "threadpool.h"
+
+#include "LinearMath/btAabbUtil2.h"
+#include "LinearMath/btTransformUtil.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+struct Range {
+    uint32_t begin;
+    uint32_t end;
+};
+
+//! Sort the ranges and join the ones that overlap or touch, so that no
+//! particle is visited twice. Returns how many are left
+size_t merge(Range *ranges, size_t count) {
+    sort(ranges, ranges + count, [](const Range &a, const Range &b) {
+        return a.begin < b.begin;
+    });
+
+    size_t merged = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (ranges[i].begin == ranges[i].end) {
+            continue;
+        }
+        if (merged && ranges[i].begin <= ranges[merged - 1].end) {
+            ranges[merged - 1].end = max(ranges[merged - 1].end, ranges[i].end);
+        }
+        else {
+            ranges[merged++] = ranges[i];
+        }
+    }
+
+    return merged;
+}
+
+size_t nextPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) {
+        power *= 2;
+    }
+    return power;
+}
+
+//! Spring, damper and friction of a contact between a particle and a body
+//! or the ground, 'velocity' is the particle relative to the other side
+//! and 'normal' points towards the particle
+struct Contact {
+    btScalar stiffness;
+    btScalar damping;
+    btScalar friction;
+
+    btVector3 operator()(const btVector3 &normal,
+                         btScalar depth,
+                         const btVector3 &velocity) const {
+        auto normalVelocity = velocity.dot(normal);
+        auto normalForce = stiffness * depth - damping * normalVelocity;
+        if (normalForce <= 0) {
+            return btVector3(0, 0, 0);
+        }
+
+        auto tangent = velocity - normal * normalVelocity;
+        auto tangentSpeed = tangent.length() + btScalar(1e-6);
+        auto tangentDamping =
+            min(damping, friction * normalForce / tangentSpeed);
+
+        return normal * normalForce - tangent * tangentDamping;
+    }
+};
+
+//! How deep a sphere is inside a box or a cylinder along x, and the
+//! direction that pushes it out, in world space
+bool penetration(bool cylinder,
+                 const btVector3 &halfExtents,
+                 const btTransform &transform,
+                 const btVector3 &center,
+                 btScalar radius,
+                 btVector3 &normal,
+                 btScalar &depth) {
+    auto local = transform.invXform(center);
+
+    btVector3 closest;
+    btVector3 inwardNormal(0, 0, 0);
+    btScalar inwardDepth = 0;
+    bool inside = false;
+
+    if (cylinder) {
+        auto halfWidth = halfExtents.x();
+        auto r = halfExtents.y();
+        auto rho = btSqrt(local.y() * local.y() + local.z() * local.z());
+        auto radial = rho > 1e-9 ? btVector3(0, local.y(), local.z()) / rho
+                                 : btVector3(0, 0, 1);
+
+        closest = radial * min(rho, r);
+        closest.setX(btClamped(local.x(), -halfWidth, halfWidth));
+
+        auto endGap = halfWidth - btFabs(local.x());
+        auto mantleGap = r - rho;
+        inside = endGap >= 0 && mantleGap >= 0;
+        if (inside) {
+            if (endGap < mantleGap) {
+                inwardNormal.setX(local.x() < 0 ? -1 : 1);
+                inwardDepth = endGap;
+            }
+            else {
+                inwardNormal = radial;
+                inwardDepth = mantleGap;
+            }
+        }
+    }
+    else {
+        closest = local;
+        closest.setMax(-halfExtents);
+        closest.setMin(halfExtents);
+
+        auto gap = halfExtents - local.absolute();
+        inside = gap.x() >= 0 && gap.y() >= 0 && gap.z() >= 0;
+        if (inside) {
+            auto axis = gap.minAxis();
+            inwardNormal[axis] = local[axis] < 0 ? -1 : 1;
+            inwardDepth = gap[axis];
+        }
+    }
+
+    if (inside) {
+        // Out through the closest side
+        normal = transform.getBasis() * inwardNormal;
+        depth = inwardDepth + radius;
+        return true;
+    }
+
+    auto difference = local - closest;
+    auto distance2 = difference.length2();
+    if (distance2 >= radius * radius) {
+        return false;
+    }
+
+    auto distance = btSqrt(distance2);
+    normal = transform.getBasis() * (difference / distance);
+    depth = radius - distance;
+    return true;
+}
+
+} // namespace
+
+Soil::Soil(ThreadPool *pool)
+    : Soil(Settings{}, pool) {
+}
+
+Soil::Soil(Settings settings, ThreadPool *pool)
+    : settings(settings)
+    , pool(pool) {
+}
+
+void Soil::add(const btVector3 &position) {
+    x.push_back(static_cast<float>(position.x()));
+    y.push_back(static_cast<float>(position.y()));
+    z.push_back(static_cast<float>(position.z()));
+
+    for (auto array : {&vx, &vy, &vz, &fx, &fy, &fz}) {
+        array->push_back(0);
+    }
+
+    cells.push_back(0);
+}
+
+size_t Soil::fill(const btVector3 &min, const btVector3 &max) {
+    auto radius = static_cast<btScalar>(settings.particleRadius);
+    auto spacing = radius * 2;
+
+    // Seeded with the number of particles so that a scene is built the same
+    // way every time
+    mt19937 random(static_cast<uint32_t>(size()));
+    uniform_real_distribution<btScalar> noise(-radius * .05, radius * .05);
+
+    size_t added = 0;
+    for (auto pz = min.z() + radius; pz <= max.z() - radius; pz += spacing) {
+        for (auto py = min.y() + radius; py <= max.y() - radius;
+             py += spacing) {
+            for (auto px = min.x() + radius; px <= max.x() - radius;
+                 px += spacing) {
+                add(btVector3(px + noise(random), py + noise(random), pz));
+                ++added;
+            }
+        }
+    }
+
+    return added;
+}
+
+size_t Soil::fillPile(const btVector3 &front,
+                      size_t particles,
+                      size_t layers) {
+    auto spacing = settings.particleRadius * 2;
+    auto depth = static_cast<double>(max<size_t>(layers, 1));
+    auto side = static_cast<btScalar>(
+        sqrt(static_cast<double>(particles) / depth) * spacing);
+    auto ground = static_cast<btScalar>(settings.groundHeight);
+
+    // A quarter of a particle extra so that rounding does not drop the top
+    // layer
+    auto height = static_cast<btScalar>(depth * spacing + spacing / 4);
+
+    return fill(
+        btVector3(front.x() - side / 2, front.y(), ground),
+        btVector3(front.x() + side / 2, front.y() + side, ground + height));
+}
+
+void Soil::addBody(btRigidBody &body) {
+    bodies.push_back({&body,
+                      btVector3(0, 0, 0),
+                      btVector3(0, 0, 0),
+                      body.getCenterOfMassTransform(),
+                      btVector3(0, 0, 0),
+                      btVector3(0, 0, 0)});
+
+    btTransform identity;
+    identity.setIdentity();
+    addParts(bodies.size() - 1, *body.getCollisionShape(), identity);
+}
+
+void Soil::removeBody(const btRigidBody &body) {
+    auto found = find_if(bodies.begin(), bodies.end(), [&](const Body &b) {
+        return b.body == &body;
+    });
+    if (found == bodies.end()) {
+        return;
+    }
+
+    auto index = static_cast<size_t>(found - bodies.begin());
+    bodies.erase(found);
+
+    parts.erase(remove_if(parts.begin(),
+                          parts.end(),
+                          [index](const Part &part) {
+                              return part.body == index;
+                          }),
+                parts.end());
+
+    for (auto &part : parts) {
+        if (part.body > index) {
+            --part.body;
+        }
+    }
+}
+
+void Soil::addParts(size_t body,
+                    const btCollisionShape &shape,
+                    const btTransform &local) {
+    switch (shape.getShapeType()) {
+    case BOX_SHAPE_PROXYTYPE: {
+        auto &box = static_cast<const btBoxShape &>(shape);
+        parts.push_back({body, false, local, box.getHalfExtentsWithMargin()});
+        break;
+    }
+    case CYLINDER_SHAPE_PROXYTYPE: {
+        auto &cylinder = static_cast<const btCylinderShape &>(shape);
+        if (cylinder.getUpAxis() == 0) {
+            parts.push_back(
+                {body, true, local, cylinder.getHalfExtentsWithMargin()});
+        }
+        break;
+    }
+    case COMPOUND_SHAPE_PROXYTYPE: {
+        auto &compound = static_cast<const btCompoundShape &>(shape);
+        for (int i = 0; i < compound.getNumChildShapes(); ++i) {
+            addParts(body,
+                     *compound.getChildShape(i),
+                     local * compound.getChildTransform(i));
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+size_t Soil::countInside(const btTransform &transform,
+                         const btVector3 &halfExtents) const {
+    size_t count = 0;
+    for (size_t i = 0; i < size(); ++i) {
+        auto local = transform.invXform(position(i)).absolute();
+        if (local.x() <= halfExtents.x() && local.y() <= halfExtents.y() &&
+            local.z() <= halfExtents.z()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+size_t Soil::numTasks() const {
+    auto perTask = max<size_t>(settings.particlesPerTask, 1);
+    return (size() + perTask - 1) / perTask;
+}
+
+template <typename F>
+void Soil::forEachTask(const F &f) {
+    auto count = numTasks();
+    if (pool && count > 1) {
+        pool->parallelFor(count, f);
+    }
+    else {
+        for (size_t task = 0; task < count; ++task) {
+            f(task);
+        }
+    }
+}
+
+uint32_t Soil::hash(int32_t ix, int32_t iy, int32_t iz) const {
+    // Linear in x, so that neighbours along x are next to each other in
+    // the table. The factors are picked so that no small step in y and z
+    // lands close to x in a table of any size, which would put unrelated
+    // particles in the ranges
+    return (static_cast<uint32_t>(ix) +
+            static_cast<uint32_t>(iy) * 0x61c88647u +
+            static_cast<uint32_t>(iz) * 0x7feb352du) &
+           hashMask;
+}
+
+void Soil::step(double dt) {
+    SIM_PROFILE("soil step");
+
+    if (x.empty()) {
+        return;
+    }
+
+    auto subSteps = max<size_t>(settings.subSteps, 1);
+    auto h = dt / static_cast<double>(subSteps);
+
+    for (auto &body : bodies) {
+        body.force.setZero();
+        body.torque.setZero();
+    }
+
+    for (size_t s = 0; s < subSteps; ++s) {
+        moveBodies(static_cast<btScalar>(h * static_cast<double>(s)));
+        sort();
+
+        loads.assign(numTasks() * bodies.size(),
+                     {btVector3(0, 0, 0), btVector3(0, 0, 0)});
+
+        forEachTask([this](size_t task) { collide(task); });
+
+        for (size_t task = 0; task < numTasks(); ++task) {
+            for (size_t b = 0; b < bodies.size(); ++b) {
+                auto &load = loads[task * bodies.size() + b];
+                bodies[b].force += load.force;
+                bodies[b].torque += load.torque;
+            }
+        }
+
+        forEachTask([this, h](size_t task) {
+            integrate(task, static_cast<float>(h));
+        });
+    }
+
+    // Bullet clears the forces after every step of the world, so the
+    // average over the substeps acts on the bodies during the next one
+    auto scale = btScalar(1) / static_cast<btScalar>(subSteps);
+    for (auto &body : bodies) {
+        if (!body.force.isZero() || !body.torque.isZero()) {
+            body.body->applyCentralForce(body.force * scale);
+            body.body->applyTorque(body.torque * scale);
+        }
+    }
+}
+
+void Soil::moveBodies(btScalar time) {
+    for (auto &body : bodies) {
+        body.linearVelocity = body.body->getLinearVelocity();
+        body.angularVelocity = body.body->getAngularVelocity();
+        btTransformUtil::integrateTransform(
+            body.body->getCenterOfMassTransform(),
+            body.linearVelocity,
+            body.angularVelocity,
+            time,
+            body.transform);
+    }
+
+    auto radius = static_cast<btScalar>(settings.particleRadius);
+
+    partStates.resize(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i) {
+        auto &part = parts[i];
+        auto &state = partStates[i];
+        state.transform = bodies[part.body].transform * part.local;
+
+        // The cylinder is inside the box with the same half extents
+        btTransformAabb(part.halfExtents,
+                        radius,
+                        state.transform,
+                        state.min,
+                        state.max);
+    }
+}
+
+void Soil::sort() {
+    auto n = size();
+    auto tableSize = nextPowerOfTwo(max<size_t>(n * 2, 1024));
+    hashMask = static_cast<uint32_t>(tableSize - 1);
+
+    const auto inverseCellSize =
+        1 / (static_cast<float>(settings.particleRadius) * 2);
+
+    for (size_t i = 0; i < n; ++i) {
+        cells[i] =
+            hash(static_cast<int32_t>(floor(x[i] * inverseCellSize)),
+                 static_cast<int32_t>(floor(y[i] * inverseCellSize)),
+                 static_cast<int32_t>(floor(z[i] * inverseCellSize)));
+    }
+
+    // Counting sort by cell
+    cellStart.assign(tableSize + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        ++cellStart[cells[i] + 1];
+    }
+    for (size_t c = 1; c <= tableSize; ++c) {
+        cellStart[c] += cellStart[c - 1];
+    }
+
+    cellCursor.assign(cellStart.begin(), cellStart.end() - 1);
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        order[cellCursor[cells[i]]++] = static_cast<uint32_t>(i);
+    }
+
+    // The forces are recalculated after the sort, so they are not moved
+    sortBuffer.resize(n);
+    for (auto array : {&x, &y, &z, &vx, &vy, &vz}) {
+        for (size_t i = 0; i < n; ++i) {
+            sortBuffer[i] = (*array)[order[i]];
+        }
+        array->swap(sortBuffer);
+    }
+
+    cellBuffer.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        cellBuffer[i] = cells[order[i]];
+    }
+    cells.swap(cellBuffer);
+}
+
+void Soil::collide(size_t task) {
+    auto begin = task * settings.particlesPerTask;
+    auto end = min(begin + settings.particlesPerTask, size());
+
+    const auto radius = static_cast<float>(settings.particleRadius);
+    const auto diameter = radius * 2;
+    const auto reach2 = diameter * diameter;
+    const auto inverseCellSize = 1 / diameter;
+    const auto stiffness = static_cast<float>(settings.stiffness);
+    const auto damping = static_cast<float>(
+        settings.dampingRatio * 2 *
+        sqrt(settings.stiffness * settings.particleMass));
+    const auto friction = static_cast<float>(settings.friction);
+
+    const Contact contact{static_cast<btScalar>(stiffness),
+                          static_cast<btScalar>(damping),
+                          static_cast<btScalar>(friction)};
+
+    const float *px = x.data(), *py = y.data(), *pz = z.data();
+    const float *pvx = vx.data(), *pvy = vy.data(), *pvz = vz.data();
+    const uint32_t *start = cellStart.data();
+
+    Load *taskLoads = loads.data() + task * bodies.size();
+
+    for (size_t i = begin; i < end; ++i) {
+        const float xi = px[i], yi = py[i], zi = pz[i];
+        const float vxi = pvx[i], vyi = pvy[i], vzi = pvz[i];
+
+        auto ix = static_cast<int32_t>(floor(xi * inverseCellSize));
+        auto iy = static_cast<int32_t>(floor(yi * inverseCellSize));
+        auto iz = static_cast<int32_t>(floor(zi * inverseCellSize));
+
+        // Three cells along x in each of the nine rows around the particle,
+        // one range per row unless it wraps around the end of the table
+        Range ranges[27];
+        size_t numRanges = 0;
+        for (int32_t dz = -1; dz <= 1; ++dz) {
+            for (int32_t dy = -1; dy <= 1; ++dy) {
+                auto first = hash(ix - 1, iy + dy, iz + dz);
+                if (first + 2 <= hashMask) {
+                    ranges[numRanges++] = {start[first], start[first + 3]};
+                }
+                else {
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        auto cell = (first + c) & hashMask;
+                        ranges[numRanges++] = {start[cell], start[cell + 1]};
+                    }
+                }
+            }
+        }
+        numRanges = merge(ranges, numRanges);
+
+        float fxi = 0, fyi = 0, fzi = 0;
+
+        for (size_t r = 0; r < numRanges; ++r) {
+            // No branches, particles that do not touch (and i itself) get
+            // no force, so that the loop can run on simd lanes
+#pragma omp simd reduction(+ : fxi, fyi, fzi)
+            for (uint32_t j = ranges[r].begin; j < ranges[r].end; ++j) {
+                float dx = xi - px[j];
+                float dy = yi - py[j];
+                float dz = zi - pz[j];
+                float d2 = dx * dx + dy * dy + dz * dz;
+                float touching = float((d2 < reach2) & (d2 > 1e-12f));
+
+                float inverseDistance = 1.f / sqrt(max(d2, 1e-12f));
+                float nx = dx * inverseDistance;
+                float ny = dy * inverseDistance;
+                float nz = dz * inverseDistance;
+                float overlap = diameter - d2 * inverseDistance;
+
+                float dvx = vxi - pvx[j];
+                float dvy = vyi - pvy[j];
+                float dvz = vzi - pvz[j];
+                float vn = dvx * nx + dvy * ny + dvz * nz;
+                float fn =
+                    max(stiffness * overlap - damping * vn, 0.f) * touching;
+
+                float tx = dvx - vn * nx;
+                float ty = dvy - vn * ny;
+                float tz = dvz - vn * nz;
+                float vt = sqrt(tx * tx + ty * ty + tz * tz) + 1e-6f;
+                float ft = min(damping, friction * fn / vt);
+
+                fxi += fn * nx - ft * tx;
+                fyi += fn * ny - ft * ty;
+                fzi += fn * nz - ft * tz;
+            }
+        }
+
+        btVector3 center(xi, yi, zi);
+        btVector3 velocity(vxi, vyi, vzi);
+        btVector3 force(fxi, fyi, fzi);
+
+        if (settings.ground) {
+            auto depth =
+                static_cast<btScalar>(radius) -
+                (center.z() - static_cast<btScalar>(settings.groundHeight));
+            if (depth > 0) {
+                force += contact(btVector3(0, 0, 1), depth, velocity);
+            }
+        }
+
+        for (size_t p = 0; p < parts.size(); ++p) {
+            auto &state = partStates[p];
+            if (!TestPointAgainstAabb2(state.min, state.max, center)) {
+                continue;
+            }
+
+            auto &part = parts[p];
+            btVector3 normal;
+            btScalar depth;
+            if (!penetration(part.cylinder,
+                             part.halfExtents,
+                             state.transform,
+                             center,
+                             radius,
+                             normal,
+                             depth)) {
+                continue;
+            }
+
+            auto &body = bodies[part.body];
+            auto arm = center - body.transform.getOrigin();
+            auto bodyVelocity =
+                body.linearVelocity + body.angularVelocity.cross(arm);
+            auto partForce = contact(normal, depth, velocity - bodyVelocity);
+
+            force += partForce;
+            auto &load = taskLoads[part.body];
+            load.force -= partForce;
+            load.torque -= arm.cross(partForce);
+        }
+
+        fx[i] = static_cast<float>(force.x());
+        fy[i] = static_cast<float>(force.y());
+        fz[i] = static_cast<float>(force.z());
+    }
+}
+
+void Soil::integrate(size_t task, float h) {
+    auto begin = task * settings.particlesPerTask;
+    auto end = min(begin + settings.particlesPerTask, size());
+
+    const auto inverseMass = static_cast<float>(1 / settings.particleMass);
+    const auto gravity = static_cast<float>(settings.gravity);
+
+    float *px = x.data(), *py = y.data(), *pz = z.data();
+    float *pvx = vx.data(), *pvy = vy.data(), *pvz = vz.data();
+    const float *pfx = fx.data(), *pfy = fy.data(), *pfz = fz.data();
+
+    // Semi implicit euler, the new velocity moves the particle
+#pragma omp simd
+    for (size_t i = begin; i < end; ++i) {
+        pvx[i] += pfx[i] * inverseMass * h;
+        pvy[i] += pfy[i] * inverseMass * h;
+        pvz[i] += (pfz[i] * inverseMass + gravity) * h;
+        px[i] += pvx[i] * h;
+        py[i] += pvy[i] * h;
+        pz[i] += pvz[i] * h;
+    }
+}
+
+} // namespace sim
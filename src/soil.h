@@ -0,0 +1,185 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "btBulletDynamicsCommon.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace sim {
+
+class ThreadPool;
+
+//! Granular soil made of small spheres that a bucket can dig into
+//!
+//! The particles are not bullet bodies. They are stored as one float array
+//! per component (structure of arrays) and push each other apart with a
+//! spring and a damper when they overlap, with the tangential force capped
+//! by coulomb friction. Neighbours are found with a spatial hash of a
+//! uniform grid with cells as large as a particle. The hash is linear in x,
+//! so when the particles are sorted by hash the three cells along x next to
+//! a particle are one contiguous range, and the force loop runs over nine
+//! such ranges without branches so that it can be vectorized. The
+//! particles are split in tasks on the thread pool
+//!
+//! Rigid bodies that are added collide with the particles through their
+//! box and x cylinder shapes, also inside compound shapes. The bodies are
+//! moved with their velocity during the substeps of the soil, and the
+//! average reaction force is applied to them, so step() is called right
+//! before the world is stepped with the same time. The ground is a plane
+class Soil {
+public:
+    struct Settings {
+        double particleRadius = .15;
+        double particleMass = 5e-5;
+
+        //! Force per meter that two particles overlap
+        double stiffness = 2;
+
+        //! Fraction of critical damping in contacts
+        double dampingRatio = .5;
+        double friction = .6;
+
+        //! Along z, the same as World
+        double gravity = -100;
+
+        //! Top of the ground of World, particles do not fall through it
+        bool ground = true;
+        double groundHeight = -1;
+
+        //! The contacts are stiff and the particles light, so the soil is
+        //! stepped many times for every step of the world
+        size_t subSteps = 8;
+
+        //! Particles that are handled in the same task
+        size_t particlesPerTask = 2048;
+    };
+
+    //! Without a pool everything runs on the calling thread
+    explicit Soil(ThreadPool *pool = nullptr);
+    Soil(Settings settings, ThreadPool *pool = nullptr);
+
+    Soil(const Soil &) = delete;
+    Soil &operator=(const Soil &) = delete;
+
+    void add(const btVector3 &position);
+
+    //! Fill a box with particles packed in a grid, with a little noise so
+    //! that they do not stack perfectly. Returns the number added
+    size_t fill(const btVector3 &min, const btVector3 &max);
+
+    //! Fill a pile on the ground with a square base, layers particles deep
+    //! so that it is spread out instead of tall. It starts at front and
+    //! goes along y, centered in x, and the z of front is not used.
+    //! Returns the number added, which is close to particles
+    size_t fillPile(const btVector3 &front,
+                    size_t particles,
+                    size_t layers = 5);
+
+    //! Collide the body with the particles. Shapes that are neither boxes,
+    //! cylinders along x or compounds of those are left out. The body must
+    //! be removed before it is deleted
+    void addBody(btRigidBody &body);
+    void removeBody(const btRigidBody &body);
+
+    //! Advance the soil dt seconds and apply the reaction forces to the
+    //! bodies
+    void step(double dt);
+
+    size_t size() const {
+        return x.size();
+    }
+
+    btVector3 position(size_t index) const {
+        return btVector3(x[index], y[index], z[index]);
+    }
+
+    //! Particles with the center inside a box, eg to see how much the
+    //! bucket carries
+    size_t countInside(const btTransform &transform,
+                       const btVector3 &halfExtents) const;
+
+    const Settings settings;
+
+private:
+    //! A box or a cylinder along x in the shape of a body
+    struct Part {
+        size_t body;
+        bool cylinder;
+        btTransform local;
+
+        //! For the cylinder x is half the width and y the radius
+        btVector3 halfExtents;
+    };
+
+    struct Body {
+        btRigidBody *body;
+
+        //! Sum over the substeps of the current step
+        btVector3 force;
+        btVector3 torque;
+
+        //! Where the body is moved to in the current substep
+        btTransform transform;
+        btVector3 linearVelocity;
+        btVector3 angularVelocity;
+    };
+
+    //! The world transform and box of a part in the current substep
+    struct PartState {
+        btTransform transform;
+        btVector3 min;
+        btVector3 max;
+    };
+
+    //! Force and torque from one task on one body
+    struct Load {
+        btVector3 force;
+        btVector3 torque;
+    };
+
+    void addParts(size_t body,
+                  const btCollisionShape &shape,
+                  const btTransform &local);
+
+    void moveBodies(btScalar time);
+    void sort();
+    void collide(size_t task);
+    void integrate(size_t task, float h);
+
+    //! Run f for every task, on the pool if there is one
+    template <typename F>
+    void forEachTask(const F &f);
+
+    size_t numTasks() const;
+
+    uint32_t hash(int32_t ix, int32_t iy, int32_t iz) const;
+
+    ThreadPool *pool;
+
+    // Particles, sorted by cell after sort()
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> fx, fy, fz;
+    std::vector<uint32_t> cells;
+
+    //! Particles in cell i are cellStart[i] to cellStart[i + 1]
+    std::vector<uint32_t> cellStart;
+    uint32_t hashMask = 0;
+
+    // Scratch for sort()
+    std::vector<uint32_t> cellCursor;
+    std::vector<uint32_t> order;
+    std::vector<float> sortBuffer;
+    std::vector<uint32_t> cellBuffer;
+
+    std::vector<Body> bodies;
+    std::vector<Part> parts;
+    std::vector<PartState> partStates;
+
+    //! numTasks() * bodies.size(), task major
+    std::vector<Load> loads;
+};
+
+} // namespace sim
@@ -0,0 +1,91 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace sim {
+
+//! Lock free queue for exactly one producer thread and one consumer thread
+//! Nothing is allocated after construction, and a full ring makes push
+//! fail instead of waiting, so the producer never blocks
+template <typename T>
+class SpscRing {
+public:
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "values are copied in and out without constructors");
+
+    //! The capacity is rounded up to a power of two
+    explicit SpscRing(size_t minimumCapacity)
+        : capacity(roundUp(minimumCapacity))
+        , mask(capacity - 1)
+        , values(std::make_unique<T[]>(capacity)) {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    //! Producer side, false if the ring is full
+    bool push(const T &value) {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail == capacity) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail == capacity) {
+                return false;
+            }
+        }
+
+        values[h & mask] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer side, copies up to count values and returns how many
+    size_t pop(T *out, size_t count) {
+        auto t = tail.load(std::memory_order_relaxed);
+        auto available = head.load(std::memory_order_acquire) - t;
+        if (available < count) {
+            count = available;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = values[(t + i) & mask];
+        }
+
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    //! Approximate when called while the other thread is running
+    size_t size() const {
+        return head.load(std::memory_order_acquire) -
+               tail.load(std::memory_order_acquire);
+    }
+
+    const size_t capacity;
+
+private:
+    static size_t roundUp(size_t value) {
+        size_t capacity = 1;
+        while (capacity < value) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    const size_t mask;
+    std::unique_ptr<T[]> values;
+
+    //! On separate cache lines so the threads do not invalidate each other
+    alignas(64) std::atomic<size_t> head{0};
+    //! Last tail seen by the producer, saves reading the shared tail on
+    //! every push
+    size_t cachedTail = 0;
+
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+} // namespace sim
@@ -0,0 +1,272 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "telemetry.h"
+
+#include "vehicle1.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+void copy(const btVector3 &from, float *to) {
+    for (int i = 0; i < 3; ++i) {
+        to[i] = static_cast<float>(from[i]);
+    }
+}
+
+void copy(const btQuaternion &from, float *to) {
+    to[0] = static_cast<float>(from.x());
+    to[1] = static_cast<float>(from.y());
+    to[2] = static_cast<float>(from.z());
+    to[3] = static_cast<float>(from.w());
+}
+
+//! Records moved to the sink in one go
+const size_t batchSize = 1024;
+
+//! The mapped file grows with at least this much at a time
+const size_t fileGrowth = 16 * 1024 * 1024;
+
+} // namespace
+
+TelemetryRecord captureTelemetry(Vehicle1 &vehicle,
+                                 uint64_t step,
+                                 uint32_t index) {
+    TelemetryRecord record = {};
+
+    record.step = step;
+    record.vehicle = index;
+    if (vehicle.isSleeping()) {
+        record.flags |= TelemetryRecord::Sleeping;
+    }
+
+    auto &front = vehicle.frontBody.getWorldTransform();
+    auto &rear = vehicle.rearBody.getWorldTransform();
+
+    copy(front.getOrigin(), record.frontPosition);
+    copy(front.getRotation(), record.frontRotation);
+    copy(rear.getOrigin(), record.rearPosition);
+    copy(rear.getRotation(), record.rearRotation);
+
+    for (size_t i = 0; i < vehicle.wheels.size(); ++i) {
+        auto &body = vehicle.wheels[i].body;
+
+        // The hinge axis is -x in the frame of the wheel
+        auto axis = -body.getWorldTransform().getBasis().getColumn(0);
+        record.wheelAngularVelocity[i] =
+            static_cast<float>(body.getAngularVelocity().dot(axis));
+    }
+
+    record.waistAngle = static_cast<float>(vehicle.waistJoint.getHingeAngle());
+    record.throttleTarget = static_cast<float>(
+        vehicle.wheels[0].constraint.getMotorTargetVelocity());
+    record.steeringTarget =
+        static_cast<float>(vehicle.waistJoint.getMotorTargetVelocity());
+
+    return record;
+}
+
+MappedFileSink::MappedFileSink(const string &filename) {
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw runtime_error("telemetry: could not open " + filename + ": " +
+                            strerror(errno));
+    }
+
+    if (!grow(fileGrowth)) {
+        close(fd);
+        throw runtime_error("telemetry: could not map " + filename);
+    }
+}
+
+MappedFileSink::~MappedFileSink() {
+    if (address) {
+        munmap(address, mappedSize);
+    }
+
+    // Cut away the part that was reserved but never written, a failure
+    // only leaves zeros at the end
+    auto truncated = ftruncate(fd, static_cast<off_t>(size));
+    (void)truncated;
+    close(fd);
+}
+
+bool MappedFileSink::write(const void *data, size_t bytes) {
+    if (size + bytes > mappedSize && !grow(size + bytes)) {
+        return false;
+    }
+
+    memcpy(address + size, data, bytes);
+    size += bytes;
+    return true;
+}
+
+bool MappedFileSink::grow(size_t minimumSize) {
+    auto newSize = max(minimumSize, mappedSize + fileGrowth);
+
+    if (ftruncate(fd, static_cast<off_t>(newSize))) {
+        return false;
+    }
+
+    if (address) {
+        munmap(address, mappedSize);
+        address = nullptr;
+        mappedSize = 0;
+    }
+
+    auto mapped =
+        mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    address = static_cast<char *>(mapped);
+    mappedSize = newSize;
+    return true;
+}
+
+UnixSocketSink::UnixSocketSink(const string &path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw runtime_error("telemetry: socket path too long: " + path);
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw runtime_error(string("telemetry: could not create socket: ") +
+                            strerror(errno));
+    }
+
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address))) {
+        auto error = string(strerror(errno));
+        close(fd);
+        throw runtime_error("telemetry: could not connect to " + path + ": " +
+                            error);
+    }
+}
+
+UnixSocketSink::~UnixSocketSink() {
+    close(fd);
+}
+
+bool UnixSocketSink::write(const void *data, size_t bytes) {
+    auto bytesLeft = static_cast<const char *>(data);
+    auto end = bytesLeft + bytes;
+
+    while (bytesLeft < end) {
+        // No SIGPIPE when the reader has gone away
+        auto sent = send(fd,
+                         bytesLeft,
+                         static_cast<size_t>(end - bytesLeft),
+                         MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytesLeft += sent;
+    }
+
+    return true;
+}
+
+unique_ptr<TelemetrySink> openTelemetrySink(const string &target) {
+    const string prefix = "unix:";
+    if (target.compare(0, prefix.size(), prefix) == 0) {
+        return make_unique<UnixSocketSink>(target.substr(prefix.size()));
+    }
+
+    return make_unique<MappedFileSink>(target);
+}
+
+Telemetry::Telemetry(unique_ptr<TelemetrySink> s,
+                     double dt,
+                     Settings settings)
+    : settings(settings), sink(move(s)), ring(settings.capacity) {
+    TelemetryHeader header;
+    header.dt = dt;
+    if (!sink->write(&header, sizeof(header))) {
+        sinkFailed = true;
+    }
+
+    thread = std::thread([this] { run(); });
+}
+
+Telemetry::Telemetry(unique_ptr<TelemetrySink> sink, double dt)
+    : Telemetry(move(sink), dt, Settings{}) {
+}
+
+Telemetry::~Telemetry() {
+    stop();
+}
+
+void Telemetry::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool Telemetry::record(const TelemetryRecord &record) {
+    if (ring.push(record)) {
+        return true;
+    }
+
+    ++numDropped;
+    return false;
+}
+
+void Telemetry::run() {
+    vector<TelemetryRecord> buffer(batchSize);
+
+    while (running) {
+        if (!drain(buffer)) {
+            this_thread::sleep_for(settings.interval);
+        }
+    }
+
+    // The producer has stopped, so this gets everything that is left
+    while (drain(buffer)) {
+    }
+}
+
+size_t Telemetry::drain(vector<TelemetryRecord> &buffer) {
+    auto count = ring.pop(buffer.data(), buffer.size());
+    if (!count) {
+        return 0;
+    }
+
+    // Keep emptying the ring after a failure, so that the counts are right
+    if (!sinkFailed) {
+        if (sink->write(buffer.data(), count * sizeof(TelemetryRecord))) {
+            numWritten += count;
+        }
+        else {
+            sinkFailed = true;
+        }
+    }
+
+    if (sinkFailed) {
+        numDropped += count;
+    }
+
+    return count;
+}
+
+} // namespace sim
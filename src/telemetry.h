@@ -0,0 +1,181 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "spscring.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sim {
+
+class Vehicle1;
+
+//! State of one vehicle after one step, written to the sink as it is in
+//! memory. Positions are in world coordinates and rotations are
+//! quaternions as x, y, z, w
+struct TelemetryRecord {
+    enum Flags : uint32_t {
+        Sleeping = 1,
+    };
+
+    //! Index of the step that was just taken, counted from 0
+    uint64_t step;
+    uint32_t vehicle;
+    uint32_t flags;
+
+    float frontPosition[3];
+    float frontRotation[4];
+    float rearPosition[3];
+    float rearRotation[4];
+
+    //! Around the axles, in the same order as Vehicle1::wheels
+    float wheelAngularVelocity[4];
+
+    float waistAngle;
+
+    //! Target velocities of the wheel motors and the waist motor, which is
+    //! the input times the scaling in the settings
+    float throttleTarget;
+    float steeringTarget;
+
+    float reserved;
+};
+
+static_assert(sizeof(TelemetryRecord) == 104,
+              "the layout is read by other programs");
+
+//! Written once before the records
+struct TelemetryHeader {
+    char magic[8] = {'v', 's', 't', 'l', 'm', '0', '1', '\0'};
+    uint32_t version = 1;
+    uint32_t recordSize = sizeof(TelemetryRecord);
+    double dt = 0;
+};
+
+static_assert(sizeof(TelemetryHeader) == 24,
+              "the layout is read by other programs");
+
+//! Read the current state of a vehicle, needs to be done on the thread
+//! that steps the world
+TelemetryRecord captureTelemetry(Vehicle1 &vehicle,
+                                 uint64_t step,
+                                 uint32_t index);
+
+//! Where the records ends up
+class TelemetrySink {
+public:
+    virtual ~TelemetrySink() = default;
+
+    //! False if nothing more can be written
+    virtual bool write(const void *data, size_t bytes) = 0;
+};
+
+//! File that is memory mapped and grown in large steps, and cut to the
+//! size of the data when closed
+class MappedFileSink : public TelemetrySink {
+public:
+    //! Throws std::runtime_error if the file can not be created
+    MappedFileSink(const std::string &filename);
+    ~MappedFileSink() override;
+
+    bool write(const void *data, size_t bytes) override;
+
+private:
+    bool grow(size_t minimumSize);
+
+    int fd = -1;
+    char *address = nullptr;
+    size_t mappedSize = 0;
+    size_t size = 0;
+};
+
+//! Connects to a program that listens on a local stream socket
+class UnixSocketSink : public TelemetrySink {
+public:
+    //! Throws std::runtime_error if the connection fails
+    UnixSocketSink(const std::string &path);
+    ~UnixSocketSink() override;
+
+    bool write(const void *data, size_t bytes) override;
+
+private:
+    int fd = -1;
+};
+
+//! "unix:<path>" connects to a socket, anything else is a filename
+std::unique_ptr<TelemetrySink> openTelemetrySink(const std::string &target);
+
+//! Moves records from the simulation thread to a sink
+//!
+//! The simulation thread only copies the records into a ring buffer, and a
+//! thread of its own writes them to the sink. If the writer falls behind
+//! the records that does not fit are dropped and counted, the simulation
+//! never waits for it
+class Telemetry {
+public:
+    struct Settings {
+        //! Records that can be waiting for the writer
+        size_t capacity = 1 << 16;
+
+        //! How long the writer sleeps when the ring is empty
+        std::chrono::milliseconds interval{2};
+    };
+
+    Telemetry(std::unique_ptr<TelemetrySink> sink,
+              double dt,
+              Settings settings);
+    Telemetry(std::unique_ptr<TelemetrySink> sink, double dt);
+
+    //! Same as stop()
+    ~Telemetry();
+
+    Telemetry(const Telemetry &) = delete;
+    Telemetry &operator=(const Telemetry &) = delete;
+
+    //! Only from one thread, false if the record was dropped
+    bool record(const TelemetryRecord &record);
+
+    //! Writes everything that is recorded and stops the writer, nothing
+    //! can be recorded after this
+    void stop();
+
+    size_t written() const {
+        return numWritten;
+    }
+
+    size_t dropped() const {
+        return numDropped;
+    }
+
+    //! True if the sink stopped accepting data, eg when the other end of the
+    //! socket is closed
+    bool failed() const {
+        return sinkFailed;
+    }
+
+    const Settings settings;
+
+private:
+    void run();
+
+    //! Returns the number of records that was moved
+    size_t drain(std::vector<TelemetryRecord> &buffer);
+
+    std::unique_ptr<TelemetrySink> sink;
+    SpscRing<TelemetryRecord> ring;
+
+    std::atomic<bool> running{true};
+    std::atomic<size_t> numWritten{0};
+    std::atomic<size_t> numDropped{0};
+    std::atomic<bool> sinkFailed{false};
+
+    std::thread thread;
+};
+
+} // namespace sim
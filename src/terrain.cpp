@@ -0,0 +1,304 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char magic[8] = {'v', 's', 't', 'i', 'l', 'e', '1', '\0'};
+
+bool fileExists(const string &filename) {
+    struct stat info;
+    return stat(filename.c_str(), &info) == 0;
+}
+
+} // namespace
+
+namespace sim {
+
+MappedFile::MappedFile(const string &filename) {
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("could not open " + filename);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw runtime_error("could not read " + filename);
+    }
+
+    length = static_cast<size_t>(info.st_size);
+    address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+
+    if (address == MAP_FAILED) {
+        address = nullptr;
+        throw runtime_error("could not map " + filename);
+    }
+}
+
+MappedFile::~MappedFile() {
+    munmap(address, length);
+}
+
+TerrainTileFile::TerrainTileFile(const string &filename) : file(filename) {
+    if (file.size() < headerSize || memcmp(file.data(), magic, 8) != 0) {
+        throw runtime_error("terrain: " + filename + " is not a tile");
+    }
+
+    int32_t res;
+    memcpy(&res, file.data() + 8, sizeof(res));
+    memcpy(&minHeight, file.data() + 12, sizeof(minHeight));
+    memcpy(&maxHeight, file.data() + 16, sizeof(maxHeight));
+    resolution = res;
+
+    auto expected = headerSize + static_cast<size_t>(resolution) *
+                                     static_cast<size_t>(resolution) *
+                                     sizeof(float);
+
+    if (resolution < 2 || file.size() < expected) {
+        throw runtime_error("terrain: " + filename + " is truncated");
+    }
+}
+
+string TerrainTileFile::filename(const string &directory, int x, int y) {
+    return directory + "/" + to_string(x) + "_" + to_string(y) + ".tile";
+}
+
+void TerrainTileFile::write(const string &filename,
+                            int resolution,
+                            const vector<float> &heights) {
+    if (heights.size() != static_cast<size_t>(resolution * resolution)) {
+        throw runtime_error("terrain: wrong number of heights");
+    }
+
+    ofstream file(filename, ios::binary);
+    if (!file) {
+        throw runtime_error("terrain: could not write " + filename);
+    }
+
+    auto minmax = minmax_element(heights.begin(), heights.end());
+
+    int32_t res = resolution;
+    float minHeight = *minmax.first;
+    float maxHeight = *minmax.second;
+    int32_t reserved = 0;
+
+    file.write(magic, sizeof(magic));
+    file.write(reinterpret_cast<const char *>(&res), sizeof(res));
+    file.write(reinterpret_cast<const char *>(&minHeight), sizeof(minHeight));
+    file.write(reinterpret_cast<const char *>(&maxHeight), sizeof(maxHeight));
+    file.write(reinterpret_cast<const char *>(&reserved), sizeof(reserved));
+    file.write(reinterpret_cast<const char *>(heights.data()),
+               static_cast<streamsize>(heights.size() * sizeof(float)));
+}
+
+Terrain::Tile::Tile(const string &filename, Key key, const Settings &settings)
+    : key(key), file(filename) {
+    auto res = file.resolution;
+
+    // The shape uses the heights straight from the mapped file
+    shape = make_unique<btHeightfieldTerrainShape>(res,
+                                                   res,
+                                                   file.heights(),
+                                                   1,
+                                                   file.minHeight,
+                                                   file.maxHeight,
+                                                   2,
+                                                   PHY_FLOAT,
+                                                   false);
+
+    auto spacing = static_cast<btScalar>(settings.tileSize / (res - 1));
+    shape->setLocalScaling({spacing, spacing, 1});
+
+    // Bullet centers the shape around the middle of its bounding box
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin(btVector3((key.first + .5) * settings.tileSize,
+                                  (key.second + .5) * settings.tileSize,
+                                  (file.minHeight + file.maxHeight) / 2.));
+
+    btRigidBody::btRigidBodyConstructionInfo info(0, nullptr, shape.get());
+    info.m_startWorldTransform = transform;
+    body = make_unique<btRigidBody>(info);
+}
+
+Terrain::Terrain(btDynamicsWorld *world, Settings settings)
+    : settings(move(settings)), world(world) {
+}
+
+Terrain::~Terrain() {
+    for (auto &it : tiles) {
+        world->removeRigidBody(it.second->body.get());
+    }
+}
+
+void Terrain::update(const vector<btVector3> &points) {
+    auto tileSize = settings.tileSize;
+    auto reach = static_cast<int>(ceil(settings.loadRadius / tileSize));
+
+    wanted.clear();
+
+    for (auto &point : points) {
+        auto center = key(point.x(), point.y());
+
+        for (int y = center.second - reach; y <= center.second + reach; ++y) {
+            for (int x = center.first - reach; x <= center.first + reach;
+                 ++x) {
+                if (distance({x, y}, point) <= settings.loadRadius) {
+                    wanted.emplace_back(x, y);
+                }
+            }
+        }
+    }
+
+    // Vehicles close to each other wants the same tiles
+    sort(wanted.begin(), wanted.end());
+    wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+
+    for (auto &key : wanted) {
+        if (tiles.find(key) != tiles.end() || missing.count(key)) {
+            continue;
+        }
+
+        auto filename = TerrainTileFile::filename(
+            settings.directory, key.first, key.second);
+
+        if (!fileExists(filename)) {
+            missing.insert(key);
+            continue;
+        }
+
+        unique_ptr<Tile> tile;
+        try {
+            tile = make_unique<Tile>(filename, key, settings);
+        }
+        catch (std::exception &e) {
+            // A broken tile should not stop the simulation, there is just
+            // no ground there
+            missing.insert(key);
+            error = e.what();
+            ++failures;
+            continue;
+        }
+
+        world->addRigidBody(tile->body.get());
+        tiles.emplace(key, move(tile));
+        ++loads;
+    }
+
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        auto isClose = [&](const btVector3 &point) {
+            return distance(it->first, point) <= settings.unloadRadius;
+        };
+
+        if (any_of(points.begin(), points.end(), isClose)) {
+            ++it;
+            continue;
+        }
+
+        world->removeRigidBody(it->second->body.get());
+        it = tiles.erase(it);
+        ++unloads;
+    }
+}
+
+Terrain::Key Terrain::key(double x, double y) const {
+    return {static_cast<int>(floor(x / settings.tileSize)),
+            static_cast<int>(floor(y / settings.tileSize))};
+}
+
+bool Terrain::height(double x, double y, double &height) const {
+    auto it = tiles.find(key(x, y));
+    if (it == tiles.end()) {
+        return false;
+    }
+
+    auto &file = it->second->file;
+    auto last = file.resolution - 1;
+    auto spacing = settings.tileSize / last;
+
+    auto fx = (x - it->first.first * settings.tileSize) / spacing;
+    auto fy = (y - it->first.second * settings.tileSize) / spacing;
+
+    auto sx = min(static_cast<int>(fx), last - 1);
+    auto sy = min(static_cast<int>(fy), last - 1);
+
+    fx -= sx;
+    fy -= sy;
+
+    // Bilinear, which is close enough to bullets triangles for placing
+    // things on the ground
+    auto h00 = file.height(sx, sy);
+    auto h10 = file.height(sx + 1, sy);
+    auto h01 = file.height(sx, sy + 1);
+    auto h11 = file.height(sx + 1, sy + 1);
+
+    height = (h00 * (1 - fx) + h10 * fx) * (1 - fy) +
+             (h01 * (1 - fx) + h11 * fx) * fy;
+
+    return true;
+}
+
+double Terrain::distance(Key key, const btVector3 &point) const {
+    auto size = settings.tileSize;
+    auto x0 = key.first * size;
+    auto y0 = key.second * size;
+
+    auto dx = max({x0 - point.x(), 0., point.x() - (x0 + size)});
+    auto dy = max({y0 - point.y(), 0., point.y() - (y0 + size)});
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+void generateTerrain(const Terrain::Settings &settings,
+                     int count,
+                     int resolution) {
+    mkdir(settings.directory.c_str(), 0755);
+
+    auto spacing = settings.tileSize / (resolution - 1);
+
+    vector<float> heights(static_cast<size_t>(resolution * resolution));
+
+    for (int ty = -count / 2; ty < count - count / 2; ++ty) {
+        for (int tx = -count / 2; tx < count - count / 2; ++tx) {
+            for (int sy = 0; sy < resolution; ++sy) {
+                for (int sx = 0; sx < resolution; ++sx) {
+                    auto x = tx * settings.tileSize + sx * spacing;
+                    auto y = ty * settings.tileSize + sy * spacing;
+
+                    // Flat at the height of the old ground box around
+                    // origin where vehicles spawn, rolling hills further out
+                    auto r = sqrt(x * x + y * y);
+                    auto amplitude = min(1., r / 200.);
+                    auto hills = 6 * sin(x / 53.) * cos(y / 41.) +
+                                 2 * sin((x + y) / 17.) + sin(x / 7.) * .3;
+
+                    heights[static_cast<size_t>(sy * resolution + sx)] =
+                        static_cast<float>(-1 + amplitude * hills);
+                }
+            }
+
+            TerrainTileFile::write(
+                TerrainTileFile::filename(settings.directory, tx, ty),
+                resolution,
+                heights);
+        }
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,179 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h"
+#include "btBulletDynamicsCommon.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sim {
+
+//! Read only memory mapping of a whole file
+class MappedFile {
+public:
+    //! Throws std::runtime_error if the file could not be mapped
+    MappedFile(const std::string &filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const {
+        return static_cast<const char *>(address);
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    void *address = nullptr;
+    size_t length = 0;
+};
+
+//! One square heightfield tile file
+//!
+//! Tile x, y covers the area from x * tileSize to (x + 1) * tileSize along
+//! the world x axis, and the same along y. The file is named "x_y.tile" and
+//! contains a header followed by resolution * resolution float heights, row
+//! by row with x increasing fastest. Neighbouring tiles share their edge
+//! samples. The heights are used directly from the mapping so only the
+//! parts that are touched are ever read from disk
+class TerrainTileFile {
+public:
+    //! Throws std::runtime_error on missing or malformed files
+    TerrainTileFile(const std::string &filename);
+
+    const float *heights() const {
+        return reinterpret_cast<const float *>(file.data() + headerSize);
+    }
+
+    float height(int sx, int sy) const {
+        return heights()[sy * resolution + sx];
+    }
+
+    static std::string filename(const std::string &directory, int x, int y);
+
+    static void write(const std::string &filename,
+                      int resolution,
+                      const std::vector<float> &heights);
+
+    static constexpr size_t headerSize = 24;
+
+    int resolution = 0;
+    float minHeight = 0;
+    float maxHeight = 0;
+
+private:
+    MappedFile file;
+};
+
+//! Streams heightfield tiles in and out of a physics world around a set of
+//! points, usually the active vehicles, so that maps of any size can be used
+//! while only the tiles close to something are loaded
+class Terrain {
+public:
+    struct Settings {
+        std::string directory;
+
+        //! Size in meters of the side of a tile
+        double tileSize = 100;
+
+        //! Tiles closer than this to any point are loaded
+        double loadRadius = 120;
+
+        //! Tiles further away than this from every point are unloaded, the
+        //! gap to loadRadius keeps tiles from being loaded and unloaded
+        //! repeatedly by something that moves along the edge
+        double unloadRadius = 200;
+    };
+
+    using Key = std::pair<int, int>;
+
+    struct Tile {
+        Tile(const std::string &filename,
+             Key key,
+             const Settings &settings);
+
+        Key key;
+        TerrainTileFile file;
+        std::unique_ptr<btHeightfieldTerrainShape> shape;
+        std::unique_ptr<btRigidBody> body;
+    };
+
+    Terrain(btDynamicsWorld *world, Settings settings);
+    ~Terrain();
+
+    Terrain(const Terrain &) = delete;
+    Terrain &operator=(const Terrain &) = delete;
+
+    //! Load the tiles around the points and unload tiles that are far away
+    //! from all of them. Must be called from the thread that steps the world
+    void update(const std::vector<btVector3> &points);
+
+    //! The tile that contains the world position
+    Key key(double x, double y) const;
+
+    //! Height of the ground at the position, only works where a tile is
+    //! loaded, returns false otherwise
+    bool height(double x, double y, double &height) const;
+
+    size_t size() const {
+        return tiles.size();
+    }
+
+    //! Number of tiles loaded and unloaded since the start, for statistics
+    size_t numLoads() const {
+        return loads;
+    }
+
+    size_t numUnloads() const {
+        return unloads;
+    }
+
+    //! Tiles with a file that could not be loaded, they are treated as
+    //! missing. The message is from the last of them
+    size_t numFailures() const {
+        return failures;
+    }
+
+    const std::string &lastError() const {
+        return error;
+    }
+
+    const Settings settings;
+
+private:
+    //! Shortest distance in the xy plane from the point to the tile
+    double distance(Key key, const btVector3 &point) const;
+
+    btDynamicsWorld *world;
+
+    std::map<Key, std::unique_ptr<Tile>> tiles;
+
+    //! Tiles that has no file, to not look for them again on every update
+    std::set<Key> missing;
+
+    //! Reused between updates
+    std::vector<Key> wanted;
+
+    size_t loads = 0;
+    size_t unloads = 0;
+    size_t failures = 0;
+    std::string error;
+};
+
+//! Write a procedural map of count * count tiles centered around origin,
+//! used for testing streaming without real site data
+void generateTerrain(const Terrain::Settings &settings,
+                     int count,
+                     int resolution = 129);
+
+} // namespace sim
@@ -0,0 +1,292 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "terrainrender.h"
+
+#include "culling.h"
+#include "matgui/matgl.h"
+#include "mesh.h"
+#include "meshcache.h"
+#include "profiler.h"
+#include "renderstate.h"
+#include "shaders.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+//! Grid of the tile with every step:th sample, relative to the corner of
+//! the tile, with skirts hanging down from the edges that hides the cracks
+//! between tiles with different level of detail
+Mesh createTileMesh(const sim::TerrainTileFile &file,
+                    double tileSize,
+                    int step) {
+    Mesh mesh;
+
+    auto &vertices = mesh.vertices;
+    auto &indices = mesh.indices;
+
+    const int res = file.resolution;
+    const int n = (res - 1) / step + 1;
+    const auto spacing = static_cast<float>(tileSize / (res - 1));
+    const auto skirt = spacing * static_cast<float>(step);
+
+    vertices.reserve(static_cast<size_t>(n * n + 4 * n));
+
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            auto sx = i * step;
+            auto sy = j * step;
+
+            auto left = file.height(max(sx - step, 0), sy);
+            auto right = file.height(min(sx + step, res - 1), sy);
+            auto down = file.height(sx, max(sy - step, 0));
+            auto up = file.height(sx, min(sy + step, res - 1));
+
+            auto nx = (left - right) / (2 * skirt);
+            auto ny = (down - up) / (2 * skirt);
+            auto length = sqrt(nx * nx + ny * ny + 1);
+
+            auto position =
+                vec4{sx * spacing, sy * spacing, file.height(sx, sy)};
+            auto normal = vec4{nx / length, ny / length, 1 / length, 0};
+
+            vertices.push_back({position, normal});
+        }
+    }
+
+    for (int j = 1; j < n; ++j) {
+        for (int i = 1; i < n; ++i) {
+            auto a = static_cast<unsigned>((j - 1) * n + i - 1);
+            auto b = a + 1;
+            auto c = a + static_cast<unsigned>(n);
+            auto d = c + 1;
+
+            indices.insert(indices.end(), {a, b, d, a, d, c});
+        }
+    }
+
+    // Skirts, one copy of every edge vertex moved down
+    auto addSkirt = [&](int start, int stride) {
+        auto first = static_cast<unsigned>(vertices.size());
+
+        for (int k = 0; k < n; ++k) {
+            auto vertex = vertices[static_cast<size_t>(start + k * stride)];
+            vertex.pos.z -= skirt;
+            vertices.push_back(vertex);
+        }
+
+        for (int k = 1; k < n; ++k) {
+            auto top0 = static_cast<unsigned>(start + (k - 1) * stride);
+            auto top1 = static_cast<unsigned>(start + k * stride);
+            auto bottom0 = first + static_cast<unsigned>(k - 1);
+            auto bottom1 = first + static_cast<unsigned>(k);
+
+            indices.insert(indices.end(),
+                           {top0, top1, bottom1, top0, bottom1, bottom0});
+        }
+    };
+
+    addSkirt(0, 1);
+    addSkirt((n - 1) * n, 1);
+    addSkirt(0, n);
+    addSkirt(n - 1, n);
+
+    return mesh;
+}
+
+} // namespace
+
+namespace sim {
+
+struct TerrainRenderer::TileMesh {
+    TileMesh(const Mesh &mesh, Matrixf model, btVector3 min, btVector3 max)
+        : model(model), min(min), max(max), mesh(mesh) {
+    }
+
+    Matrixf model;
+
+    //! Bounds including the skirts
+    btVector3 min;
+    btVector3 max;
+
+    uint64_t lastUsed = 0;
+    GpuMesh mesh;
+};
+
+TerrainRenderer::TerrainRenderer(Terrain::Settings terrainSettings,
+                                 Settings settings)
+    : terrainSettings(move(terrainSettings)), settings(settings) {
+}
+
+TerrainRenderer::TerrainRenderer(Terrain::Settings terrainSettings)
+    : TerrainRenderer(move(terrainSettings), Settings{}) {
+}
+
+TerrainRenderer::~TerrainRenderer() = default;
+
+void TerrainRenderer::render(const btVector3 &center,
+                             const Matrixf &view,
+                             const Matrixf &projection,
+                             const Culling &culling) {
+    SIM_PROFILE("draw terrain");
+
+    ++frame;
+
+    auto &state = RenderState::instance();
+    auto program = plainShader();
+    static auto modelUniform = program->getUniform("uModel");
+
+    state.camera(view, projection);
+    state.use(program);
+
+    auto tileSize = terrainSettings.tileSize;
+    auto reach = static_cast<int>(ceil(settings.viewDistance / tileSize));
+    auto cx = static_cast<int>(floor(center.x() / tileSize));
+    auto cy = static_cast<int>(floor(center.y() / tileSize));
+
+    size_t builds = 0;
+
+    for (int y = cy - reach; y <= cy + reach; ++y) {
+        for (int x = cx - reach; x <= cx + reach; ++x) {
+            auto dx = max({x * tileSize - center.x(),
+                           0.,
+                           center.x() - (x + 1) * tileSize});
+            auto dy = max({y * tileSize - center.y(),
+                           0.,
+                           center.y() - (y + 1) * tileSize});
+            auto distance = sqrt(dx * dx + dy * dy);
+
+            if (distance > settings.viewDistance) {
+                continue;
+            }
+
+            int lod = 0;
+            while (lod + 1 < settings.numLods &&
+                   distance > settings.lodDistance * (1 << lod)) {
+                ++lod;
+            }
+
+            // Heights are not known before the tile is read, so this only
+            // rejects tiles that are to the side of the view
+            auto column = btVector3{0, 0, 1e4};
+            auto corner = btVector3(x * tileSize, y * tileSize, 0);
+            auto farCorner = corner + btVector3(tileSize, tileSize, 0);
+            if (!culling.visible(corner - column, farCorner + column)) {
+                continue;
+            }
+
+            auto tile = mesh(x, y, lod, builds);
+            if (!tile) {
+                continue;
+            }
+
+            // Used also when it is outside the view, since it is likely to
+            // be seen again soon
+            tile->lastUsed = frame;
+
+            if (!culling.visible(tile->min, tile->max)) {
+                continue;
+            }
+
+            glUniformMatrix4fv(modelUniform, 1, false, tile->model);
+            tile->mesh.draw();
+        }
+    }
+
+    evict();
+}
+
+TerrainRenderer::TileMesh *TerrainRenderer::mesh(int x,
+                                                 int y,
+                                                 int lod,
+                                                 size_t &builds) {
+    if (missing.count({x, y})) {
+        return nullptr;
+    }
+
+    auto it = meshes.find(Key{x, y, lod});
+    if (it != meshes.end()) {
+        return it->second.get();
+    }
+
+    if (builds >= settings.maxBuildsPerFrame) {
+        // Use any other level while waiting, coarser first since that is
+        // where tiles comes from when the camera moves closer
+        for (int other = settings.numLods - 1; other >= 0; --other) {
+            auto fallback = meshes.find(Key{x, y, other});
+            if (fallback != meshes.end()) {
+                return fallback->second.get();
+            }
+        }
+        return nullptr;
+    }
+
+    auto filename =
+        TerrainTileFile::filename(terrainSettings.directory, x, y);
+
+    unique_ptr<TerrainTileFile> file;
+    try {
+        file = make_unique<TerrainTileFile>(filename);
+    }
+    catch (runtime_error &) {
+        missing.insert({x, y});
+        return nullptr;
+    }
+
+    ++builds;
+
+    // Levels that does not divide the tile evenly falls back to the finest
+    int step = 1 << lod;
+    if ((file->resolution - 1) % step) {
+        step = 1;
+    }
+
+    auto tileMesh = createTileMesh(*file, terrainSettings.tileSize, step);
+
+    auto model =
+        Matrixf::Translation(static_cast<float>(x * terrainSettings.tileSize),
+                             static_cast<float>(y * terrainSettings.tileSize),
+                             0);
+
+    // The file is unmapped and the mesh freed when this returns, only the
+    // gpu copy is kept
+    auto tileSize = terrainSettings.tileSize;
+    auto skirt = tileSize / (file->resolution - 1) * step;
+    auto min = btVector3(x * tileSize, y * tileSize, file->minHeight - skirt);
+    auto max =
+        btVector3((x + 1) * tileSize, (y + 1) * tileSize, file->maxHeight);
+
+    auto &ret = meshes[Key{x, y, lod}];
+    ret = make_unique<TileMesh>(tileMesh, model, min, max);
+    ret->lastUsed = frame;
+
+    return ret.get();
+}
+
+void TerrainRenderer::evict() {
+    while (meshes.size() > settings.maxMeshes) {
+        auto oldest = meshes.begin();
+        auto oldestFrame = numeric_limits<uint64_t>::max();
+
+        for (auto it = meshes.begin(); it != meshes.end(); ++it) {
+            if (it->second->lastUsed < oldestFrame) {
+                oldestFrame = it->second->lastUsed;
+                oldest = it;
+            }
+        }
+
+        // Never evict what was drawn this frame, the budget is too small
+        // for the view distance in that case
+        if (oldestFrame == frame) {
+            return;
+        }
+
+        meshes.erase(oldest);
+    }
+}
+
+} // namespace sim
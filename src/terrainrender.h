@@ -0,0 +1,84 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "terrain.h"
+
+#include "matrix.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+
+namespace sim {
+
+class Culling;
+
+//! Draws the terrain tiles around a point, with less detail further away
+//!
+//! Reads the tile files by itself instead of using the tiles in Terrain,
+//! since those are loaded and unloaded from the physics thread. The meshes
+//! only lives on the gpu, and the least recently drawn ones are evicted so
+//! that the memory use is the same however large the map is
+class TerrainRenderer {
+public:
+    struct Settings {
+        double viewDistance = 500;
+
+        //! Distance where the second level of detail starts, every level
+        //! after that starts at twice the distance of the one before
+        double lodDistance = 60;
+
+        //! Each level uses every other sample of the level before
+        int numLods = 4;
+
+        //! Number of tile meshes kept on the gpu
+        size_t maxMeshes = 128;
+
+        //! Limit the number of meshes built per frame to avoid hitches,
+        //! tiles that are waiting are drawn with a coarser mesh if there is
+        //! one
+        size_t maxBuildsPerFrame = 4;
+    };
+
+    TerrainRenderer(Terrain::Settings terrainSettings, Settings settings);
+    TerrainRenderer(Terrain::Settings terrainSettings);
+    ~TerrainRenderer();
+
+    TerrainRenderer(const TerrainRenderer &) = delete;
+    TerrainRenderer &operator=(const TerrainRenderer &) = delete;
+
+    //! Tiles are loaded around center, and only the ones that are inside
+    //! the view are drawn
+    void render(const btVector3 &center,
+                const Matrixf &view,
+                const Matrixf &projection,
+                const Culling &culling);
+
+    //! Number of meshes on the gpu
+    size_t size() const {
+        return meshes.size();
+    }
+
+    const Terrain::Settings terrainSettings;
+    const Settings settings;
+
+private:
+    struct TileMesh;
+
+    //! x, y and level of detail
+    using Key = std::tuple<int, int, int>;
+
+    TileMesh *mesh(int x, int y, int lod, size_t &builds);
+
+    void evict();
+
+    std::map<Key, std::unique_ptr<TileMesh>> meshes;
+    std::set<std::pair<int, int>> missing;
+
+    uint64_t frame = 0;
+};
+
+} // namespace sim
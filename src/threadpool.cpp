@@ -0,0 +1,229 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "threadpool.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+thread_local int workerIndex = -1;
+thread_local const void *workerPool = nullptr;
+
+} // namespace
+
+namespace sim {
+
+ThreadPool::ThreadPool(size_t numThreads) {
+    if (numThreads == 0) {
+        numThreads = max<size_t>(thread::hardware_concurrency(), 1);
+    }
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        queues.push_back(make_unique<Queue>());
+    }
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads.emplace_back([this, i] { work(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    taskAvailable.notify_all();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::push(Task task) {
+    size_t index;
+    if (workerPool == this) {
+        index = static_cast<size_t>(workerIndex);
+    }
+    else {
+        index = nextQueue++ % queues.size();
+    }
+
+    ++unfinished;
+
+    {
+        auto &queue = *queues[index];
+        lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(move(task));
+    }
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        ++queued;
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    if (workerPool == this) {
+        throw logic_error("ThreadPool::wait called from a task of the pool");
+    }
+
+    unique_lock<std::mutex> lock(mutex);
+    tasksFinished.wait(lock, [this] { return unfinished == 0; });
+
+    if (exception) {
+        auto e = exception;
+        exception = nullptr;
+        rethrow_exception(e);
+    }
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             void (*call)(const void *context, size_t index),
+                             const void *context) {
+    if (count == 0) {
+        return;
+    }
+
+    Batch batch;
+    batch.call = call;
+    batch.context = context;
+    batch.count = count;
+
+    if (count > 1) {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            batch.nextBatch = batches;
+            batches = &batch;
+        }
+        taskAvailable.notify_all();
+    }
+
+    run(batch);
+
+    {
+        // No worker joins after the indices has run out, so when the
+        // helpers are gone the batch is done
+        unique_lock<std::mutex> lock(mutex);
+        tasksFinished.wait(lock, [&batch] { return batch.helpers == 0; });
+
+        for (auto link = &batches; *link; link = &(*link)->nextBatch) {
+            if (*link == &batch) {
+                *link = batch.nextBatch;
+                break;
+            }
+        }
+    }
+
+    if (batch.exception) {
+        rethrow_exception(batch.exception);
+    }
+}
+
+void ThreadPool::run(Batch &batch) {
+    for (auto i = batch.next++; i < batch.count; i = batch.next++) {
+        try {
+            batch.call(batch.context, i);
+        }
+        catch (...) {
+            lock_guard<std::mutex> lock(mutex);
+            if (!batch.exception) {
+                batch.exception = current_exception();
+            }
+        }
+    }
+}
+
+ThreadPool::Batch *ThreadPool::findBatch() {
+    for (auto batch = batches; batch; batch = batch->nextBatch) {
+        if (batch->next < batch->count) {
+            return batch;
+        }
+    }
+    return nullptr;
+}
+
+int ThreadPool::currentThreadIndex() const {
+    return workerPool == this ? workerIndex : -1;
+}
+
+bool ThreadPool::pop(size_t index, Task &task) {
+    auto &queue = *queues[index];
+    lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+
+    task = move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --queued;
+    return true;
+}
+
+bool ThreadPool::steal(size_t thief, Task &task) {
+    for (size_t i = 1; i < queues.size(); ++i) {
+        auto &queue = *queues[(thief + i) % queues.size()];
+        lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::work(size_t index) {
+    workerIndex = static_cast<int>(index);
+    workerPool = this;
+
+    Task task;
+
+    while (true) {
+        if (pop(index, task) || steal(index, task)) {
+            try {
+                task();
+            }
+            catch (...) {
+                lock_guard<std::mutex> lock(mutex);
+                if (!exception) {
+                    exception = current_exception();
+                }
+            }
+            task = nullptr;
+
+            if (--unfinished == 0) {
+                lock_guard<std::mutex> lock(mutex);
+                tasksFinished.notify_all();
+            }
+            continue;
+        }
+
+        unique_lock<std::mutex> lock(mutex);
+        taskAvailable.wait(lock, [this] {
+            return queued > 0 || findBatch() || !running;
+        });
+
+        if (auto batch = findBatch()) {
+            ++batch->helpers;
+            lock.unlock();
+
+            run(*batch);
+
+            lock.lock();
+            --batch->helpers;
+            tasksFinished.notify_all();
+            continue;
+        }
+
+        if (!running && queued == 0) {
+            return;
+        }
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,118 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sim {
+
+//! Work stealing thread pool
+//! Every worker has its own queue. Tasks pushed from a worker goes to that
+//! workers queue, and idle workers steals from the other end of the other
+//! queues
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    //! 0 means one thread per hardware thread
+    explicit ThreadPool(size_t numThreads = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void push(Task task);
+
+    //! Block until all pushed tasks are finished
+    //! Rethrows the first exception thrown by any task. Throws
+    //! std::logic_error if called from a task of this pool, since the
+    //! calling task would wait for itself
+    void wait();
+
+    //! Run f(i) for i in [0, count) spread over the pool and wait for it
+    //! The calling thread runs indices as well while it waits, so it can be
+    //! called from inside a task of the same pool, and it only waits for
+    //! its own indices. Nothing is allocated, f is called through a
+    //! pointer. Rethrows the first exception thrown by f
+    template <typename F>
+    void parallelFor(size_t count, const F &f) {
+        parallelFor(
+            count,
+            [](const void *context, size_t i) {
+                (*static_cast<const F *>(context))(i);
+            },
+            &f);
+    }
+
+    void parallelFor(size_t count,
+                     void (*call)(const void *context, size_t index),
+                     const void *context);
+
+    size_t size() const {
+        return threads.size();
+    }
+
+    //! Index of the calling thread if it is a worker of this pool, -1 for
+    //! any other thread
+    int currentThreadIndex() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    //! One call to parallelFor, lives on the stack of the caller and is
+    //! linked into 'batches' while it runs
+    struct Batch {
+        void (*call)(const void *context, size_t index);
+        const void *context;
+        size_t count;
+        std::atomic<size_t> next{0};
+
+        //! Workers that are running indices, changed under mutex
+        size_t helpers = 0;
+        std::exception_ptr exception;
+        Batch *nextBatch = nullptr;
+    };
+
+    //! Run indices until there are none left
+    void run(Batch &batch);
+
+    //! A batch with indices left, or null. Called under mutex
+    Batch *findBatch();
+
+    bool pop(size_t index, Task &task);
+    bool steal(size_t thief, Task &task);
+    void work(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable tasksFinished;
+
+    //! Tasks in queues, changed under mutex when increased
+    std::atomic<size_t> queued{0};
+    //! Tasks that are queued or running
+    std::atomic<size_t> unfinished{0};
+    std::atomic<size_t> nextQueue{0};
+
+    std::exception_ptr exception;
+    bool running = true;
+
+    //! Batches of parallelFor calls that are running, under mutex
+    Batch *batches = nullptr;
+};
+
+} // namespace sim
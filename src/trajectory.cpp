@@ -0,0 +1,150 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "trajectory.h"
+
+#include "LinearMath/btScalar.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+//! Next line that is not empty or a comment
+bool nextLine(istream &stream, string &line, size_t &lineNumber) {
+    while (getline(stream, line)) {
+        ++lineNumber;
+        auto first = line.find_first_not_of(" \t\r");
+        if (first != string::npos && line[first] != '#') {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+string Trajectory::currentPrecision() {
+    return sizeof(btScalar) == sizeof(float) ? "float" : "double";
+}
+
+void Trajectory::save(ostream &stream) const {
+    // Enough digits to read back the same doubles
+    stream << setprecision(numeric_limits<double>::max_digits10);
+    stream << "# precision dt wallTime, then step x y z\n";
+    stream << precision << " " << dt << " " << wallTime << "\n";
+
+    for (auto &sample : samples) {
+        stream << sample.step << " " << sample.x << " " << sample.y << " "
+               << sample.z << "\n";
+    }
+}
+
+void Trajectory::save(const string &filename) const {
+    ofstream file(filename);
+    if (!file) {
+        throw runtime_error("trajectory: could not open " + filename);
+    }
+
+    save(file);
+}
+
+Trajectory Trajectory::load(istream &stream) {
+    Trajectory trajectory;
+
+    string line;
+    size_t lineNumber = 0;
+
+    if (!nextLine(stream, line, lineNumber)) {
+        throw runtime_error("trajectory: missing header");
+    }
+
+    {
+        istringstream ss(line);
+        if (!(ss >> trajectory.precision >> trajectory.dt >>
+              trajectory.wallTime)) {
+            throw runtime_error("trajectory: could not parse header: " + line);
+        }
+    }
+
+    while (nextLine(stream, line, lineNumber)) {
+        istringstream ss(line);
+        Sample sample;
+        if (!(ss >> sample.step >> sample.x >> sample.y >> sample.z)) {
+            throw runtime_error("trajectory: could not parse line " +
+                                to_string(lineNumber) + ": " + line);
+        }
+        trajectory.samples.push_back(sample);
+    }
+
+    return trajectory;
+}
+
+Trajectory Trajectory::load(const string &filename) {
+    ifstream file(filename);
+    if (!file) {
+        throw runtime_error("trajectory: could not open " + filename);
+    }
+
+    return load(file);
+}
+
+TrajectoryDivergence compare(const Trajectory &reference,
+                             const Trajectory &other,
+                             double tolerance) {
+    if (reference.dt != other.dt) {
+        throw runtime_error("trajectory: different time steps");
+    }
+
+    TrajectoryDivergence divergence;
+
+    // Both runs starts at the same step, but one of them may be shorter
+    auto count = min(reference.samples.size(), other.samples.size());
+    divergence.samples = count;
+
+    double sum = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        auto &a = reference.samples[i];
+        auto &b = other.samples[i];
+
+        if (a.step != b.step) {
+            throw runtime_error("trajectory: step " + to_string(a.step) +
+                                " does not match " + to_string(b.step));
+        }
+
+        auto dx = a.x - b.x;
+        auto dy = a.y - b.y;
+        auto dz = a.z - b.z;
+        auto error = sqrt(dx * dx + dy * dy + dz * dz);
+
+        sum += error;
+        divergence.maxError = max(divergence.maxError, error);
+        divergence.finalError = error;
+
+        if (error > tolerance && !divergence.exceedsTolerance) {
+            divergence.exceedsTolerance = true;
+            divergence.firstStepOverTolerance = a.step;
+        }
+    }
+
+    if (count) {
+        divergence.meanError = sum / static_cast<double>(count);
+    }
+
+    if (other.wallTime > 0) {
+        divergence.speedup = reference.wallTime / other.wallTime;
+    }
+
+    return divergence;
+}
+
+} // namespace sim
@@ -0,0 +1,69 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+//! Position of a vehicle at every step of a run, used to compare the
+//! float and double builds of the same scenario
+//! The text format starts with "precision dt wallTime" and then one
+//! "step x y z" line per sample, lines starting with '#' are ignored
+struct Trajectory {
+    struct Sample {
+        size_t step = 0;
+        double x = 0;
+        double y = 0;
+        double z = 0;
+    };
+
+    //! "float" or "double", the precision of btScalar in the build that
+    //! produced the trajectory
+    std::string precision;
+    double dt = 0;
+
+    //! Time it took to simulate the samples
+    double wallTime = 0;
+
+    std::vector<Sample> samples;
+
+    //! Precision of the current build
+    static std::string currentPrecision();
+
+    void save(std::ostream &stream) const;
+    void save(const std::string &filename) const;
+
+    //! Throws std::runtime_error on malformed input
+    static Trajectory load(std::istream &stream);
+    static Trajectory load(const std::string &filename);
+};
+
+//! How far a trajectory has drifted from a reference of the same scenario
+struct TrajectoryDivergence {
+    //! Number of steps that exists in both trajectories
+    size_t samples = 0;
+
+    //! Distances between the positions at the same step
+    double maxError = 0;
+    double meanError = 0;
+    double finalError = 0;
+
+    //! First step where the error is larger than the tolerance
+    bool exceedsTolerance = false;
+    size_t firstStepOverTolerance = 0;
+
+    //! Wall time of the reference divided by the wall time of the other
+    double speedup = 0;
+};
+
+//! Throws std::runtime_error if the time steps differs, since the steps
+//! would not be the same points in time
+TrajectoryDivergence compare(const Trajectory &reference,
+                             const Trajectory &other,
+                             double tolerance);
+
+} // namespace sim
@@ -0,0 +1,120 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "transformsnapshot.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+bool lessObject(const TransformSnapshot::Entry &entry,
+                const btCollisionObject *object) {
+    return entry.object < object;
+}
+
+TransformSnapshot::Entry makeEntry(const btCollisionObject &object) {
+    TransformSnapshot::Entry entry;
+    entry.object = &object;
+    entry.transform = object.getWorldTransform();
+
+    // The broadphase already keeps the boxes up to date
+    if (auto proxy = object.getBroadphaseHandle()) {
+        entry.bounds = {proxy->m_aabbMin, proxy->m_aabbMax};
+    }
+    else {
+        object.getCollisionShape()->getAabb(
+            entry.transform, entry.bounds.min, entry.bounds.max);
+    }
+
+    return entry;
+}
+
+} // namespace
+
+void TransformSnapshot::capture(const btCollisionWorld &world) {
+    auto &objects = world.getCollisionObjectArray();
+
+    entries.resize(static_cast<size_t>(objects.size()));
+
+    for (int i = 0; i < objects.size(); ++i) {
+        entries[static_cast<size_t>(i)] = makeEntry(*objects[i]);
+    }
+
+    sort(entries.begin(), entries.end(), [](auto &a, auto &b) {
+        return a.object < b.object;
+    });
+}
+
+void TransformSnapshot::add(const btCollisionObject &object) {
+    auto it = lower_bound(entries.begin(), entries.end(), &object, lessObject);
+    if (it != entries.end() && it->object == &object) {
+        *it = makeEntry(object);
+        return;
+    }
+
+    entries.insert(it, makeEntry(object));
+}
+
+const TransformSnapshot::Entry *TransformSnapshot::find(
+    const btCollisionObject &object) const {
+    auto it = lower_bound(entries.begin(), entries.end(), &object, lessObject);
+    if (it == entries.end() || it->object != &object) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+btTransform InterpolatedTransforms::operator()(
+    const btCollisionObject &object) const {
+    auto to = current ? current->find(object) : nullptr;
+
+    if (!to) {
+        // The object was added after the last snapshot was taken
+        return btTransform::getIdentity();
+    }
+
+    auto from = (previous && alpha < 1) ? previous->find(object) : nullptr;
+
+    if (!from) {
+        return to->transform;
+    }
+
+    auto a = static_cast<btScalar>(alpha);
+    auto &fromTransform = from->transform;
+    auto &toTransform = to->transform;
+
+    return btTransform(
+        fromTransform.getRotation().slerp(toTransform.getRotation(), a),
+        fromTransform.getOrigin().lerp(toTransform.getOrigin(), a));
+}
+
+bool InterpolatedTransforms::bounds(const btCollisionObject &object,
+                                    btVector3 &min,
+                                    btVector3 &max) const {
+    auto to = current ? current->find(object) : nullptr;
+
+    if (!to) {
+        return false;
+    }
+
+    min = to->bounds.min;
+    max = to->bounds.max;
+
+    auto from = (previous && alpha < 1) ? previous->find(object) : nullptr;
+
+    if (from) {
+        min.setMin(from->bounds.min);
+        max.setMax(from->bounds.max);
+    }
+
+    return true;
+}
+
+bool InterpolatedTransforms::contains(const btCollisionObject &object) const {
+    return current && current->find(object);
+}
+
+} // namespace sim
@@ -0,0 +1,69 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "btBulletCollisionCommon.h"
+
+#include <vector>
+
+namespace sim {
+
+//! Copy of the transform of every collision object in a world at one point
+//! in time
+//!
+//! The entries are keyed by the address of the object and sorted by it.
+//! The index of an object in the world changes when other objects are
+//! removed, and the renderer must not read it from the live object while
+//! the physics thread steps
+struct TransformSnapshot {
+    //! World space bounding box, the same that the broadphase uses
+    struct Bounds {
+        btVector3 min;
+        btVector3 max;
+    };
+
+    struct Entry {
+        const btCollisionObject *object;
+        btTransform transform;
+        Bounds bounds;
+    };
+
+    void capture(const btCollisionWorld &world);
+
+    //! Add an object that is not in the world, eg a body that is moved
+    //! along with a vehicle proxy. Call after capture()
+    void add(const btCollisionObject &object);
+
+    //! Null if the object was not captured
+    const Entry *find(const btCollisionObject &object) const;
+
+    std::vector<Entry> entries;
+
+    //! Time in seconds that the snapshot represents
+    double time = 0;
+    size_t step = 0;
+};
+
+//! Transforms interpolated between two consecutive snapshots
+//! This is what the renderer reads instead of the live bodies
+struct InterpolatedTransforms {
+    btTransform operator()(const btCollisionObject &object) const;
+
+    //! Box that contains the object in both snapshots, and therefore
+    //! everywhere in between. Returns false if the object is not in the
+    //! snapshots
+    bool bounds(const btCollisionObject &object,
+                btVector3 &min,
+                btVector3 &max) const;
+
+    //! If the object is in the current snapshot
+    bool contains(const btCollisionObject &object) const;
+
+    const TransformSnapshot *previous = nullptr;
+    const TransformSnapshot *current = nullptr;
+
+    //! 0 means previous and 1 means current
+    double alpha = 1;
+};
+
+} // namespace sim
@@ -0,0 +1,176 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "vecenv.h"
+#include "profiler.h"
+#include "threadpool.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+btTransform startTransform() {
+    btTransform transform;
+    transform.setIdentity();
+    transform.setOrigin({0, 0, -3});
+    return transform;
+}
+
+void copy(const btVector3 &from, float *to) {
+    to[0] = static_cast<float>(from.x());
+    to[1] = static_cast<float>(from.y());
+    to[2] = static_cast<float>(from.z());
+}
+
+void copy(const btQuaternion &from, float *to) {
+    to[0] = static_cast<float>(from.x());
+    to[1] = static_cast<float>(from.y());
+    to[2] = static_cast<float>(from.z());
+    to[3] = static_cast<float>(from.w());
+}
+
+} // namespace
+
+VecEnv::Environment::Environment(const Settings &settings)
+    : vehicle(world.dynamicsWorld.get(), startTransform(), settings.vehicle) {
+    initial.capture(*world.dynamicsWorld);
+}
+
+VecEnv::VecEnv(Settings settings, ThreadPool *pool)
+    : settings(settings)
+    , pool(pool) {
+    if (!settings.count) {
+        throw runtime_error("vector environment needs at least one vehicle");
+    }
+
+    environments.reserve(settings.count);
+    for (size_t i = 0; i < settings.count; ++i) {
+        environments.push_back(make_unique<Environment>(settings));
+    }
+}
+
+VecEnv::~VecEnv() = default;
+
+void VecEnv::reset(const uint8_t *mask, const Observations &observations) {
+    SIM_PROFILE("vecenv reset");
+
+    auto resetOne = [&](size_t i) {
+        if (!mask || mask[i]) {
+            reset(*environments[i]);
+        }
+
+        if (observations.done) {
+            observations.done[i] = 0;
+        }
+        if (observations.truncated) {
+            observations.truncated[i] = 0;
+        }
+
+        observe(i, observations);
+    };
+
+    if (pool) {
+        pool->parallelFor(size(), resetOne);
+    }
+    else {
+        for (size_t i = 0; i < size(); ++i) {
+            resetOne(i);
+        }
+    }
+}
+
+void VecEnv::step(const double *throttle,
+                  const double *steering,
+                  const Observations &observations) {
+    SIM_PROFILE("vecenv step");
+
+    const auto dt = static_cast<btScalar>(settings.dt);
+    const auto minUpright = static_cast<btScalar>(settings.minUpright);
+
+    auto stepOne = [&](size_t i) {
+        auto &environment = *environments[i];
+        auto &vehicle = environment.vehicle;
+
+        vehicle.throttle(throttle[i]);
+        vehicle.steering(steering[i]);
+
+        environment.world.dynamicsWorld->stepSimulation(dt, 1, dt);
+        ++environment.episodeStep;
+
+        auto up = vehicle.frontBody.getWorldTransform().getBasis().getColumn(2);
+        bool tipped = up.z() < minUpright;
+        bool truncated =
+            !tipped && environment.episodeStep >= settings.maxEpisodeSteps;
+
+        if (tipped || truncated) {
+            reset(environment);
+        }
+
+        if (observations.done) {
+            observations.done[i] = tipped || truncated;
+        }
+        if (observations.truncated) {
+            observations.truncated[i] = truncated;
+        }
+
+        observe(i, observations);
+    };
+
+    if (pool) {
+        pool->parallelFor(size(), stepOne);
+    }
+    else {
+        for (size_t i = 0; i < size(); ++i) {
+            stepOne(i);
+        }
+    }
+}
+
+void VecEnv::reset(Environment &environment) {
+    auto &world = *environment.world.dynamicsWorld;
+
+    // Without the old contacts the episode starts from the same state every
+    // time. The broadphase is kept, rebuilding it would allocate
+    environment.initial.restore(world);
+    clearContacts(world);
+    environment.episodeStep = 0;
+}
+
+void VecEnv::observe(size_t i, const Observations &observations) {
+    auto &vehicle = environments[i]->vehicle;
+    auto &front = vehicle.frontBody;
+    auto &transform = front.getWorldTransform();
+
+    if (observations.position) {
+        copy(transform.getOrigin(), observations.position + i * 3);
+    }
+    if (observations.rotation) {
+        copy(transform.getRotation(), observations.rotation + i * 4);
+    }
+    if (observations.linearVelocity) {
+        copy(front.getLinearVelocity(), observations.linearVelocity + i * 3);
+    }
+    if (observations.angularVelocity) {
+        copy(front.getAngularVelocity(), observations.angularVelocity + i * 3);
+    }
+    if (observations.waistAngle) {
+        observations.waistAngle[i] =
+            static_cast<float>(vehicle.waistJoint.getHingeAngle());
+    }
+    if (observations.wheelSpeed) {
+        for (size_t w = 0; w < vehicle.wheels.size(); ++w) {
+            auto &body = vehicle.wheels[w].body;
+
+            // The hinge axis is -x in the frame of the wheel, the same as
+            // in the telemetry
+            auto axis = -body.getWorldTransform().getBasis().getColumn(0);
+            observations.wheelSpeed[i * 4 + w] =
+                static_cast<float>(body.getAngularVelocity().dot(axis));
+        }
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,122 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "vehicle1.h"
+#include "world.h"
+#include "worldstate.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace sim {
+
+class ThreadPool;
+
+//! Many independent environments with one Vehicle1 each, stepped together
+//! for batched rollouts when training controllers
+//!
+//! Every environment has a world of its own, so they can be stepped in
+//! parallel on the thread pool. Actions and observations are arrays with
+//! one value per environment (structure of arrays) owned by the caller,
+//! and the state that a reset goes back to is captured when the
+//! environments are created. The vecenv benchmarks report the allocations
+//! per step after the first episode
+class VecEnv {
+public:
+    struct Settings {
+        size_t count = 16;
+        double dt = 1. / 60.;
+
+        //! Steps before an episode is truncated
+        size_t maxEpisodeSteps = 1000;
+
+        //! The episode ends when the up direction of the front body has a z
+        //! component below this, ie when the vehicle has tipped over
+        double minUpright = .5;
+
+        Vehicle1::Vehicle1Settings vehicle;
+    };
+
+    //! Written for every environment after reset() and step(), fields that
+    //! are null are skipped. Vectors are packed per environment, so the
+    //! position of environment i is position[i * 3] to position[i * 3 + 2]
+    struct Observations {
+        //! Front body, xyz and a quaternion xyzw
+        float *position = nullptr;
+        float *rotation = nullptr;
+
+        //! Front body, xyz
+        float *linearVelocity = nullptr;
+        float *angularVelocity = nullptr;
+
+        //! Waist hinge angle in radians, one per environment
+        float *waistAngle = nullptr;
+
+        //! Radians per second around the axle of each wheel, four per
+        //! environment in the order of Vehicle1::wheels
+        float *wheelSpeed = nullptr;
+
+        //! 1 if the episode ended in this step. The environment is already
+        //! reset, so the rest of the observation is the first of the next
+        //! episode
+        uint8_t *done = nullptr;
+
+        //! 1 if the episode ended because of maxEpisodeSteps and not
+        //! because the vehicle tipped over
+        uint8_t *truncated = nullptr;
+    };
+
+    //! Without a pool everything is stepped on the calling thread
+    VecEnv(Settings settings, ThreadPool *pool = nullptr);
+    ~VecEnv();
+
+    VecEnv(const VecEnv &) = delete;
+    VecEnv &operator=(const VecEnv &) = delete;
+
+    //! Put the environments where mask is not 0 back to their first state,
+    //! all of them if mask is null, and observe every environment
+    void reset(const uint8_t *mask, const Observations &observations);
+
+    //! Apply one throttle and steering value per environment, step all of
+    //! them once and observe. Environments whose episode ends are reset
+    //! directly, without waiting for the rest of the batch
+    void step(const double *throttle,
+              const double *steering,
+              const Observations &observations);
+
+    size_t size() const {
+        return environments.size();
+    }
+
+    //! Steps taken in the current episode of an environment
+    size_t episodeStep(size_t index) const {
+        return environments[index]->episodeStep;
+    }
+
+    Vehicle1 &vehicle(size_t index) {
+        return environments[index]->vehicle;
+    }
+
+    const Settings settings;
+
+private:
+    struct Environment {
+        Environment(const Settings &settings);
+
+        World world;
+        Vehicle1 vehicle;
+        WorldState initial;
+        size_t episodeStep = 0;
+    };
+
+    void reset(Environment &environment);
+    void observe(size_t index, const Observations &observations);
+
+    ThreadPool *pool;
+
+    std::vector<std::unique_ptr<Environment>> environments;
+};
+
+} // namespace sim
@@ -1,204 +1,407 @@
 // Copyright © Mattias Larsson Sköld 2020
 
 #include "vehicle1.h"
-#include "box.h"
+#include "vehicleproxy.h"
 #include "btBulletCollisionCommon.h"
 #include "btBulletDynamicsCommon.h"
-#include "cylinder.h"
+
+#include <algorithm>
 
 using namespace std;
 
+using Settings = sim::Vehicle1::Vehicle1Settings;
+
 namespace {
 
-std::pair<unique_ptr<btRigidBody>, unique_ptr<btCollisionShape>> createBox(
-    btTransform transform, btVector3 halfDims, btScalar mass) {
+btRigidBody::btRigidBodyConstructionInfo bodyInfo(btTransform transform,
+                                                  btCollisionShape &shape,
+                                                  btScalar mass,
+                                                  const btVector3 &inertia) {
+    auto info = btRigidBody::btRigidBodyConstructionInfo(
+        mass, nullptr, &shape, inertia);
+    info.m_startWorldTransform = transform;
+    return info;
+}
 
-    auto shape = make_unique<btBoxShape>(halfDims);
+btVector3 centerPosition(const btTransform &centerGround, const Settings &s) {
+    return centerGround.getOrigin() +
+           btVector3(0, 0, s.axisZOffset + s.wheelRadius);
+}
 
-    btVector3 localInertia;
-    shape->calculateLocalInertia(mass, localInertia);
+btTransform frontTransform(const btTransform &centerGround, const Settings &s) {
+    return btTransform(centerGround.getBasis(),
+                       centerPosition(centerGround, s) + s.frontOffset());
+}
 
-    auto body =
-        make_unique<btRigidBody>(mass, nullptr, shape.get(), localInertia);
+btTransform rearTransform(const btTransform &centerGround, const Settings &s) {
+    return btTransform(centerGround.getBasis(),
+                       centerPosition(centerGround, s) + s.rearOffset());
+}
 
-    body->setWorldTransform(transform);
+btVector3 wheelCenter(const btTransform &centerGround,
+                      const Settings &s,
+                      int side,
+                      bool front) {
+    return centerPosition(centerGround, s) + s.wheelOffset(side, front);
+}
 
-    return {move(body), move(shape)};
+btVector3 localInertia(const btCollisionShape &shape, btScalar mass) {
+    btVector3 inertia;
+    shape.calculateLocalInertia(mass, inertia);
+    return inertia;
 }
 
 } // namespace
 
 namespace sim {
 
-struct Vehicle1::Wheel {
-    Wheel(btDynamicsWorld *world,
-          btVector3 center,
-          btRigidBody &mainBody,
-          double mass,
-          double radius,
-          double width)
-        : world(world)
-        , shape({width, radius, radius})
-        , body(mass, nullptr, &shape, calculateInertia(mass))
-        , constraint(body,
-                     mainBody,
-                     btVector3(0, 0, 0),
-                     center - mainBody.getWorldTransform().getOrigin(),
-                     btVector3(-1, 0, 0),
-                     btVector3(-1, 0, 0))
-        , radius(radius)
-        , width(width) {
-        btTransform transform;
-        transform.setIdentity();
-        transform.setOrigin(center);
-        body.setWorldTransform(transform);
+bool Vehicle1::Vehicle1Settings::set(const std::string &name, double value) {
+    // clang-format off
+    const std::pair<const char *, double Vehicle1Settings::*> members[] = {
+        {"wheelRadius", &Vehicle1Settings::wheelRadius},
+        {"wheelHalfWidth", &Vehicle1Settings::wheelHalfWidth},
+        {"bodyHalfWidth", &Vehicle1Settings::bodyHalfWidth},
+        {"bodyHalfHeight", &Vehicle1Settings::bodyHalfHeight},
+        {"rearBodyHalfLength", &Vehicle1Settings::rearBodyHalfLength},
+        {"frontBodyHalfLength", &Vehicle1Settings::frontBodyHalfLength},
+        {"bucketHalfWidth", &Vehicle1Settings::bucketHalfWidth},
+        {"bucketHalfHeight", &Vehicle1Settings::bucketHalfHeight},
+        {"bucketHalfLength", &Vehicle1Settings::bucketHalfLength},
+        {"bucketWallHalfThickness", &Vehicle1Settings::bucketWallHalfThickness},
+        {"bucketWheight", &Vehicle1Settings::bucketWheight},
+        {"liftScaling", &Vehicle1Settings::liftScaling},
+        {"centerJointOffset", &Vehicle1Settings::centerJointOffset},
+        {"axisZOffset", &Vehicle1Settings::axisZOffset},
+        {"rearAxisYOffset", &Vehicle1Settings::rearAxisYOffset},
+        {"frontAxisYOffset", &Vehicle1Settings::frontAxisYOffset},
+        {"frontWheight", &Vehicle1Settings::frontWheight},
+        {"rearWheight", &Vehicle1Settings::rearWheight},
+        {"wheelWheigt", &Vehicle1Settings::wheelWheigt},
+        {"throttleScaling", &Vehicle1Settings::throttleScaling},
+        {"steeringScaling", &Vehicle1Settings::steeringScaling},
+        {"sleepLinearVelocity", &Vehicle1Settings::sleepLinearVelocity},
+        {"sleepAngularVelocity", &Vehicle1Settings::sleepAngularVelocity},
+    };
+    // clang-format on
+
+    for (auto &member : members) {
+        if (name == member.first) {
+            this->*member.second = value;
+            return true;
+        }
+    }
 
-        world->addRigidBody(&body);
-        world->addConstraint(&constraint);
+    return false;
+}
 
-        body.setFriction(10);
-        body.setActivationState(DISABLE_DEACTIVATION);
-    }
+btVector3 Vehicle1::Vehicle1Settings::frontOffset() const {
+    return btVector3(0, centerJointOffset + frontBodyHalfLength, 0);
+}
 
-    void throttle(double value) {
-        constraint.enableAngularMotor(true, value, 1);
-    }
+btVector3 Vehicle1::Vehicle1Settings::rearOffset() const {
+    return btVector3(0, -centerJointOffset - rearBodyHalfLength, 0);
+}
 
-    ~Wheel() {
-        world->removeConstraint(&constraint);
-        world->removeRigidBody(&body);
-    }
+btVector3 Vehicle1::Vehicle1Settings::wheelOffset(int side, bool front) const {
+    auto y = front ? centerJointOffset + frontBodyHalfLength + frontAxisYOffset
+                   : -centerJointOffset - rearBodyHalfLength + rearAxisYOffset;
 
-    btVector3 calculateInertia(double mass) {
-        btVector3 inertia;
+    return btVector3((bodyHalfWidth + wheelHalfWidth) * side, y, axisZOffset);
+}
 
-        shape.calculateLocalInertia(mass, inertia);
+btVector3 Vehicle1::Vehicle1Settings::bucketOffset() const {
+    return btVector3(0,
+                     frontAxisYOffset + wheelRadius + .25 + bucketHalfLength,
+                     axisZOffset - wheelRadius + bucketHalfHeight + .1);
+}
 
-        return inertia;
-    }
+btVector3 Vehicle1::Vehicle1Settings::liftPivot() const {
+    return btVector3(0, frontBodyHalfLength, bodyHalfHeight);
+}
 
-    void render(const Matrixf &view, const Matrixf &projection) {
-        Matrix<btScalar> model;
-        body.getWorldTransform().getOpenGLMatrix(&model.x1);
-        model *= Matrixd::Scale(width, radius, radius);
-        renderCylinderX(model, view, projection);
-    }
+Vehicle1::Shapes::Shapes(const Vehicle1Settings &s)
+    : front(
+          btVector3(s.bodyHalfWidth, s.frontBodyHalfLength, s.bodyHalfHeight))
+    , rear(btVector3(s.bodyHalfWidth, s.rearBodyHalfLength, s.bodyHalfHeight))
+    , wheel(btVector3(s.wheelHalfWidth, s.wheelRadius, s.wheelRadius))
+    , frontInertia(localInertia(front, s.frontWheight))
+    , rearInertia(localInertia(rear, s.frontWheight))
+    , wheelInertia(localInertia(wheel, s.wheelWheigt))
+    , proxy(false, 2)
+    , proxyMass(static_cast<btScalar>(s.frontWheight * 2 + s.wheelWheigt * 4))
+    , bucketFloor(btVector3(
+          s.bucketHalfWidth, s.bucketHalfLength, s.bucketWallHalfThickness))
+    , bucketBack(btVector3(
+          s.bucketHalfWidth, s.bucketWallHalfThickness, s.bucketHalfHeight))
+    , bucketSide(btVector3(
+          s.bucketWallHalfThickness, s.bucketHalfLength, s.bucketHalfHeight))
+    , bucket(false, 4) {
+    proxy.addChildShape(
+        btTransform(btMatrix3x3::getIdentity(), s.frontOffset()), &front);
+    proxy.addChildShape(
+        btTransform(btMatrix3x3::getIdentity(), s.rearOffset()), &rear);
+    proxy.calculateLocalInertia(proxyMass, proxyInertia);
+
+    auto wall = s.bucketWallHalfThickness;
+    auto side = s.bucketHalfWidth - wall;
+    auto child = [this](btCollisionShape &shape, btVector3 offset) {
+        bucket.addChildShape(
+            btTransform(btMatrix3x3::getIdentity(), offset), &shape);
+    };
+
+    child(bucketFloor, btVector3(0, 0, wall - s.bucketHalfHeight));
+    child(bucketBack, btVector3(0, wall - s.bucketHalfLength, 0));
+    child(bucketSide, btVector3(-side, 0, 0));
+    child(bucketSide, btVector3(side, 0, 0));
+    bucket.calculateLocalInertia(static_cast<btScalar>(s.bucketWheight),
+                                 bucketInertia);
+}
 
-    btDynamicsWorld *world;
-    btCylinderShapeX shape;
-    btRigidBody body;
-    btHingeConstraint constraint;
-    double radius;
-    double width;
-};
+Vehicle1::Wheel::Wheel(btVector3 center,
+                       btRigidBody &mainBody,
+                       btCollisionShape &shape,
+                       double mass,
+                       const btVector3 &inertia,
+                       double radius,
+                       double width)
+    : body(bodyInfo(btTransform(btMatrix3x3::getIdentity(), center),
+                    shape,
+                    mass,
+                    inertia))
+    , constraint(body,
+                 mainBody,
+                 btVector3(0, 0, 0),
+                 center - mainBody.getWorldTransform().getOrigin(),
+                 btVector3(-1, 0, 0),
+                 btVector3(-1, 0, 0))
+    , radius(radius)
+    , width(width) {
+    body.setFriction(10);
+}
 
 Vehicle1::Vehicle1(btDynamicsWorld *world,
                    btTransform centerGround,
                    Vehicle1::Vehicle1Settings s)
-    : settings(s) {
-
-    auto centerPosition = centerGround.getOrigin() +
-                          btVector3(0, 0, s.axisZOffset + s.wheelRadius);
-
-    {
-        auto transform = btTransform(
-            centerGround.getBasis(),
-            centerPosition +
-                btVector3(0, s.centerJointOffset + s.frontBodyHalfLength, 0));
-        auto [body, shape] = createBox(
-            transform,
-            btVector3(s.bodyHalfWidth, s.frontBodyHalfLength, s.bodyHalfHeight),
-            s.frontWheight);
-        frontBody = move(body);
-        shapes.push_back(move(shape));
-        world->addRigidBody(frontBody.get());
-    }
-
-    {
-        auto transform = btTransform(
-            centerGround.getBasis(),
-            centerPosition +
-                btVector3(0, -s.centerJointOffset - s.rearBodyHalfLength, 0));
-        auto [body, shape] = createBox(
-            transform,
-            btVector3(s.bodyHalfWidth, s.rearBodyHalfLength, s.bodyHalfHeight),
-            s.frontWheight);
-        rearBody = move(body);
-        shapes.push_back(move(shape));
-        world->addRigidBody(rearBody.get());
-    }
-
-    {
-        waistJoint = make_unique<btHingeConstraint>(
-            *frontBody,
-            *rearBody,
-            btVector3{0, -s.centerJointOffset - s.frontBodyHalfLength, 0},
-            btVector3{0, s.centerJointOffset + s.rearBodyHalfLength, 0},
-            btVector3(0, 0, 1),
-            btVector3(0, 0, 1));
-
-        world->addConstraint(waistJoint.get());
-    }
-
-    for (int i : {-1, 1}) {
-        wheels.push_back(make_unique<Wheel>(
-            world,
-            centerPosition +
-                btVector3((s.bodyHalfWidth + s.wheelHalfWidth) * i,
-                          s.centerJointOffset + s.frontBodyHalfLength +
-                              s.frontAxisYOffset,
-                          s.axisZOffset),
-            *frontBody,
-            s.wheelWheigt,
-            s.wheelRadius,
-            s.wheelHalfWidth));
-
-        wheels.push_back(make_unique<Wheel>(
-            world,
-            centerPosition +
-                btVector3((s.bodyHalfWidth + s.wheelHalfWidth) * i,
-                          -s.centerJointOffset - s.rearBodyHalfLength +
-                              s.rearAxisYOffset,
-                          s.axisZOffset),
-            *rearBody,
-            s.wheelWheigt,
-            s.wheelRadius,
-            s.wheelHalfWidth));
-    }
-
-    frontBody->setActivationState(DISABLE_DEACTIVATION);
-    rearBody->setActivationState(DISABLE_DEACTIVATION);
+    : Vehicle1(world, centerGround, s, make_shared<Shapes>(s)) {
+}
+
+Vehicle1::Vehicle1(btDynamicsWorld *world,
+                   btTransform centerGround,
+                   Vehicle1::Vehicle1Settings s,
+                   std::shared_ptr<Shapes> sharedShapes)
+    : settings(s)
+    , shapes(move(sharedShapes))
+    , frontBody(bodyInfo(frontTransform(centerGround, s),
+                         shapes->front,
+                         s.frontWheight,
+                         shapes->frontInertia))
+    , rearBody(bodyInfo(rearTransform(centerGround, s),
+                        shapes->rear,
+                        s.frontWheight,
+                        shapes->rearInertia))
+    , waistJoint(frontBody,
+                 rearBody,
+                 btVector3(0, -s.centerJointOffset - s.frontBodyHalfLength, 0),
+                 btVector3(0, s.centerJointOffset + s.rearBodyHalfLength, 0),
+                 btVector3(0, 0, 1),
+                 btVector3(0, 0, 1))
+    // clang-format off
+    , wheels{{
+          {wheelCenter(centerGround, s, -1, true), frontBody, shapes->wheel,
+           s.wheelWheigt, shapes->wheelInertia, s.wheelRadius,
+           s.wheelHalfWidth},
+          {wheelCenter(centerGround, s, -1, false), rearBody, shapes->wheel,
+           s.wheelWheigt, shapes->wheelInertia, s.wheelRadius,
+           s.wheelHalfWidth},
+          {wheelCenter(centerGround, s, 1, true), frontBody, shapes->wheel,
+           s.wheelWheigt, shapes->wheelInertia, s.wheelRadius,
+           s.wheelHalfWidth},
+          {wheelCenter(centerGround, s, 1, false), rearBody, shapes->wheel,
+           s.wheelWheigt, shapes->wheelInertia, s.wheelRadius,
+           s.wheelHalfWidth},
+      }}
+    // clang-format on
+    , world(world) {
+
+    if (s.bucket) {
+        auto front = frontTransform(centerGround, s);
+        bucketBody = make_unique<btRigidBody>(bodyInfo(
+            btTransform(front.getBasis(),
+                        front.getOrigin() + s.bucketOffset()),
+            shapes->bucket,
+            static_cast<btScalar>(s.bucketWheight),
+            shapes->bucketInertia));
+
+        // The limits keep the bucket from being lowered into the ground or
+        // lifted over the front body. The hinge angle is the front body
+        // relative to the bucket, so lifting makes it negative
+        bucketJoint = make_unique<btHingeConstraint>(
+            frontBody,
+            *bucketBody,
+            s.liftPivot(),
+            s.liftPivot() - s.bucketOffset(),
+            btVector3(1, 0, 0),
+            btVector3(1, 0, 0));
+        bucketJoint->setLimit(-1.2, .3);
+    }
+
+    addToWorld();
+
+    auto linear = static_cast<btScalar>(s.sleepLinearVelocity);
+    auto angular = static_cast<btScalar>(s.sleepAngularVelocity);
+
+    frontBody.setSleepingThresholds(linear, angular);
+    rearBody.setSleepingThresholds(linear, angular);
+    for (auto &wheel : wheels) {
+        wheel.body.setSleepingThresholds(linear, angular);
+    }
+    if (bucketBody) {
+        bucketBody->setSleepingThresholds(linear, angular);
+    }
 }
 
 Vehicle1::~Vehicle1() {
+    if (!proxy) {
+        removeFromWorld();
+    }
 }
 
-void Vehicle1::render(Matrixf view, Matrixf projection) {
-    Matrixd transform;
-    frontBody->getWorldTransform().getOpenGLMatrix(&transform.x1);
-    transform *= Matrixd::Scale(settings.bodyHalfWidth,
-                                settings.frontBodyHalfLength,
-                                settings.bodyHalfHeight);
-    renderBox(transform, view, projection);
+void Vehicle1::addToWorld() {
+    world->addRigidBody(&frontBody);
+    world->addRigidBody(&rearBody);
+    world->addConstraint(&waistJoint);
+
+    for (auto &wheel : wheels) {
+        world->addRigidBody(&wheel.body);
+        world->addConstraint(&wheel.constraint);
+    }
+
+    if (bucketBody) {
+        // The bucket swings close to the front body
+        world->addRigidBody(bucketBody.get());
+        world->addConstraint(bucketJoint.get(), true);
+    }
+}
 
-    rearBody->getWorldTransform().getOpenGLMatrix(&transform.x1);
-    transform *= Matrixd::Scale(settings.bodyHalfWidth,
-                                settings.rearBodyHalfLength,
-                                settings.bodyHalfHeight);
-    renderBox(transform, view, projection);
+void Vehicle1::removeFromWorld() {
+    if (bucketBody) {
+        world->removeConstraint(bucketJoint.get());
+        world->removeRigidBody(bucketBody.get());
+    }
 
     for (auto &wheel : wheels) {
-        wheel->render(view, projection);
+        world->removeConstraint(&wheel.constraint);
+        world->removeRigidBody(&wheel.body);
+    }
+
+    world->removeConstraint(&waistJoint);
+    world->removeRigidBody(&rearBody);
+    world->removeRigidBody(&frontBody);
+}
+
+void Vehicle1::addToSnapshot(TransformSnapshot &snapshot) const {
+    if (proxy) {
+        snapshot.add(frontBody);
+        snapshot.add(rearBody);
+    }
+}
+
+void Vehicle1::useProxy() {
+    // The proxy has nothing that the bucket could be attached to
+    if (proxy || bucketBody) {
+        return;
+    }
+
+    removeFromWorld();
+    proxy = make_unique<VehicleProxy>(world, *this);
+}
+
+void Vehicle1::useFullModel() {
+    if (!proxy) {
+        return;
     }
+
+    proxy->restore();
+    proxy.reset();
+    addToWorld();
 }
 
 void Vehicle1::steering(double value) {
-    waistJoint->enableAngularMotor(true, value * settings.steeringScaling, 10);
+    if (value != 0) {
+        wake();
+    }
+    if (proxy) {
+        proxy->steering(value * settings.steeringScaling);
+        return;
+    }
+    waistJoint.enableAngularMotor(true, value * settings.steeringScaling, 10);
 }
 
 void Vehicle1::throttle(double value) {
+    if (value != 0) {
+        wake();
+    }
+    if (proxy) {
+        proxy->throttle(value * settings.throttleScaling);
+        return;
+    }
     for (auto &wheel : wheels) {
-        wheel->throttle(value * settings.throttleScaling);
+        wheel.throttle(value * settings.throttleScaling);
+    }
+}
+
+void Vehicle1::lift(double value) {
+    if (!bucketJoint) {
+        return;
+    }
+    if (value != 0) {
+        wake();
+    }
+    bucketJoint->enableAngularMotor(true, -value * settings.liftScaling, 10);
+}
+
+bool Vehicle1::isSleeping() const {
+    auto &body = proxy ? proxy->chassis : frontBody;
+    return body.getActivationState() == ISLAND_SLEEPING;
+}
+
+double Vehicle1::jointError() const {
+    if (proxy) {
+        return 0;
+    }
+
+    auto error = [](const btHingeConstraint &hinge) {
+        auto a = hinge.getRigidBodyA().getWorldTransform() *
+                 hinge.getAFrame().getOrigin();
+        auto b = hinge.getRigidBodyB().getWorldTransform() *
+                 hinge.getBFrame().getOrigin();
+        return static_cast<double>(a.distance(b));
+    };
+
+    auto max = error(waistJoint);
+    for (auto &wheel : wheels) {
+        max = std::max(max, error(wheel.constraint));
+    }
+    if (bucketJoint) {
+        max = std::max(max, error(*bucketJoint));
+    }
+
+    return max;
+}
+
+void Vehicle1::wake() {
+    if (proxy) {
+        proxy->chassis.activate();
+        return;
+    }
+
+    frontBody.activate();
+    rearBody.activate();
+    for (auto &wheel : wheels) {
+        wheel.body.activate();
+    }
+    if (bucketBody) {
+        bucketBody->activate();
     }
 }
 
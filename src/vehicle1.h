@@ -2,20 +2,29 @@
 
 #pragma once
 
+#include "BulletCollision/CollisionShapes/btBoxShape.h"
 #include "BulletCollision/CollisionShapes/btCollisionShape.h"
+#include "BulletCollision/CollisionShapes/btCompoundShape.h"
+#include "BulletCollision/CollisionShapes/btCylinderShape.h"
 #include "BulletDynamics/ConstraintSolver/btHingeConstraint.h"
 #include "BulletDynamics/Dynamics/btDynamicsWorld.h"
 #include "BulletDynamics/Dynamics/btRigidBody.h"
 #include "matrix.h"
+#include "transformsnapshot.h"
 
+#include <array>
 #include <memory>
-#include <vector>
+#include <string>
 
 namespace sim {
 
-class Vehicle1 {
-    struct Wheel;
+class Culling;
+class RenderBatch;
+class VehicleProxy;
 
+//! All bodies, joints and wheels are stored inline so that a vehicle is one
+//! contiguous allocation, and a container of vehicles keeps them together
+class Vehicle1 {
 public:
     struct Vehicle1Settings {
         double wheelRadius = 1.5;
@@ -28,6 +37,13 @@ public:
         double bucketHalfWidth = bodyHalfWidth + wheelHalfWidth * 2;
         double bucketHalfHeight = bodyHalfHeight;
         double bucketHalfLength = 2;
+        double bucketWallHalfThickness = .1;
+
+        //! Build the bucket in front of the front body, on a hinge that
+        //! lifts it. Off by default
+        bool bucket = false;
+        double bucketWheight = .5;
+        double liftScaling = 1;
 
         double centerJointOffset = 1.5;
 
@@ -41,30 +57,184 @@ public:
 
         double throttleScaling = 4;
         double steeringScaling = 2;
+
+        //! A vehicle without throttle or steering that moves slower than
+        //! this for a while is put to sleep, 0 keeps it awake all the time
+        double sleepLinearVelocity = .2;
+        double sleepAngularVelocity = .2;
+
+        //! Set a setting by its member name, used for parameter sweeps
+        //! Returns false if there is no setting with that name
+        bool set(const std::string &name, double value);
+
+        //! Positions relative to the waist joint, with the vehicle facing
+        //! along y and a straight waist
+        btVector3 frontOffset() const;
+        btVector3 rearOffset() const;
+        btVector3 wheelOffset(int side, bool front) const;
+
+        //! Center of the bucket relative to the front body, with the lift
+        //! hinge at rest. The bottom is just above the ground and the back
+        //! clears the front wheels
+        btVector3 bucketOffset() const;
+
+        //! Lift hinge on the top of the front end of the front body,
+        //! relative to the front body
+        btVector3 liftPivot() const;
+    };
+
+    //! Collision shapes and inertia that only depends on the settings
+    //! Can be shared between all vehicles with the same dimensions and masses
+    struct Shapes {
+        Shapes(const Vehicle1Settings &settings);
+
+        Shapes(const Shapes &) = delete;
+        Shapes &operator=(const Shapes &) = delete;
+
+        btBoxShape front;
+        btBoxShape rear;
+        btCylinderShapeX wheel;
+
+        btVector3 frontInertia;
+        btVector3 rearInertia;
+        btVector3 wheelInertia;
+
+        //! Both halves in one shape with the origin at the waist joint, and
+        //! the mass of the whole vehicle, for VehicleProxy
+        btCompoundShape proxy;
+        btScalar proxyMass;
+        btVector3 proxyInertia;
+
+        //! Open at the top and the front, the floor, back and sides are
+        //! boxes in one compound shape
+        btBoxShape bucketFloor;
+        btBoxShape bucketBack;
+        btBoxShape bucketSide;
+        btCompoundShape bucket;
+        btVector3 bucketInertia;
+    };
+
+    struct Wheel {
+        Wheel(btVector3 center,
+              btRigidBody &mainBody,
+              btCollisionShape &shape,
+              double mass,
+              const btVector3 &inertia,
+              double radius,
+              double width);
+
+        void throttle(double value) {
+            constraint.enableAngularMotor(true, value, 1);
+        }
+
+        //! Defined in vehicle1render.cpp
+        void render(RenderBatch &batch,
+                    const InterpolatedTransforms &transforms);
+
+        btRigidBody body;
+        btHingeConstraint constraint;
+        double radius;
+        double width;
     };
 
     Vehicle1(btDynamicsWorld *,
              btTransform center,
              struct Vehicle1Settings settings);
 
-    ~Vehicle1();
+    //! Use shapes shared with other vehicles, they need to be created with
+    //! the same settings
+    Vehicle1(btDynamicsWorld *,
+             btTransform center,
+             struct Vehicle1Settings settings,
+             std::shared_ptr<Shapes> shapes);
 
-    void render(Matrixf view, Matrixf projection);
+    //! Removes everything from the world
+    ~Vehicle1();
 
+    Vehicle1(const Vehicle1 &) = delete;
+    Vehicle1 &operator=(const Vehicle1 &) = delete;
+
+    //! Queue the vehicle for drawing, transforms are read from the snapshot
+    //! and not from the live bodies. Nothing is queued if the vehicle is
+    //! outside the view, and vehicles that are small on screen are drawn as
+    //! a single box
+    //! Defined in vehicle1render.cpp to keep the physics free from graphics
+    void render(RenderBatch &batch,
+                const InterpolatedTransforms &transforms,
+                const Culling &culling);
+
+    //! Box around all bodies in the snapshots, false if it is not in them
+    //! Defined in vehicle1render.cpp
+    bool bounds(const InterpolatedTransforms &transforms,
+                btVector3 &min,
+                btVector3 &max) const;
+
+    //! With a proxy the front and rear body are outside the world but
+    //! follow the proxy, add them to the snapshot so that the vehicle is
+    //! drawn from the snapshot alone. Call on the physics thread after
+    //! TransformSnapshot::capture()
+    void addToSnapshot(TransformSnapshot &snapshot) const;
+
+    //! Any input other than 0 wakes the vehicle up and keeps it awake
     void steering(double value);
-
     void throttle(double value);
 
-    std::unique_ptr<btRigidBody> frontBody;
-    std::unique_ptr<btRigidBody> rearBody;
-    std::unique_ptr<btRigidBody> bucketBody;
+    //! Radians per second that the bucket is lifted, negative lowers it.
+    //! Does nothing without a bucket
+    void lift(double value);
 
-    std::unique_ptr<btHingeConstraint> waistJoint;
+    //! Activate every body at once, so that no part of the vehicle is
+    //! stepped while the rest is sleeping
+    void wake();
 
-    std::vector<std::unique_ptr<Wheel>> wheels;
-    std::vector<std::unique_ptr<btCollisionShape>> shapes;
+    //! The bodies are connected by the hinges, so bullet puts them in the
+    //! same island and they fall asleep together. Contact with anything
+    //! that moves wakes the whole island
+    bool isSleeping() const;
+
+    //! Take the bodies and hinges out of the world and simulate the vehicle
+    //! with a VehicleProxy instead. Position and velocity are carried over
+    //! both ways. Does nothing if it already is in that mode, and vehicles
+    //! with a bucket always use the full model
+    void useProxy();
+    void useFullModel();
+
+    bool isProxy() const {
+        return proxy != nullptr;
+    }
+
+    //! Null when the full model is used
+    const VehicleProxy *currentProxy() const {
+        return proxy.get();
+    }
+
+    //! Largest distance between the two sides of any joint, how far the
+    //! solver has let the hinges drift apart. 0 for the proxy
+    double jointError() const;
 
     Vehicle1Settings settings;
+
+    std::shared_ptr<Shapes> shapes;
+
+    btRigidBody frontBody;
+    btRigidBody rearBody;
+    std::unique_ptr<btRigidBody> bucketBody;
+
+    btHingeConstraint waistJoint;
+
+    //! Between the front body and the bucket, null without a bucket
+    std::unique_ptr<btHingeConstraint> bucketJoint;
+
+    //! Front left, rear left, front right, rear right
+    std::array<Wheel, 4> wheels;
+
+private:
+    void addToWorld();
+    void removeFromWorld();
+
+    btDynamicsWorld *world;
+
+    std::unique_ptr<VehicleProxy> proxy;
 };
 
 } // namespace sim
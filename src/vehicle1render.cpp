@@ -0,0 +1,104 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "culling.h"
+#include "renderbatch.h"
+#include "vehicle1.h"
+
+namespace sim {
+
+void Vehicle1::Wheel::render(RenderBatch &batch,
+                             const InterpolatedTransforms &transforms) {
+    Matrix<btScalar> model;
+    transforms(body).getOpenGLMatrix(&model.x1);
+    model *= Matrixd::Scale(width, radius, radius);
+    batch.cylinderX(model);
+}
+
+void Vehicle1::render(RenderBatch &batch,
+                      const InterpolatedTransforms &transforms,
+                      const Culling &culling) {
+    btVector3 min, max;
+    if (!bounds(transforms, min, max) || !culling.visible(min, max)) {
+        return;
+    }
+
+    if (!culling.isDetailed(min, max)) {
+        // Only a few pixels, one box is enough to show where it is
+        auto center = (min + max) / 2;
+        auto halfExtents = (max - min) / 2;
+        batch.box(Matrixd::Translation(center.x(), center.y(), center.z()) *
+                  Matrixd::Scale(
+                      halfExtents.x(), halfExtents.y(), halfExtents.z()));
+        return;
+    }
+
+    Matrix<btScalar> transform;
+
+    transforms(frontBody).getOpenGLMatrix(&transform.x1);
+    transform *= Matrixd::Scale(settings.bodyHalfWidth,
+                                settings.frontBodyHalfLength,
+                                settings.bodyHalfHeight);
+    batch.box(transform);
+
+    transforms(rearBody).getOpenGLMatrix(&transform.x1);
+    transform *= Matrixd::Scale(settings.bodyHalfWidth,
+                                settings.rearBodyHalfLength,
+                                settings.bodyHalfHeight);
+    batch.box(transform);
+
+    // The proxy is drawn as both halves without wheels. Whether there is
+    // one is read from the snapshot, the proxy itself belongs to the
+    // physics thread
+    if (!transforms.contains(wheels.front().body)) {
+        return;
+    }
+
+    for (auto &wheel : wheels) {
+        wheel.render(batch, transforms);
+    }
+
+    if (bucketBody) {
+        btTransform bucket = transforms(*bucketBody);
+        auto &shape = shapes->bucket;
+
+        for (int i = 0; i < shape.getNumChildShapes(); ++i) {
+            auto child =
+                static_cast<const btBoxShape *>(shape.getChildShape(i));
+            auto halfExtents = child->getHalfExtentsWithMargin();
+
+            (bucket * shape.getChildTransform(i))
+                .getOpenGLMatrix(&transform.x1);
+            transform *= Matrixd::Scale(
+                halfExtents.x(), halfExtents.y(), halfExtents.z());
+            batch.box(transform);
+        }
+    }
+}
+
+bool Vehicle1::bounds(const InterpolatedTransforms &transforms,
+                      btVector3 &min,
+                      btVector3 &max) const {
+    if (!transforms.bounds(frontBody, min, max)) {
+        return false;
+    }
+
+    auto add = [&](const btCollisionObject &object) {
+        btVector3 objectMin, objectMax;
+        if (transforms.bounds(object, objectMin, objectMax)) {
+            min.setMin(objectMin);
+            max.setMax(objectMax);
+        }
+    };
+
+    add(rearBody);
+    for (auto &wheel : wheels) {
+        add(wheel.body);
+    }
+    if (bucketBody) {
+        add(*bucketBody);
+    }
+
+    return true;
+}
+
+} // namespace sim
@@ -0,0 +1,361 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "vehicledefinition.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+//! Reads the words of one line, errors include the line
+class LineReader {
+public:
+    LineReader(const string &line, size_t lineNumber)
+        : stream(line), line(line), lineNumber(lineNumber) {
+    }
+
+    //! Empty at the end of the line
+    string word() {
+        string word;
+        stream >> word;
+        return word;
+    }
+
+    string name() {
+        auto name = word();
+        if (name.empty()) {
+            fail("missing name");
+        }
+        return name;
+    }
+
+    btScalar number() {
+        double value;
+        if (!(stream >> value)) {
+            fail("expected number");
+        }
+        return static_cast<btScalar>(value);
+    }
+
+    btVector3 vector() {
+        auto x = number();
+        auto y = number();
+        auto z = number();
+        return {x, y, z};
+    }
+
+    [[noreturn]] void fail(const string &message) const {
+        throw runtime_error("vehicle definition: " + message + " on line " +
+                            to_string(lineNumber) + ": " + line);
+    }
+
+private:
+    istringstream stream;
+    const string &line;
+    size_t lineNumber;
+};
+
+class Parser {
+public:
+    Parser(VehicleDefinition &definition)
+        : definition(definition) {
+    }
+
+    void parse(const string &line, size_t lineNumber) {
+        LineReader reader(line, lineNumber);
+
+        auto kind = reader.word();
+
+        if (kind == "sleep") {
+            definition.sleepLinearVelocity = reader.number();
+            definition.sleepAngularVelocity = reader.number();
+        }
+        else if (kind == "body") {
+            parseBody(reader);
+        }
+        else if (kind == "hinge") {
+            parseHinge(reader);
+        }
+        else if (kind == "wheel") {
+            parseWheel(reader);
+        }
+        else {
+            reader.fail("unknown part '" + kind + "'");
+        }
+    }
+
+private:
+    //! The keywords that can come in any order after the name
+    void parseBodyProperties(LineReader &reader,
+                             VehicleDefinition::Body &body,
+                             VehicleDefinition::Motor *motor) {
+        bool hasPosition = false;
+
+        for (auto word = reader.word(); !word.empty(); word = reader.word()) {
+            if (word == "mass") {
+                body.mass = reader.number();
+            }
+            else if (word == "position") {
+                body.position = reader.vector();
+                hasPosition = true;
+            }
+            else if (word == "friction") {
+                body.friction = reader.number();
+            }
+            else if (word == "motor" && motor) {
+                *motor = parseMotor(reader);
+            }
+            else {
+                reader.fail("unexpected '" + word + "'");
+            }
+        }
+
+        if (!hasPosition) {
+            reader.fail("missing position");
+        }
+    }
+
+    VehicleDefinition::Motor parseMotor(LineReader &reader) {
+        VehicleDefinition::Motor motor;
+        motor.input = input(reader.name());
+        motor.scale = reader.number();
+        motor.maxImpulse = reader.number();
+        return motor;
+    }
+
+    void parseBody(LineReader &reader) {
+        VehicleDefinition::Body body;
+        body.name = uniqueBodyName(reader);
+
+        auto shape = reader.word();
+        if (shape == "box") {
+            body.shape = VehicleDefinition::Box;
+            body.halfExtents = reader.vector();
+        }
+        else if (shape == "cylinderx") {
+            body.shape = VehicleDefinition::CylinderX;
+            auto halfWidth = reader.number();
+            auto radius = reader.number();
+            body.halfExtents = {halfWidth, radius, radius};
+        }
+        else {
+            reader.fail("unknown shape '" + shape + "'");
+        }
+
+        parseBodyProperties(reader, body, nullptr);
+        add(move(body));
+    }
+
+    void parseHinge(LineReader &reader) {
+        VehicleDefinition::Hinge hinge;
+        hinge.name = reader.name();
+        hinge.bodyA = bodyIndex(reader, reader.name());
+        hinge.bodyB = bodyIndex(reader, reader.name());
+
+        btVector3 pivot;
+        bool hasPivot = false;
+        bool hasAxis = false;
+
+        for (auto word = reader.word(); !word.empty(); word = reader.word()) {
+            if (word == "pivot") {
+                pivot = reader.vector();
+                hasPivot = true;
+            }
+            else if (word == "axis") {
+                hinge.axis = reader.vector();
+                hasAxis = true;
+            }
+            else if (word == "motor") {
+                hinge.motor = parseMotor(reader);
+            }
+            else {
+                reader.fail("unexpected '" + word + "'");
+            }
+        }
+
+        if (!hasPivot || !hasAxis) {
+            reader.fail("hinge needs pivot and axis");
+        }
+
+        if (hinge.axis.length2() == 0) {
+            reader.fail("axis can not be zero");
+        }
+        hinge.axis.normalize();
+
+        hinge.pivotA = pivot - definition.bodies[hinge.bodyA].position;
+        hinge.pivotB = pivot - definition.bodies[hinge.bodyB].position;
+
+        definition.hinges.push_back(hinge);
+    }
+
+    void parseWheel(LineReader &reader) {
+        VehicleDefinition::Body body;
+        body.name = uniqueBodyName(reader);
+        body.shape = VehicleDefinition::CylinderX;
+
+        auto parent = bodyIndex(reader, reader.name());
+
+        btScalar radius = 0;
+        btScalar halfWidth = 0;
+
+        // Radius and width comes first so that the rest can be shared with
+        // bodies
+        for (int i = 0; i < 2; ++i) {
+            auto word = reader.word();
+            if (word == "radius") {
+                radius = reader.number();
+            }
+            else if (word == "halfwidth") {
+                halfWidth = reader.number();
+            }
+            else {
+                reader.fail("expected radius and halfwidth");
+            }
+        }
+
+        body.halfExtents = {halfWidth, radius, radius};
+
+        VehicleDefinition::Hinge hinge;
+        hinge.name = body.name;
+        parseBodyProperties(reader, body, &hinge.motor);
+
+        // Same as Vehicle1::Wheel, the wheel is the first body
+        hinge.bodyA = definition.bodies.size();
+        hinge.bodyB = parent;
+        hinge.pivotA = {0, 0, 0};
+        hinge.pivotB = body.position - definition.bodies[parent].position;
+        hinge.axis = {-1, 0, 0};
+
+        add(move(body));
+        definition.hinges.push_back(hinge);
+    }
+
+    string uniqueBodyName(LineReader &reader) {
+        auto name = reader.name();
+        if (definition.body(name) >= 0) {
+            reader.fail("there is already a body named " + name);
+        }
+        return name;
+    }
+
+    size_t bodyIndex(LineReader &reader, const string &name) {
+        auto index = definition.body(name);
+        if (index < 0) {
+            reader.fail("no body named " + name);
+        }
+        return static_cast<size_t>(index);
+    }
+
+    int input(const string &name) {
+        auto index = definition.input(name);
+        if (index >= 0) {
+            return index;
+        }
+
+        definition.inputs.push_back(name);
+        return static_cast<int>(definition.inputs.size() - 1);
+    }
+
+    //! Creates the shape and calculates the inertia, which is what makes
+    //! the vehicles cheap to spawn
+    void add(VehicleDefinition::Body body) {
+        if (body.shape == VehicleDefinition::Box) {
+            body.collisionShape = make_unique<btBoxShape>(body.halfExtents);
+        }
+        else {
+            body.collisionShape =
+                make_unique<btCylinderShapeX>(body.halfExtents);
+        }
+
+        body.inertia = {0, 0, 0};
+        if (body.mass != 0) {
+            body.collisionShape->calculateLocalInertia(body.mass,
+                                                       body.inertia);
+        }
+
+        definition.bodies.push_back(move(body));
+    }
+
+    VehicleDefinition &definition;
+};
+
+} // namespace
+
+shared_ptr<const VehicleDefinition> VehicleDefinition::load(istream &stream) {
+    auto definition = make_shared<VehicleDefinition>();
+    Parser parser(*definition);
+
+    string line;
+    for (size_t lineNumber = 1; getline(stream, line); ++lineNumber) {
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') {
+            continue;
+        }
+
+        parser.parse(line, lineNumber);
+    }
+
+    if (definition->bodies.empty()) {
+        throw runtime_error("vehicle definition: no bodies");
+    }
+
+    return definition;
+}
+
+shared_ptr<const VehicleDefinition> VehicleDefinition::load(
+    const string &filename) {
+    ifstream file(filename);
+    if (!file) {
+        throw runtime_error("vehicle definition: could not open " + filename);
+    }
+
+    return load(file);
+}
+
+int VehicleDefinition::input(const string &name) const {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (inputs[i] == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+int VehicleDefinition::body(const string &name) const {
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        if (bodies[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+shared_ptr<const VehicleDefinition> VehicleDefinitionCache::get(
+    const string &filename) {
+    lock_guard<std::mutex> lock(mutex);
+
+    auto &definition = definitions[filename];
+    if (!definition) {
+        try {
+            definition = VehicleDefinition::load(filename);
+        }
+        catch (...) {
+            definitions.erase(filename);
+            throw;
+        }
+    }
+
+    return definition;
+}
+
+size_t VehicleDefinitionCache::size() const {
+    lock_guard<std::mutex> lock(mutex);
+    return definitions.size();
+}
+
+} // namespace sim
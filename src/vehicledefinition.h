@@ -0,0 +1,107 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "btBulletCollisionCommon.h"
+
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+//! Bodies, hinges and motors of a vehicle, read from a text file
+//!
+//! Everything that is the same for every copy of the vehicle, the
+//! collision shapes, the inertia and the hinge frames, is computed once
+//! when the file is loaded. One line per part, '#' starts a comment:
+//!
+//!     sleep <linear> <angular>
+//!     body <name> box <hx> <hy> <hz> mass <m> position <x> <y> <z>
+//!         [friction <f>]
+//!     body <name> cylinderx <half width> <radius> mass <m> position ...
+//!     hinge <name> <body a> <body b> pivot <x> <y> <z> axis <x> <y> <z>
+//!         [motor <input> <scale> <max impulse>]
+//!     wheel <name> <parent> radius <r> halfwidth <w> mass <m>
+//!         position <x> <y> <z> [friction <f>] [motor ...]
+//!
+//! Positions are relative to the point on the ground under the vehicle,
+//! and bodies start out axis aligned. A wheel is a cylinder along x with a
+//! hinge to its parent at its center. Motors turn with the value of the
+//! named input times scale, see ArticulatedVehicle::control
+struct VehicleDefinition {
+    enum Shape {
+        Box,
+        CylinderX,
+    };
+
+    struct Body {
+        std::string name;
+        Shape shape = Box;
+        btVector3 halfExtents;
+        btScalar mass = 1;
+        btScalar friction = .5;
+        btVector3 position;
+
+        std::unique_ptr<btCollisionShape> collisionShape;
+        btVector3 inertia;
+    };
+
+    struct Motor {
+        //! Index in inputs, -1 for hinges without motor
+        int input = -1;
+        double scale = 1;
+        double maxImpulse = 1;
+    };
+
+    struct Hinge {
+        std::string name;
+        size_t bodyA = 0;
+        size_t bodyB = 0;
+
+        //! In the local frames of the bodies
+        btVector3 pivotA;
+        btVector3 pivotB;
+        btVector3 axis;
+
+        Motor motor;
+    };
+
+    //! Throws std::runtime_error on malformed input
+    static std::shared_ptr<const VehicleDefinition> load(std::istream &stream);
+    static std::shared_ptr<const VehicleDefinition> load(
+        const std::string &filename);
+
+    //! Index of a named input, -1 if no motor uses it
+    int input(const std::string &name) const;
+
+    //! Index of a named body, -1 if there is none
+    int body(const std::string &name) const;
+
+    std::vector<Body> bodies;
+    std::vector<Hinge> hinges;
+    std::vector<std::string> inputs;
+
+    btScalar sleepLinearVelocity = .2;
+    btScalar sleepAngularVelocity = .2;
+};
+
+//! Definitions that are already loaded, by filename
+//! Safe to use from several threads
+class VehicleDefinitionCache {
+public:
+    //! Loads the file the first time, throws std::runtime_error on errors
+    std::shared_ptr<const VehicleDefinition> get(const std::string &filename);
+
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, std::shared_ptr<const VehicleDefinition>>
+        definitions;
+};
+
+} // namespace sim
@@ -0,0 +1,247 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "vehicleproxy.h"
+#include "vehicle1.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace sim {
+
+namespace {
+
+//! Side and front of every wheel, in the same order as Vehicle1::wheels
+const pair<int, bool> wheelPlacements[] = {
+    {-1, true}, {-1, false}, {1, true}, {1, false}};
+
+//! Velocity of a point on a body
+btVector3 pointVelocity(const btVector3 &linear,
+                        const btVector3 &angular,
+                        const btVector3 &center,
+                        const btVector3 &point) {
+    return linear + angular.cross(point - center);
+}
+
+btRigidBody::btRigidBodyConstructionInfo chassisInfo(const Vehicle1 &vehicle) {
+    auto &shapes = *vehicle.shapes;
+
+    // The proxy has its origin at the waist joint
+    auto &front = vehicle.frontBody.getWorldTransform();
+    auto transform = front * btTransform(btMatrix3x3::getIdentity(),
+                                         -vehicle.settings.frontOffset());
+
+    btRigidBody::btRigidBodyConstructionInfo info(
+        shapes.proxyMass, nullptr, &shapes.proxy, shapes.proxyInertia);
+    info.m_startWorldTransform = transform;
+    info.m_linearSleepingThreshold =
+        static_cast<btScalar>(vehicle.settings.sleepLinearVelocity);
+    info.m_angularSleepingThreshold =
+        static_cast<btScalar>(vehicle.settings.sleepAngularVelocity);
+
+    return info;
+}
+
+} // namespace
+
+VehicleProxy::VehicleProxy(btDynamicsWorld *world, Vehicle1 &vehicle)
+    : VehicleProxy(world, vehicle, Settings{}) {
+}
+
+VehicleProxy::VehicleProxy(btDynamicsWorld *world,
+                           Vehicle1 &vehicle,
+                           Settings settings)
+    : chassis(chassisInfo(vehicle))
+    , world(world)
+    , vehicle(vehicle)
+    , settings(settings)
+    , raycaster(world)
+    , raycastVehicle(btRaycastVehicle::btVehicleTuning{},
+                     &chassis,
+                     &raycaster) {
+    auto &s = vehicle.settings;
+    auto &front = vehicle.frontBody;
+
+    chassis.setLinearVelocity(
+        pointVelocity(front.getLinearVelocity(),
+                      front.getAngularVelocity(),
+                      front.getWorldTransform().getOrigin(),
+                      chassis.getWorldTransform().getOrigin()));
+    chassis.setAngularVelocity(front.getAngularVelocity());
+
+    // Lets Fleet find the vehicle from contacts with the proxy
+    chassis.setUserPointer(&vehicle);
+
+    waistAngle = clamp<double>(vehicle.waistJoint.getHingeAngle(),
+                               -settings.maxWaistAngle,
+                               settings.maxWaistAngle);
+
+    btRaycastVehicle::btVehicleTuning tuning;
+    tuning.m_suspensionStiffness =
+        static_cast<btScalar>(settings.suspensionStiffness);
+    tuning.m_suspensionCompression =
+        static_cast<btScalar>(settings.suspensionCompression);
+    tuning.m_suspensionDamping =
+        static_cast<btScalar>(settings.suspensionDamping);
+    tuning.m_frictionSlip = static_cast<btScalar>(settings.frictionSlip);
+
+    // Right, up and forward is x, z and y, which is the default. The wheels
+    // roll forward along up cross axle, so the axle points to the right
+    raycastVehicle.setCoordinateSystem(0, 2, 1);
+
+    // Hanging so that an unloaded wheel is where the wheel of the full
+    // model is
+    auto restLength = static_cast<btScalar>(settings.suspensionRestLength);
+
+    for (auto &wheel : wheelPlacements) {
+        auto connection = s.wheelOffset(wheel.first, wheel.second) +
+                          btVector3(0, 0, restLength);
+        raycastVehicle.addWheel(connection,
+                                btVector3(0, 0, -1),
+                                btVector3(1, 0, 0),
+                                restLength,
+                                static_cast<btScalar>(s.wheelRadius),
+                                tuning,
+                                wheel.second);
+    }
+
+    world->addRigidBody(&chassis);
+    world->addAction(this);
+}
+
+VehicleProxy::~VehicleProxy() {
+    world->removeAction(this);
+    world->removeRigidBody(&chassis);
+}
+
+void VehicleProxy::updateAction(btCollisionWorld *, btScalar dt) {
+    follow();
+
+    if (!chassis.isActive()) {
+        waistVelocity = 0;
+        return;
+    }
+
+    double previousAngle = waistAngle;
+    double angle = clamp(previousAngle + steeringValue * dt,
+                         -settings.maxWaistAngle,
+                         settings.maxWaistAngle);
+    waistAngle = angle;
+    waistVelocity = (angle - previousAngle) / dt;
+
+    // An articulated vehicle turns around the waist, which is about the
+    // same as both axles steering half of the waist angle each
+    auto half = static_cast<btScalar>(angle / 2);
+    for (int i = 0; i < raycastVehicle.getNumWheels(); ++i) {
+        auto front = raycastVehicle.getWheelInfo(i).m_bFrontWheel;
+        raycastVehicle.setSteeringValue(front ? half : -half, i);
+    }
+
+    // Drive towards the speed that the wheel motors would give
+    auto target = throttleValue * vehicle.settings.wheelRadius;
+    auto speed = static_cast<double>(
+        chassis.getLinearVelocity().dot(raycastVehicle.getForwardVector()));
+    auto acceleration = clamp(settings.speedGain * (target - speed),
+                              -settings.maxAcceleration,
+                              settings.maxAcceleration);
+    auto force = static_cast<btScalar>(acceleration * chassis.getMass() /
+                                       raycastVehicle.getNumWheels());
+
+    for (int i = 0; i < raycastVehicle.getNumWheels(); ++i) {
+        raycastVehicle.applyEngineForce(force, i);
+    }
+
+    raycastVehicle.updateVehicle(dt);
+}
+
+btTransform VehicleProxy::halfTransform(const btTransform &chassis,
+                                        bool front) const {
+    if (front) {
+        return chassis;
+    }
+
+    // A positive hinge angle turns the rear clockwise seen from above
+    return chassis *
+           btTransform(btQuaternion(btVector3(0, 0, 1),
+                                    static_cast<btScalar>(-waistAngle)));
+}
+
+btVector3 VehicleProxy::halfAngularVelocity(bool front) const {
+    auto &angular = chassis.getAngularVelocity();
+    if (front) {
+        return angular;
+    }
+
+    auto up = chassis.getWorldTransform().getBasis().getColumn(2);
+    return angular - up * static_cast<btScalar>(waistVelocity);
+}
+
+void VehicleProxy::follow() {
+    auto &transform = chassis.getWorldTransform();
+    auto &center = transform.getOrigin();
+    auto &linear = chassis.getLinearVelocity();
+
+    // The waist is at the center of the proxy, so the rear half moves as if
+    // it was the chassis spinning a little faster or slower
+    auto place = [&](btRigidBody &body, const btVector3 &offset, bool front) {
+        auto angular = halfAngularVelocity(front);
+        body.setWorldTransform(
+            halfTransform(transform, front) *
+            btTransform(btMatrix3x3::getIdentity(), offset));
+        auto &origin = body.getWorldTransform().getOrigin();
+        body.setLinearVelocity(pointVelocity(linear, angular, center, origin));
+        body.setAngularVelocity(angular);
+    };
+
+    place(vehicle.frontBody, vehicle.settings.frontOffset(), true);
+    place(vehicle.rearBody, vehicle.settings.rearOffset(), false);
+}
+
+void VehicleProxy::restore() const {
+    auto &s = vehicle.settings;
+    auto &transform = chassis.getWorldTransform();
+    auto &center = transform.getOrigin();
+    auto &linear = chassis.getLinearVelocity();
+
+    auto place = [&](btRigidBody &body,
+                     const btVector3 &offset,
+                     bool front,
+                     const btVector3 &spin) {
+        auto angular = halfAngularVelocity(front);
+        btTransform bodyTransform =
+            halfTransform(transform, front) *
+            btTransform(btMatrix3x3::getIdentity(), offset);
+        body.setWorldTransform(bodyTransform);
+        body.setInterpolationWorldTransform(bodyTransform);
+        body.setLinearVelocity(pointVelocity(
+            linear, angular, center, bodyTransform.getOrigin()));
+        body.setAngularVelocity(angular + spin);
+        body.setInterpolationLinearVelocity(body.getLinearVelocity());
+        body.setInterpolationAngularVelocity(body.getAngularVelocity());
+        body.clearForces();
+        body.activate(true);
+    };
+
+    place(vehicle.frontBody, s.frontOffset(), true, {0, 0, 0});
+    place(vehicle.rearBody, s.rearOffset(), false, {0, 0, 0});
+
+    for (size_t i = 0; i < vehicle.wheels.size(); ++i) {
+        auto &wheel = wheelPlacements[i];
+        auto basis = halfTransform(transform, wheel.second).getBasis();
+
+        // Rolling along the ground, the wheels rotate backwards around x
+        // when the vehicle moves forward along y
+        auto forward = linear.dot(basis.getColumn(1));
+        auto spin =
+            basis * btVector3(-forward / static_cast<btScalar>(s.wheelRadius),
+                              0,
+                              0);
+
+        place(vehicle.wheels[i].body,
+              s.wheelOffset(wheel.first, wheel.second),
+              wheel.second,
+              spin);
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,107 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "BulletDynamics/Dynamics/btActionInterface.h"
+#include "BulletDynamics/Dynamics/btDynamicsWorld.h"
+#include "BulletDynamics/Dynamics/btRigidBody.h"
+#include "BulletDynamics/Vehicle/btRaycastVehicle.h"
+
+namespace sim {
+
+class Vehicle1;
+
+//! Cheap stand in for a Vehicle1 that is far away from anything that
+//! needs the full model
+//!
+//! One rigid body with the shape of both halves and four raycast wheels
+//! instead of six bodies and five hinges. The waist is not simulated, its
+//! angle only steers both axles, and the throttle sets the speed that the
+//! wheels drive towards, the same as the wheel motors of the full model.
+//! After every step the front and rear bodies of the vehicle are moved to
+//! where the proxy is, with the rear turned by the waist angle, so code
+//! that reads them keeps working
+class VehicleProxy : public btActionInterface {
+public:
+    struct Settings {
+        double suspensionRestLength = .6;
+
+        //! Per unit of mass, as in btRaycastVehicle
+        double suspensionStiffness = 100;
+        double suspensionCompression = 6;
+        double suspensionDamping = 10;
+
+        double frictionSlip = 10;
+
+        //! Radians in each direction, the same as the waist can reach
+        double maxWaistAngle = .8;
+
+        //! Acceleration per m/s that the speed differs from the throttle
+        double speedGain = 4;
+        double maxAcceleration = 20;
+    };
+
+    //! Takes the place of the vehicle, which has to be removed from the
+    //! world. The position, velocity and waist angle are taken from its
+    //! bodies
+    VehicleProxy(btDynamicsWorld *world, Vehicle1 &vehicle);
+    VehicleProxy(btDynamicsWorld *world, Vehicle1 &vehicle, Settings settings);
+
+    //! Removes the proxy from the world
+    ~VehicleProxy() override;
+
+    VehicleProxy(const VehicleProxy &) = delete;
+    VehicleProxy &operator=(const VehicleProxy &) = delete;
+
+    //! Wheel speed in radians per second, what the wheel motors of the
+    //! full model drives towards
+    void throttle(double value) {
+        throttleValue = value;
+    }
+
+    //! Radians per second that the waist turns
+    void steering(double value) {
+        steeringValue = value;
+    }
+
+    //! Place all bodies of the vehicle where the proxy is, with the waist
+    //! at the angle of the proxy, and give them the velocity of the proxy
+    void restore() const;
+
+    void updateAction(btCollisionWorld *world, btScalar dt) override;
+
+    void debugDraw(btIDebugDraw *) override {
+    }
+
+    btRigidBody chassis;
+
+private:
+    //! Moves the front and rear body of the vehicle to the proxy
+    void follow();
+
+    //! Frame of the front or rear half when the proxy is at chassis. The
+    //! front half is the chassis and the rear is turned around the waist
+    //! joint, which is the origin of the chassis
+    btTransform halfTransform(const btTransform &chassis, bool front) const;
+
+    //! Angular velocity of the front or rear half
+    btVector3 halfAngularVelocity(bool front) const;
+
+    btDynamicsWorld *world;
+    Vehicle1 &vehicle;
+    Settings settings;
+
+    btDefaultVehicleRaycaster raycaster;
+    btRaycastVehicle raycastVehicle;
+
+    double throttleValue = 0;
+    double steeringValue = 0;
+
+    //! In the same sign as the hinge angle of the waist joint
+    double waistAngle = 0;
+
+    //! Radians per second that the waist turned in the last step
+    double waistVelocity = 0;
+};
+
+} // namespace sim
@@ -0,0 +1,165 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "world.h"
+
+#include "BulletDynamics/Featherstone/btMultiBodyConstraintSolver.h"
+
+#ifdef BT_THREADSAFE
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "BulletDynamics/ConstraintSolver/btConstraintSolverPoolMt.h"
+#include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+#include "LinearMath/btThreads.h"
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+#ifdef BT_THREADSAFE
+
+//! Bullets own scheduler, its workers spin between the short parallel
+//! sections in a step, which is what makes it faster than ThreadPool here
+//! There can only be one per process
+void taskScheduler(size_t threads) {
+    static unique_ptr<btITaskScheduler> scheduler = [] {
+        auto scheduler = unique_ptr<btITaskScheduler>(
+            btCreateDefaultTaskScheduler());
+        if (!scheduler) {
+            throw runtime_error("could not create bullet task scheduler");
+        }
+        btSetTaskScheduler(scheduler.get());
+        return scheduler;
+    }();
+
+    if (threads == 0) {
+        threads = max<size_t>(thread::hardware_concurrency(), 1);
+    }
+
+    auto maxThreads = static_cast<size_t>(scheduler->getMaxNumThreads());
+    scheduler->setNumThreads(static_cast<int>(min(threads, maxThreads)));
+}
+
+#endif
+
+} // namespace
+
+namespace sim {
+
+std::unique_ptr<btRigidBody> createRigidBody(btScalar mass,
+                                             btCollisionShape *shape) {
+    bool isDynamic = mass != 0.;
+
+    btVector3 localInertia(0, 0, 0);
+    if (isDynamic) {
+        shape->calculateLocalInertia(mass, localInertia);
+    }
+
+    return make_unique<btRigidBody>(mass, nullptr, shape, localInertia);
+}
+
+World::World(double groundHalfExtent)
+    : World(Settings{groundHalfExtent, 1, false}) {
+}
+
+World::World(Settings settings)
+    : collisionConfiguration(make_unique<btDefaultCollisionConfiguration>())
+    , broadphase(make_unique<btDbvtBroadphase>())
+    , groundHalfExtent(settings.groundHalfExtent) {
+
+    if (settings.multiBody) {
+        if (settings.threads != 1) {
+            throw runtime_error("multibody world can only use one thread");
+        }
+
+        dispatcher =
+            make_unique<btCollisionDispatcher>(collisionConfiguration.get());
+        auto multiBodySolver = make_unique<btMultiBodyConstraintSolver>();
+        auto multiBodyWorld = make_unique<btMultiBodyDynamicsWorld>(
+            dispatcher.get(),
+            broadphase.get(),
+            multiBodySolver.get(),
+            collisionConfiguration.get());
+        multiBody = multiBodyWorld.get();
+        dynamicsWorld = move(multiBodyWorld);
+        solver = move(multiBodySolver);
+    }
+    else if (settings.threads == 1) {
+        dispatcher =
+            make_unique<btCollisionDispatcher>(collisionConfiguration.get());
+        solver = make_unique<btSequentialImpulseConstraintSolver>();
+        dynamicsWorld =
+            make_unique<btDiscreteDynamicsWorld>(dispatcher.get(),
+                                                 broadphase.get(),
+                                                 solver.get(),
+                                                 collisionConfiguration.get());
+    }
+    else {
+#ifdef BT_THREADSAFE
+        taskScheduler(settings.threads);
+
+        // One solver per thread, islands are solved in parallel
+        auto pool = make_unique<btConstraintSolverPoolMt>(BT_MAX_THREAD_COUNT);
+
+        dispatcher =
+            make_unique<btCollisionDispatcherMt>(collisionConfiguration.get());
+        dynamicsWorld = make_unique<btDiscreteDynamicsWorldMt>(
+            dispatcher.get(),
+            broadphase.get(),
+            pool.get(),
+            nullptr,
+            collisionConfiguration.get());
+        solver = move(pool);
+        multithreaded = true;
+#else
+        throw runtime_error(
+            "multithreaded world needs bullet built with BT_THREADSAFE");
+#endif
+    }
+
+    dynamicsWorld->setGravity(btVector3(0, 0, -100));
+
+    if (groundHalfExtent <= 0) {
+        return;
+    }
+
+    groundShape = std::make_unique<btBoxShape>(btVector3(
+        groundHalfExtent, groundHalfExtent, groundHalfExtent));
+
+    btTransform groundTransform;
+    groundTransform.setIdentity();
+    groundTransform.setOrigin(btVector3(0, 0, -groundHalfExtent - 1));
+
+    groundBody = createRigidBody(0, groundShape.get());
+    groundBody->setWorldTransform(groundTransform);
+
+    dynamicsWorld->addRigidBody(groundBody.get());
+}
+
+size_t World::threads() const {
+#ifdef BT_THREADSAFE
+    if (multithreaded) {
+        return static_cast<size_t>(btGetTaskScheduler()->getNumThreads());
+    }
+#endif
+    return 1;
+}
+
+bool World::supportsMultithreading() {
+#ifdef BT_THREADSAFE
+    return true;
+#else
+    return false;
+#endif
+}
+
+World::~World() {
+    if (groundBody) {
+        dynamicsWorld->removeRigidBody(groundBody.get());
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,86 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "arena.h"
+
+#include "btBulletCollisionCommon.h"
+#include "btBulletDynamicsCommon.h"
+
+#include "BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h"
+
+#include <memory>
+
+namespace sim {
+
+std::unique_ptr<btRigidBody> createRigidBody(btScalar mass,
+                                             btCollisionShape *shape);
+
+//! The physics world and the static ground that every scene starts from
+//! Does not depend on any graphics so it can be used without a window
+//! A groundHalfExtent of 0 leaves out the ground box, for when Terrain is
+//! used instead
+struct World {
+    struct Settings {
+        double groundHalfExtent = 50;
+
+        //! Threads used for stepping. 1 uses the sequential solver and
+        //! dispatcher, which is the only setup that gives bit exact replays.
+        //! Anything else uses bullets multithreaded world, which needs
+        //! bullet to be built with BT_THREADSAFE. 0 means one thread per
+        //! hardware thread
+        size_t threads = 1;
+
+        //! Use a btMultiBodyDynamicsWorld, that can step MultiBodyVehicle1
+        //! as well as ordinary rigid bodies. Only with one thread
+        bool multiBody = false;
+    };
+
+    World(double groundHalfExtent = 50);
+    World(Settings settings);
+
+    ~World();
+
+    World(const World &) = delete;
+    World &operator=(const World &) = delete;
+
+    //! Memory for the vehicles that are spawned in this world, freed all at
+    //! once with the world. Declared first so that it outlives everything
+    //! else
+    Arena arena;
+
+    std::unique_ptr<btDefaultCollisionConfiguration> collisionConfiguration;
+    std::unique_ptr<btCollisionDispatcher> dispatcher;
+    std::unique_ptr<btBroadphaseInterface> broadphase;
+    std::unique_ptr<btConstraintSolver> solver;
+    std::unique_ptr<btDiscreteDynamicsWorld> dynamicsWorld;
+
+    //! Null when there is no ground box
+    std::unique_ptr<btBoxShape> groundShape;
+    std::unique_ptr<btRigidBody> groundBody;
+
+    const double groundHalfExtent;
+
+    //! Number of threads that steps the world
+    //! The task scheduler is shared by all worlds in the process, so this
+    //! changes if another multithreaded world is created with another count
+    size_t threads() const;
+
+    bool isMultithreaded() const {
+        return multithreaded;
+    }
+
+    //! Null if the world is not created with Settings::multiBody
+    btMultiBodyDynamicsWorld *multiBodyWorld() const {
+        return multiBody;
+    }
+
+    //! True if bullet is built with BT_THREADSAFE
+    static bool supportsMultithreading();
+
+private:
+    bool multithreaded = false;
+    btMultiBodyDynamicsWorld *multiBody = nullptr;
+};
+
+} // namespace sim
@@ -0,0 +1,311 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#include "worldstate.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+template <typename T>
+void writeValue(ostream &stream, const T &value) {
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+void readValue(istream &stream, T &value) {
+    if (!stream.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+        throw runtime_error("world state: unexpected end of stream");
+    }
+}
+
+void writeVector(ostream &stream, const btVector3 &v) {
+    for (int i = 0; i < 3; ++i) {
+        writeValue(stream, v[i]);
+    }
+}
+
+void readVector(istream &stream, btVector3 &v) {
+    btScalar values[3];
+    for (auto &value : values) {
+        readValue(stream, value);
+    }
+    v.setValue(values[0], values[1], values[2]);
+}
+
+void writeTransform(ostream &stream, const btTransform &t) {
+    for (int i = 0; i < 3; ++i) {
+        writeVector(stream, t.getBasis()[i]);
+    }
+    writeVector(stream, t.getOrigin());
+}
+
+void readTransform(istream &stream, btTransform &t) {
+    for (int i = 0; i < 3; ++i) {
+        readVector(stream, t.getBasis()[i]);
+    }
+    readVector(stream, t.getOrigin());
+}
+
+bool equal(const btVector3 &a, const btVector3 &b) {
+    return memcmp(&a[0], &b[0], sizeof(btScalar) * 3) == 0;
+}
+
+bool equal(const btTransform &a, const btTransform &b) {
+    return equal(a.getOrigin(), b.getOrigin()) &&
+           equal(a.getBasis()[0], b.getBasis()[0]) &&
+           equal(a.getBasis()[1], b.getBasis()[1]) &&
+           equal(a.getBasis()[2], b.getBasis()[2]);
+}
+
+bool equal(btScalar a, btScalar b) {
+    return memcmp(&a, &b, sizeof(btScalar)) == 0;
+}
+
+} // namespace
+
+namespace sim {
+
+void WorldState::capture(btDynamicsWorld &world) {
+    bodies.clear();
+    hinges.clear();
+
+    auto &objects = world.getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); ++i) {
+        auto body = btRigidBody::upcast(objects[i]);
+        if (!body) {
+            continue;
+        }
+
+        bodies.push_back({
+            body->getWorldTransform(),
+            body->getInterpolationWorldTransform(),
+            body->getLinearVelocity(),
+            body->getAngularVelocity(),
+            body->getInterpolationLinearVelocity(),
+            body->getInterpolationAngularVelocity(),
+            body->getDeactivationTime(),
+            body->getActivationState(),
+        });
+    }
+
+    for (int i = 0; i < world.getNumConstraints(); ++i) {
+        auto constraint = world.getConstraint(i);
+        if (constraint->getConstraintType() != HINGE_CONSTRAINT_TYPE) {
+            continue;
+        }
+
+        auto hinge = static_cast<btHingeConstraint *>(constraint);
+        hinges.push_back({
+            hinge->getMotorTargetVelocity(),
+            hinge->getMaxMotorImpulse(),
+            hinge->getEnableAngularMotor(),
+        });
+    }
+}
+
+void WorldState::restore(btDynamicsWorld &world) const {
+    auto &objects = world.getCollisionObjectArray();
+
+    size_t bodyIndex = 0;
+    for (int i = 0; i < objects.size(); ++i) {
+        auto body = btRigidBody::upcast(objects[i]);
+        if (!body) {
+            continue;
+        }
+
+        if (bodyIndex >= bodies.size()) {
+            throw runtime_error("world state: world has more bodies");
+        }
+
+        auto &state = bodies[bodyIndex++];
+
+        // Also updates the world inertia tensor
+        body->setCenterOfMassTransform(state.transform);
+        body->setInterpolationWorldTransform(state.interpolationTransform);
+        body->setLinearVelocity(state.linearVelocity);
+        body->setAngularVelocity(state.angularVelocity);
+        body->setInterpolationLinearVelocity(state.interpolationLinearVelocity);
+        body->setInterpolationAngularVelocity(
+            state.interpolationAngularVelocity);
+        body->forceActivationState(state.activationState);
+        body->setDeactivationTime(state.deactivationTime);
+        body->clearForces();
+    }
+
+    if (bodyIndex != bodies.size()) {
+        throw runtime_error("world state: world has fewer bodies");
+    }
+
+    size_t hingeIndex = 0;
+    for (int i = 0; i < world.getNumConstraints(); ++i) {
+        auto constraint = world.getConstraint(i);
+        if (constraint->getConstraintType() != HINGE_CONSTRAINT_TYPE) {
+            continue;
+        }
+
+        if (hingeIndex >= hinges.size()) {
+            throw runtime_error("world state: world has more hinges");
+        }
+
+        auto &state = hinges[hingeIndex++];
+        auto hinge = static_cast<btHingeConstraint *>(constraint);
+        hinge->enableAngularMotor(state.motorEnabled,
+                                  state.motorTargetVelocity,
+                                  state.maxMotorImpulse);
+    }
+
+    if (hingeIndex != hinges.size()) {
+        throw runtime_error("world state: world has fewer hinges");
+    }
+}
+
+void WorldState::write(std::ostream &stream) const {
+    writeValue(stream, static_cast<uint32_t>(bodies.size()));
+    for (auto &body : bodies) {
+        writeTransform(stream, body.transform);
+        writeTransform(stream, body.interpolationTransform);
+        writeVector(stream, body.linearVelocity);
+        writeVector(stream, body.angularVelocity);
+        writeVector(stream, body.interpolationLinearVelocity);
+        writeVector(stream, body.interpolationAngularVelocity);
+        writeValue(stream, body.deactivationTime);
+        writeValue(stream, static_cast<int32_t>(body.activationState));
+    }
+
+    writeValue(stream, static_cast<uint32_t>(hinges.size()));
+    for (auto &hinge : hinges) {
+        writeValue(stream, hinge.motorTargetVelocity);
+        writeValue(stream, hinge.maxMotorImpulse);
+        writeValue(stream, static_cast<uint8_t>(hinge.motorEnabled));
+    }
+}
+
+void WorldState::read(std::istream &stream) {
+    uint32_t size;
+
+    readValue(stream, size);
+    bodies.resize(size);
+    for (auto &body : bodies) {
+        int32_t activationState;
+        readTransform(stream, body.transform);
+        readTransform(stream, body.interpolationTransform);
+        readVector(stream, body.linearVelocity);
+        readVector(stream, body.angularVelocity);
+        readVector(stream, body.interpolationLinearVelocity);
+        readVector(stream, body.interpolationAngularVelocity);
+        readValue(stream, body.deactivationTime);
+        readValue(stream, activationState);
+        body.activationState = activationState;
+    }
+
+    readValue(stream, size);
+    hinges.resize(size);
+    for (auto &hinge : hinges) {
+        uint8_t enabled;
+        readValue(stream, hinge.motorTargetVelocity);
+        readValue(stream, hinge.maxMotorImpulse);
+        readValue(stream, enabled);
+        hinge.motorEnabled = enabled;
+    }
+}
+
+bool WorldState::operator==(const WorldState &other) const {
+    if (bodies.size() != other.bodies.size() ||
+        hinges.size() != other.hinges.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        auto &a = bodies[i];
+        auto &b = other.bodies[i];
+        if (!equal(a.transform, b.transform) ||
+            !equal(a.interpolationTransform, b.interpolationTransform) ||
+            !equal(a.linearVelocity, b.linearVelocity) ||
+            !equal(a.angularVelocity, b.angularVelocity) ||
+            !equal(a.interpolationLinearVelocity,
+                   b.interpolationLinearVelocity) ||
+            !equal(a.interpolationAngularVelocity,
+                   b.interpolationAngularVelocity) ||
+            !equal(a.deactivationTime, b.deactivationTime) ||
+            a.activationState != b.activationState) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < hinges.size(); ++i) {
+        auto &a = hinges[i];
+        auto &b = other.hinges[i];
+        if (!equal(a.motorTargetVelocity, b.motorTargetVelocity) ||
+            !equal(a.maxMotorImpulse, b.maxMotorImpulse) ||
+            a.motorEnabled != b.motorEnabled) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void resetWorldCaches(btDynamicsWorld &world) {
+    struct Entry {
+        btCollisionObject *object;
+        int group;
+        int mask;
+    };
+
+    auto &objects = world.getCollisionObjectArray();
+
+    vector<Entry> entries;
+    entries.reserve(static_cast<size_t>(objects.size()));
+
+    for (int i = 0; i < objects.size(); ++i) {
+        auto proxy = objects[i]->getBroadphaseHandle();
+        entries.push_back({objects[i],
+                           proxy->m_collisionFilterGroup,
+                           proxy->m_collisionFilterMask});
+    }
+
+    // Removing from the back keeps the order of the remaining objects
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        if (auto body = btRigidBody::upcast(it->object)) {
+            world.removeRigidBody(body);
+        }
+        else {
+            world.removeCollisionObject(it->object);
+        }
+    }
+
+    // The broadphase only resets its internal state when it is empty
+    world.getBroadphase()->resetPool(world.getDispatcher());
+    world.getConstraintSolver()->reset();
+
+    for (auto &entry : entries) {
+        if (auto body = btRigidBody::upcast(entry.object)) {
+            // Activation state is changed for static bodies when added
+            auto activationState = body->getActivationState();
+            world.addRigidBody(body, entry.group, entry.mask);
+            body->forceActivationState(activationState);
+        }
+        else {
+            world.addCollisionObject(entry.object, entry.group, entry.mask);
+        }
+    }
+}
+
+void clearContacts(btDynamicsWorld &world) {
+    auto dispatcher = world.getDispatcher();
+    auto cache = world.getBroadphase()->getOverlappingPairCache();
+    auto &pairs = cache->getOverlappingPairArray();
+
+    // The algorithms and their manifolds go back to the pools of the
+    // dispatcher and are created again in the next step
+    for (int i = 0; i < pairs.size(); ++i) {
+        cache->cleanOverlappingPair(pairs[i], dispatcher);
+    }
+
+    world.getConstraintSolver()->reset();
+}
+
+} // namespace sim
@@ -0,0 +1,67 @@
+// Copyright © Mattias Larsson Sköld 2020
+
+#pragma once
+
+#include "btBulletDynamicsCommon.h"
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace sim {
+
+//! The dynamic state of every rigid body and hinge in a world
+//! Can only be restored into a world with the same bodies and constraints,
+//! added in the same order
+struct WorldState {
+    struct Body {
+        btTransform transform;
+        btTransform interpolationTransform;
+        btVector3 linearVelocity;
+        btVector3 angularVelocity;
+        btVector3 interpolationLinearVelocity;
+        btVector3 interpolationAngularVelocity;
+        btScalar deactivationTime;
+        int activationState;
+    };
+
+    struct Hinge {
+        btScalar motorTargetVelocity;
+        btScalar maxMotorImpulse;
+        bool motorEnabled;
+    };
+
+    void capture(btDynamicsWorld &world);
+
+    //! Throws std::runtime_error if the world does not match the state
+    void restore(btDynamicsWorld &world) const;
+
+    void write(std::ostream &stream) const;
+
+    //! Throws std::runtime_error on read errors
+    void read(std::istream &stream);
+
+    //! Bitwise comparison, used to check that replays are exact
+    bool operator==(const WorldState &other) const;
+
+    bool operator!=(const WorldState &other) const {
+        return !(*this == other);
+    }
+
+    std::vector<Body> bodies;
+    std::vector<Hinge> hinges;
+};
+
+//! Remove and add back every object to rebuild the broadphase from scratch,
+//! and throw away all contact caches. After this the next step only depends
+//! on the state in WorldState, which is what makes seeking in a recording
+//! bit exact
+void resetWorldCaches(btDynamicsWorld &world);
+
+//! Throw away the contacts and collision algorithms but keep the
+//! broadphase. Unlike resetWorldCaches this does not allocate, but the
+//! pairs may be found in another order after it, so the steps that follow
+//! are not bit exact
+void clearContacts(btDynamicsWorld &world);
+
+} // namespace sim